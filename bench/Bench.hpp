@@ -0,0 +1,41 @@
+#pragma once
+
+// Helpers shared by the benchmarks, defined once so that all of them
+// measure the same way.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "Accumulator.hpp"
+#include "Image.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+inline double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// per-pixel luminance RMSE of an image against the reference, luminance
+// clipped to [0, 1] like the PNG: lights seen directly and their
+// antialiased edges don't dominate it, and neither do the pixels some
+// scenes (negative albedos) make negative
+inline double RMSE(const HDRImage &image, const HDRImage &reference) {
+  double squared = 0;
+  size_t pixels = image.height * image.width;
+  for (size_t i = 0; i < pixels; i++) {
+    const float *a = &image.data[i * 3], *b = &reference.data[i * 3];
+    double diff =
+        std::clamp(Accumulator::luminance(a[0], a[1], a[2]), 0.0, 1.0) -
+        std::clamp(Accumulator::luminance(b[0], b[1], b[2]), 0.0, 1.0);
+    squared += diff * diff;
+  }
+  return std::sqrt(squared / pixels);
+}
+
+inline double MeanLuminance(const HDRImage &image) {
+  double sum = 0;
+  for (size_t i = 0; i < image.data.size(); i += 3)
+    sum += Accumulator::luminance(image.data[i], image.data[i + 1],
+                                  image.data[i + 2]);
+  return sum / (image.height * image.width);
+}
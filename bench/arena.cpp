@@ -0,0 +1,172 @@
+// scene arena vs. one heap allocation per object: build, trace, teardown
+// and reload times of the weekend scene, with a fresh and a fragmented heap
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "include/Random.hpp"
+#include "Camera.hpp"
+#include "BVH.hpp"
+#include "Scene.hpp"
+#include "Scenes.hpp"
+#include "Sphere.hpp"
+#include "Bench.hpp"
+
+// how Scene stored its objects before the arena: a unique_ptr each
+struct HeapScene {
+  std::vector<std::unique_ptr<Material>> materials;
+  std::vector<std::unique_ptr<Hittable>> primitives;
+  HittableList world;
+
+  template <typename T, typename... Args>
+  const T *addMaterial(Args &&...args) {
+    materials.push_back(std::make_unique<T>(std::forward<Args>(args)...));
+    return static_cast<const T *>(materials.back().get());
+  }
+
+  template <typename T, typename... Args>
+  const T *add(Args &&...args) {
+    primitives.push_back(std::make_unique<T>(std::forward<Args>(args)...));
+    world.add(primitives.back().get());
+    return static_cast<const T *>(primitives.back().get());
+  }
+
+  void clear() {
+    world.clear();
+    primitives.clear();
+    materials.clear();
+  }
+};
+
+// the spheres of WeekendScene(gridSize), drawn once so both scenes get the
+// same ones
+struct SphereDesc {
+  float3 center;
+  mfloat radius;
+  MaterialType type;
+  float3 albedo;
+  mfloat fuzz;
+};
+
+std::vector<SphereDesc> WeekendSpheres(int gridSize, RNG &rng) {
+  std::vector<SphereDesc> res;
+  res.push_back({float3(0, -1000, 0), 1000, MaterialType::Lambertian,
+                 float3(0.5, 0.5, 0.5), 0});
+  for (int a = -gridSize; a < gridSize; a++) {
+    for (int b = -gridSize; b < gridSize; b++) {
+      mfloat choose = rng.nextFloat();
+      float3 center(a + 0.9 * rng.nextFloat(), 0.2, b + 0.9 * rng.nextFloat());
+      float3 albedo(rng.nextFloat(), rng.nextFloat(), rng.nextFloat());
+      MaterialType type = choose < 0.8    ? MaterialType::Lambertian
+                          : choose < 0.95 ? MaterialType::Metal
+                                          : MaterialType::Dielectric;
+      res.push_back({center, 0.2, type, albedo, rng.nextFloat(0, 0.5)});
+    }
+  }
+  res.push_back({float3(0, 1, 0), 1, MaterialType::Dielectric, {}, 0});
+  res.push_back({float3(-4, 1, 0), 1, MaterialType::Lambertian,
+                 float3(0.4, 0.2, 0.1), 0});
+  res.push_back({float3(4, 1, 0), 1, MaterialType::Metal,
+                 float3(0.7, 0.6, 0.5), 0});
+  return res;
+}
+
+// a material and a sphere per description, interleaved like WeekendScene
+template <typename SceneType>
+void Build(SceneType &scene, const std::vector<SphereDesc> &spheres) {
+  if constexpr (std::is_same_v<SceneType, Scene>)
+    scene.template reserve<Sphere>(spheres.size());
+  for (const SphereDesc &s : spheres) {
+    const Material *material;
+    if (s.type == MaterialType::Lambertian)
+      material = scene.template addMaterial<Lambertian>(s.albedo);
+    else if (s.type == MaterialType::Metal)
+      material = scene.template addMaterial<Metal>(s.albedo, s.fuzz);
+    else
+      material = scene.template addMaterial<Dielectric>(mfloat(1.5));
+    scene.template add<Sphere>(s.radius, s.center, material);
+  }
+}
+
+// closest hit through the BVH, then the material's scatter: touches the
+// primitive and the material of every hit
+double Trace(const BVH &bvh, const std::vector<Ray> &rays, size_t &hits) {
+  RNG rng;
+  Sampler sampler(rng);
+  hits = 0;
+  auto start = Clock::now();
+  for (const Ray &ray : rays) {
+    auto result = bvh.hit(ray, Interval(0, INF));
+    if (!result.success) continue;
+    HitRecord &hit = result.ret;
+    hit.resolve(ray);
+    hits += hit.material->scatter(ray, hit, sampler).success;
+  }
+  return secondsSince(start);
+}
+
+// many small blocks of mixed sizes with every other one freed, like the
+// heap of a renderer that has been running for a while
+struct FragmentedHeap {
+  std::vector<std::unique_ptr<char[]>> blocks;
+
+  FragmentedHeap(size_t count, RNG &rng) {
+    for (size_t i = 0; i < count; i++)
+      blocks.emplace_back(new char[16 + rng.nextUInt() % 128]);
+    for (size_t i = 0; i < count; i += 2) blocks[i].reset();
+  }
+};
+
+template <typename SceneType>
+void Run(const char *name, const std::vector<SphereDesc> &spheres,
+         const std::vector<Ray> &rays) {
+  SceneType scene;
+  auto start = Clock::now();
+  Build(scene, spheres);
+  double buildSecs = secondsSince(start);
+  BVH bvh(scene.world);
+
+  size_t hits;
+  double traceSecs = Trace(bvh, rays, hits);
+
+  // back to back: tear down and build the same scene again
+  start = Clock::now();
+  scene.clear();
+  double clearSecs = secondsSince(start);
+  start = Clock::now();
+  Build(scene, spheres);
+  double rebuildSecs = secondsSince(start);
+
+  size_t allocations = 2 * spheres.size();
+  if constexpr (std::is_same_v<SceneType, Scene>)
+    allocations = scene.arena.stats().allocations;
+  print("  ", name, ": build", buildSecs * 1e3, "ms, trace",
+        rays.size() / traceSecs / 1e6, "Mrays/s,", hits, "hits");
+  print("      teardown", clearSecs * 1e3, "ms, rebuild", rebuildSecs * 1e3,
+        "ms,", allocations, "allocations");
+}
+
+int main() {
+  const int width = 320, height = 180;
+  RNG rng;
+  Sampler sampler(rng);
+  Camera camera{width, height, 20, WeekendCameraTransform()};
+  std::vector<Ray> rays;
+  for (int x = 0; x < height; x++)
+    for (int y = 0; y < width; y++)
+      rays.push_back(camera.rayToScreenPos(
+          (float2(x, y) + float2(0.5, 0.5)) / camera.screenSize, sampler));
+
+  for (int gridSize : {11, 44, 150}) {
+    auto spheres = WeekendSpheres(gridSize, rng);
+    print("spheres:", spheres.size());
+    Run<HeapScene>("heap ", spheres, rays);
+    Run<Scene>("arena", spheres, rays);
+
+    FragmentedHeap heap(4 * spheres.size(), rng);
+    print("  fragmented heap:");
+    Run<HeapScene>("heap ", spheres, rays);
+    Run<Scene>("arena", spheres, rays);
+  }
+  return 0;
+}
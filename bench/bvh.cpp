@@ -0,0 +1,77 @@
+// BVH vs. HittableList: build time, traversal time and hit equality
+#include <vector>
+
+#include "Camera.hpp"
+#include "BVH.hpp"
+#include "Scenes.hpp"
+#include "Bench.hpp"
+
+// trace every ray, return (hit time, primitive) per ray
+std::vector<HitRecord> traceAll(const Hittable &scene,
+                                const std::vector<Ray> &rays, double &secs) {
+  std::vector<HitRecord> hits(rays.size());
+  auto start = Clock::now();
+  for (size_t i = 0; i < rays.size(); i++) {
+    auto result = scene.hit(rays[i], Interval(0, INF));
+    if (result.success) {
+      hits[i] = result.ret;
+    } else {
+      hits[i].rayTime = INF;
+      hits[i].object = nullptr;
+    }
+  }
+  secs = secondsSince(start);
+  return hits;
+}
+
+int main() {
+  const int width = 320, height = 180;
+  for (int gridSize : {11, 22, 44}) {
+    Scene scene = WeekendScene(gridSize);
+
+    auto start = Clock::now();
+    BVH bvh(scene.world);
+    double buildSecs = secondsSince(start);
+
+    // primary rays of every pixel plus a diffuse bounce from each first hit
+    Camera camera{width, height, 20, WeekendCameraTransform()};
+    std::vector<Ray> rays;
+    RNG rng;
+    Sampler sampler(rng);
+    for (int x = 0; x < height; x++)
+      for (int y = 0; y < width; y++)
+        rays.push_back(camera.rayToScreenPos(
+            (float2(x, y) + float2(0.5, 0.5)) / camera.screenSize, sampler));
+    size_t primaryCount = rays.size();
+    for (size_t i = 0; i < primaryCount; i++) {
+      auto result = bvh.hit(rays[i], Interval(0, INF));
+      if (result.success) {
+        auto hit = result.ret;
+        hit.resolve(rays[i]);
+        rays.push_back(
+            Ray{hit.point, normalize(hit.normal + RandomInUnitSphere(rng))});
+      }
+    }
+
+    double listSecs, bvhSecs;
+    auto listHits = traceAll(scene.world, rays, listSecs);
+    auto bvhHits = traceAll(bvh, rays, bvhSecs);
+
+    // the first-hit image (hit time + primitive per pixel) must be identical
+    size_t mismatches = 0;
+    for (size_t i = 0; i < rays.size(); i++)
+      if (listHits[i].rayTime != bvhHits[i].rayTime ||
+          listHits[i].object != bvhHits[i].object)
+        mismatches++;
+
+    print("objects:", scene.world.objects.size(), "nodes:", bvh.tree.nodes.size(),
+          "rays:", rays.size());
+    print("  build:", buildSecs * 1e3, "ms");
+    print("  list: ", listSecs * 1e3, "ms,", rays.size() / listSecs / 1e6,
+          "Mrays/s");
+    print("  bvh:  ", bvhSecs * 1e3, "ms,", rays.size() / bvhSecs / 1e6,
+          "Mrays/s, speedup", listSecs / bvhSecs);
+    print("  mismatched hits:", mismatches);
+  }
+  return 0;
+}
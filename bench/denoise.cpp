@@ -0,0 +1,85 @@
+// denoiser: RMSE of noisy and denoised renders against a high-spp
+// reference, on the weekend scene with its defocus blur, and the spp a
+// noisy render would need for the denoised error (error falls as
+// 1 / sqrt(spp)). Then the denoiser's speed at 1080p on one thread and on
+// all of them.
+//
+// options: --scene PATH (use a scene file instead)
+#include <string>
+#include <omp.h>
+
+#include "Camera.hpp"
+#include "SphereSet.hpp"
+#include "Scenes.hpp"
+#include "SceneFile.hpp"
+#include "Bench.hpp"
+
+int main(int argc, char **argv) {
+  std::string scenePath;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string option = argv[i], value = argv[i + 1];
+    if (option == "--scene") scenePath = value;
+    else print("unknown option:", option);
+  }
+
+  Scene scene;
+  SphereSet spheres;
+  SceneFile file;
+  const Hittable *world = &spheres;
+  Camera camera{320, 180, 20};
+  if (scenePath.empty()) {
+    scene = WeekendScene();
+    spheres = SphereSet(scene.world);
+    auto camTrans = WeekendCameraTransform();
+    camera = Camera{320, 180, 20, camTrans, DefocusDisk{2, 10, 0.1, camTrans}};
+    camera.maxDepth = 40;
+  } else {
+    file.load(scenePath, false);
+    world = &file.world();
+    camera = file.camera;
+    camera = Camera(320, 180, camera.VFoV, camera.camTrans, camera.ddisk);
+    camera.maxDepth = file.camera.maxDepth;
+    camera.sky = file.camera.sky;
+  }
+
+  // a seed of its own, the reference's noise is independent of the renders
+  camera.seed = 12345;
+  camera.samplesPerPixel = 2048;
+  auto reference = camera.render(*world, false);
+  print("reference:", camera.samplesPerPixel, "spp,",
+        camera.pathStats.seconds, "s");
+
+  camera.seed = 0;
+  camera.denoise = true;
+  for (int spp : {16, 64, 256}) {
+    camera.samplesPerPixel = spp;
+    auto start = Clock::now();
+    auto denoised = camera.render(*world, false);
+    double seconds = secondsSince(start);
+    double noisyError = RMSE(camera.noisyImage, reference);
+    double denoisedError = RMSE(denoised, reference);
+    print(spp, "spp: RMSE noisy", noisyError, "denoised", denoisedError,
+          "(as noisy at about",
+          spp * (noisyError / denoisedError) * (noisyError / denoisedError),
+          "spp),", seconds - camera.pathStats.seconds,
+          "s for features and denoising");
+  }
+
+  // speed, on a 1080p frame of 1 spp
+  camera = Camera(1920, 1080, camera.VFoV, camera.camTrans, camera.ddisk);
+  camera.samplesPerPixel = 1;
+  camera.featureSamples = 1;
+  camera.denoise = true;
+  camera.render(*world, false);
+  HDRImage variance(camera.height, camera.width, 1);
+  for (int threads : {1, omp_get_max_threads()}) {
+    omp_set_num_threads(threads);
+    auto start = Clock::now();
+    for (int repeat = 0; repeat < 3; repeat++)
+      camera.denoiser.denoise(camera.noisyImage, variance, camera.features);
+    double seconds = secondsSince(start) / 3;
+    print("1920x1080,", threads, "threads:", seconds * 1e3, "ms,",
+          1920 * 1080 / seconds / 1e6, "Mpixels/s");
+  }
+  return 0;
+}
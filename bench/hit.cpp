@@ -0,0 +1,49 @@
+// HittableList::hit throughput, single thread and all threads
+#include <vector>
+#include <omp.h>
+
+#include "Camera.hpp"
+#include "Scenes.hpp"
+#include "Bench.hpp"
+
+// closest hit + surface data of the closest hit, like Camera::rayColor
+double traceAll(const Hittable &scene, const std::vector<Ray> &rays,
+                int threads, size_t &hitCount) {
+  size_t count = 0;
+  auto start = Clock::now();
+#pragma omp parallel for num_threads(threads) reduction(+ : count)
+  for (size_t i = 0; i < rays.size(); i++) {
+    auto result = scene.hit(rays[i], Interval(0, INF));
+    if (result.success) {
+      auto hit = result.ret;
+      hit.resolve(rays[i]);
+      count += hit.material != nullptr;
+    }
+  }
+  hitCount = count;
+  return secondsSince(start);
+}
+
+int main() {
+  Scene scene = WeekendScene();
+
+  // jittered primary rays over a 320x180 frame
+  Camera camera{320, 180, 20, WeekendCameraTransform()};
+  std::vector<Ray> rays;
+  RNG rng;
+  Sampler sampler(rng);
+  for (int x = 0; x < camera.height; x++)
+    for (int y = 0; y < camera.width; y++)
+      rays.push_back(camera.rayToScreenPos(
+          camera.getRandomSamplePos(x, y, sampler) / camera.screenSize,
+          sampler));
+
+  print("objects:", scene.world.objects.size(), "rays:", rays.size());
+  for (int threads : {1, omp_get_max_threads()}) {
+    size_t hitCount;
+    double secs = traceAll(scene.world, rays, threads, hitCount);
+    print("  threads:", threads, "hits:", hitCount, "time:", secs * 1e3,
+          "ms,", rays.size() / secs / 1e6, "Mrays/s");
+  }
+  return 0;
+}
@@ -0,0 +1,158 @@
+// instancing: memory of thousands of copies of one mesh against flattening
+// them, trace speed through the two-level BVH, and hits of an instance
+// against the same geometry placed directly
+#include <cmath>
+#include <vector>
+
+#include "include/Random.hpp"
+#include "MeshLoader.hpp"
+#include "TriangleMesh.hpp"
+#include "Instance.hpp"
+#include "BVH.hpp"
+#include "Bench.hpp"
+
+// unit sphere of rings x 2 * rings quads, counter-clockwise from outside
+MeshData SphereData(int rings) {
+  int segments = 2 * rings;
+  MeshData data;
+  data.positions.push_back(float3(0, 1, 0));
+  for (int r = 1; r < rings; r++) {
+    double theta = PI * r / rings;
+    for (int s = 0; s < segments; s++) {
+      double phi = 2 * PI * s / segments;
+      data.positions.push_back(float3(std::sin(theta) * std::cos(phi),
+                                      std::cos(theta),
+                                      std::sin(theta) * std::sin(phi)));
+    }
+  }
+  data.positions.push_back(float3(0, -1, 0));
+
+  auto ring = [&](int r, int s) {
+    return uint32_t(1 + (r - 1) * segments + (s % segments));
+  };
+  auto add = [&](uint32_t a, uint32_t b, uint32_t c) {
+    data.indices.insert(data.indices.end(), {a, b, c});
+  };
+  uint32_t bottom = data.positions.size() - 1;
+  for (int s = 0; s < segments; s++) {
+    add(0, ring(1, s + 1), ring(1, s));
+    for (int r = 1; r + 1 < rings; r++) {
+      add(ring(r, s), ring(r, s + 1), ring(r + 1, s + 1));
+      add(ring(r, s), ring(r + 1, s + 1), ring(r + 1, s));
+    }
+    add(bottom, ring(rings - 1, s), ring(rings - 1, s + 1));
+  }
+  return data;
+}
+
+// the mesh with every vertex moved by the transform
+TriangleMesh Flatten(const TriangleMesh &mesh, const Transform &transform) {
+  std::vector<float3> positions(mesh.positions.size());
+  for (size_t i = 0; i < positions.size(); i++)
+    positions[i] = transform.toWorld.applyPoint(mesh.positions[i]);
+  return TriangleMesh(
+      std::move(positions),
+      std::vector<uint32_t>(mesh.indices.begin(), mesh.indices.end()),
+      nullptr);
+}
+
+// rays from random points around the box towards random points inside it
+std::vector<Ray> RaysInto(const AABB &box, size_t count, RNG &rng) {
+  float3 center = (box.min + box.max) / 2, extent = box.max - box.min;
+  auto inside = [&] {
+    return box.min + extent * float3(rng.nextFloat(), rng.nextFloat(),
+                                     rng.nextFloat());
+  };
+  std::vector<Ray> rays;
+  for (size_t i = 0; i < count; i++) {
+    float3 origin = center + normalize(RandomInUnitSphere(rng)) *
+                                 extent.length();
+    rays.push_back({origin, normalize(inside() - origin)});
+  }
+  return rays;
+}
+
+// hits of a against b: rays whose hit / miss differs, and the largest
+// relative difference of hit time and point among the rays both hit
+void Compare(const char *name, const Hittable &a, const Hittable &b,
+             const std::vector<Ray> &rays) {
+  size_t differ = 0, hits = 0;
+  double timeError = 0, pointError = 0;
+  for (const Ray &ray : rays) {
+    auto ra = a.hit(ray, Interval(0, INF)), rb = b.hit(ray, Interval(0, INF));
+    if (ra.success != rb.success) differ++;
+    if (!ra.success || !rb.success) continue;
+    hits++;
+    ra.ret.resolve(ray);
+    rb.ret.resolve(ray);
+    timeError = std::max<double>(timeError,
+                                 std::abs(ra.ret.rayTime - rb.ret.rayTime) /
+                                     rb.ret.rayTime);
+    pointError = std::max<double>(
+        pointError,
+        maxAbs(ra.ret.point - rb.ret.point) / maxAbs(rb.ret.point));
+  }
+  print(" ", name, ":", hits, "hits,", differ, "rays differ, max relative",
+        "error of time", timeError, "and point", pointError);
+}
+
+int main() {
+  RNG rng;
+  MeshData data = SphereData(300);
+  TriangleMesh mesh(std::move(data.positions), std::move(data.indices),
+                    nullptr);
+  double meshMiB = mesh.memoryBytes() / 1048576.0;
+  print("mesh:", mesh.triangleCount(), "triangles,", meshMiB, "MiB");
+
+  // the same triangles directly and through an instance
+  std::vector<Ray> rays = RaysInto(mesh.boundingBox(), 200000, rng);
+  Compare("identity instance vs mesh", Instance(&mesh, Transform()), mesh,
+          rays);
+  Transform moved = Transform::Translate(float3(3.5, -2, 7.25)) *
+                    Transform::Rotate(float3(1, 2, 3), 40) *
+                    Transform::Scale(float3(1.5, 0.5, 2));
+  TriangleMesh flat = Flatten(mesh, moved);
+  Compare("transformed instance vs moved vertices", Instance(&mesh, moved),
+          flat, RaysInto(flat.boundingBox(), 200000, rng));
+  flat = {};
+
+  for (int grid : {10, 32, 100}) {
+    // grid x grid copies, randomly rotated and scaled
+    std::vector<Instance> instances;
+    instances.reserve(size_t(grid) * grid);
+    for (int i = 0; i < grid; i++) {
+      for (int j = 0; j < grid; j++) {
+        mfloat scale = rng.nextFloat(0.5, 1.2);
+        Transform transform =
+            Transform::Translate(float3(3 * i, 0, 3 * j)) *
+            Transform::Rotate(RandomInUnitSphere(rng) + float3(0, 0, 1e-3),
+                              rng.nextFloat(0, 360)) *
+            Transform::Scale(float3(scale, scale, scale));
+        instances.emplace_back(&mesh, transform);
+      }
+    }
+    std::vector<const Hittable *> objects;
+    for (const Instance &instance : instances) objects.push_back(&instance);
+
+    auto start = Clock::now();
+    BVH top(objects);
+    double buildSecs = secondsSince(start);
+
+    size_t bytes = instances.size() * sizeof(Instance) +
+                   top.objects.size() * sizeof(const Hittable *) +
+                   top.tree.nodes.size() * sizeof(BVHNode);
+    print("instances:", instances.size(), ",", instances.size() * 1e-6 *
+          mesh.triangleCount(), "M triangles, top build", buildSecs * 1e3,
+          "ms");
+    print("  memory: mesh + instances", meshMiB + bytes / 1048576.0,
+          "MiB, flattened", meshMiB * instances.size(), "MiB");
+
+    rays = RaysInto(top.boundingBox(), 100000, rng);
+    size_t hits = 0;
+    start = Clock::now();
+    for (const Ray &ray : rays) hits += top.hit(ray, Interval(0, INF)).success;
+    double secs = secondsSince(start);
+    print("  trace:", rays.size() / secs / 1e6, "Mrays/s,", hits, "hits");
+  }
+  return 0;
+}
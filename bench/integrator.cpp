@@ -0,0 +1,94 @@
+// iterative path tracer with Russian roulette vs. the former recursive one
+
+#include "Camera.hpp"
+#include "SphereSet.hpp"
+#include "Scenes.hpp"
+#include "Bench.hpp"
+
+// Camera::rayColor before it became iterative, kept as the reference
+ColorF3 RecursiveRayColor(const Camera &camera, const Ray &ray,
+                          const Hittable &scene, Sampler &sampler,
+                          uint64_t &rayCount,
+                          int depth = 0) {
+  if (depth >= camera.maxDepth) return ColorF3(0, 0, 0);
+  rayCount++;
+  auto result = scene.hit(ray, Interval(0, INF));
+  if (result.success) {
+    auto hit = result.ret;
+    hit.resolve(ray);
+    sampler.startVertex(depth);
+    auto matResult = hit.material->scatter(ray, hit, sampler);
+    if (matResult.success)
+      return matResult.ret.attenuation *
+             RecursiveRayColor(camera, matResult.ret.ray, scene, sampler,
+                               rayCount, depth + 1);
+    return ColorF3(0, 0, 0);
+  }
+  return Camera::skyColor(ray);
+}
+
+struct Run {
+  HDRImage image;
+  PathStats stats;
+};
+
+// single-threaded so both integrators are timed the same way
+template <typename Integrator>
+Run RenderWith(Camera &camera, Integrator &&integrator) {
+  Run run{HDRImage(camera.height, camera.width), {}};
+  auto start = Clock::now();
+  for (int x = 0; x < camera.height; x++) {
+    for (int y = 0; y < camera.width; y++) {
+      RNG rng(camera.seed, uint64_t(x) * camera.width + y);
+      ColorF3 sum(0, 0, 0);
+      for (int s = 0; s < camera.samplesPerPixel; s++) {
+        Sampler sampler(camera.samplerType, rng, camera.seed, x, y, s);
+        auto samplePos = camera.getRandomSamplePos(x, y, sampler);
+        auto ray =
+            camera.rayToScreenPos(samplePos / camera.screenSize, sampler);
+        sum += integrator(ray, sampler, run.stats.rays);
+      }
+      run.image.setPixel(x, y, sum / camera.samplesPerPixel);
+      run.stats.paths += camera.samplesPerPixel;
+    }
+  }
+  run.stats.seconds = secondsSince(start);
+  return run;
+}
+
+int main() {
+  Scene scene = WeekendScene();
+  SphereSet spheres(scene.world);
+  auto camTrans = WeekendCameraTransform();
+  Camera camera{160, 90, 20, camTrans, DefocusDisk{2, 10, 0.1, camTrans}};
+  camera.samplesPerPixel = 64;
+  camera.maxDepth = 40;
+
+  auto recursive = RenderWith(camera, [&](const Ray &ray, Sampler &sampler,
+                                          uint64_t &rays) {
+    return RecursiveRayColor(camera, ray, spheres, sampler, rays);
+  });
+  auto iterative = RenderWith(camera, [&](const Ray &ray, Sampler &sampler,
+                                          uint64_t &rays) {
+    return camera.rayColor(ray, spheres, sampler, &rays);
+  });
+  // roulette never starts before maxDepth
+  Camera noRoulette = camera;
+  noRoulette.rouletteMinDepth = camera.maxDepth;
+  auto iterativeNoRR = RenderWith(noRoulette, [&](const Ray &ray,
+                                                  Sampler &sampler,
+                                                  uint64_t &rays) {
+    return noRoulette.rayColor(ray, spheres, sampler, &rays);
+  });
+
+  for (auto [name, run] : {std::pair{"recursive", &recursive},
+                           std::pair{"iterative, no roulette", &iterativeNoRR},
+                           std::pair{"iterative", &iterative}}) {
+    print(name, "paths:", run->stats.paths, "rays:", run->stats.rays,
+          "average path length:", run->stats.averagePathLength());
+    print("  time:", run->stats.seconds, "s,", run->stats.mraysPerSecond(),
+          "Mrays/s,", run->stats.paths / run->stats.seconds / 1e6,
+          "Mpaths/s, mean luminance", MeanLuminance(run->image));
+  }
+  return 0;
+}
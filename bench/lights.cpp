@@ -0,0 +1,60 @@
+// next-event estimation: RMSE against a high-spp reference as the sample
+// count grows, with light sampling (and MIS) on and off, for a scene lit
+// only by a small sphere light and a quad light. Equal error should take
+// far fewer samples with light sampling; both must converge to the same
+// image.
+#include <vector>
+
+#include "Camera.hpp"
+#include "Scene.hpp"
+#include "TriangleMesh.hpp"
+#include "Bench.hpp"
+
+int main() {
+  Scene scene;
+  auto ground = scene.addMaterial<Lambertian>(ColorF3(0.5, 0.5, 0.5));
+  auto red = scene.addMaterial<Lambertian>(ColorF3(0.7, 0.2, 0.1));
+  auto white = scene.addMaterial<Lambertian>(ColorF3(0.8, 0.8, 0.8));
+  auto warm = scene.addMaterial<DiffuseLight>(ColorF3(40, 30, 20));
+  auto panel = scene.addMaterial<DiffuseLight>(ColorF3(16, 16, 16));
+  scene.add<Sphere>(mfloat(1000), float3(0, -1000, 0), ground);
+  scene.add<Sphere>(mfloat(1), float3(-1.2, 1, 0), red);
+  scene.add<Sphere>(mfloat(1), float3(1.2, 1, 0), white);
+  scene.add<Sphere>(mfloat(0.15), float3(0, 2.6, 1.5), warm);
+  // 1 x 1 quad at y = 3.5, facing down
+  TriangleMesh quad({float3(-0.5, 3.5, -0.5), float3(0.5, 3.5, -0.5),
+                     float3(0.5, 3.5, 0.5), float3(-0.5, 3.5, 0.5)},
+                    {0, 1, 2, 0, 2, 3}, panel);
+  HittableList world(&scene.world);
+  world.add(&quad);
+
+  CameraTransform camTrans{float3(0, 2, 9), float3(0, 1, 0), float3(0, 1, 0)};
+  Camera camera{128, 72, 30, camTrans};
+  camera.maxDepth = 16;
+  camera.sky = false;
+
+  camera.samplesPerPixel = 1024;
+  auto reference = camera.render(world, false);
+  print("reference:", camera.samplesPerPixel, "spp with light sampling,",
+        camera.pathStats.seconds, "s, mean luminance",
+        MeanLuminance(reference));
+
+  for (bool sampleLights : {false, true}) {
+    camera.sampleLights = sampleLights;
+    print(sampleLights ? "light sampling:" : "BSDF sampling only:");
+    for (int spp : {1, 4, 16, 64}) {
+      camera.samplesPerPixel = spp;
+      // a seed of its own, the reference's first samples would be reused
+      camera.seed = 7;
+      auto image = camera.render(world, false);
+      const auto &stats = camera.pathStats;
+      double rmse = RMSE(image, reference);
+      // lower is better: error at equal render time
+      print(" ", spp, "spp: RMSE", rmse, ",", stats.seconds, "s,",
+            stats.mraysPerSecond(), "Mrays/s, RMSE^2 x time",
+            rmse * rmse * stats.seconds, ", mean luminance",
+            MeanLuminance(image));
+    }
+  }
+  return 0;
+}
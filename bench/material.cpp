@@ -0,0 +1,118 @@
+// material dispatch: the virtual Material::scatter against Scatter(), which
+// switches on the material's type, for single scatters and whole paths
+#include <algorithm>
+#include <vector>
+
+#include "Camera.hpp"
+#include "SphereSet.hpp"
+#include "Scenes.hpp"
+#include "Bench.hpp"
+
+// Camera::rayColor as it was, with a virtual call per bounce
+ColorF3 VirtualRayColor(const Camera &camera, const Ray &cameraRay,
+                        const Hittable &scene, Sampler &sampler,
+                        uint64_t &rays) {
+  Ray ray = cameraRay;
+  ColorF3 throughput(1, 1, 1);
+  for (int depth = 0; depth < camera.maxDepth; depth++) {
+    rays++;
+    auto result = scene.hit(ray, Interval(0, INF));
+    if (!result.success) return throughput * Camera::skyColor(ray);
+    auto hit = result.ret;
+    hit.resolve(ray);
+    sampler.startVertex(depth);
+    auto matResult = hit.material->scatter(ray, hit, sampler);
+    if (!matResult.success) return ColorF3(0, 0, 0);
+    throughput *= matResult.ret.attenuation;
+    ray = matResult.ret.ray;
+    if (!camera.survivesRoulette(throughput, depth, sampler))
+      return ColorF3(0, 0, 0);
+  }
+  return ColorF3(0, 0, 0);
+}
+
+bool Same(const ColorF3 &a, const ColorF3 &b) {
+  return a.val[0] == b.val[0] && a.val[1] == b.val[1] && a.val[2] == b.val[2];
+}
+
+int main() {
+  const int width = 320, height = 180, spp = 4;
+  Scene scene = WeekendScene();
+  SphereSet spheres(scene.world);
+  Camera camera{width, height, 20, WeekendCameraTransform()};
+  camera.maxDepth = 40;
+
+  // first hits of the camera rays, scattered again and again
+  std::vector<Ray> rays;
+  std::vector<HitRecord> hits;
+  RNG rng;
+  Sampler sampler(rng);
+  for (int x = 0; x < height; x++) {
+    for (int y = 0; y < width; y++) {
+      Ray ray = camera.rayToScreenPos(
+          (float2(x, y) + float2(0.5, 0.5)) / camera.screenSize, sampler);
+      auto result = spheres.hit(ray, Interval(0, INF));
+      if (!result.success) continue;
+      result.ret.resolve(ray);
+      rays.push_back(ray);
+      hits.push_back(result.ret);
+    }
+  }
+  const int repeats = 20;
+  double secs[2];
+  ColorF3 sums[2];
+  for (int v = 0; v < 2; v++) {
+    RNG rng;
+    Sampler sampler(rng);
+    ColorF3 sum(0, 0, 0);
+    auto start = Clock::now();
+    for (int r = 0; r < repeats; r++) {
+      for (size_t i = 0; i < hits.size(); i++) {
+        auto res = v == 0 ? hits[i].material->scatter(rays[i], hits[i], sampler)
+                          : Scatter(*hits[i].material, rays[i], hits[i],
+                                    sampler);
+        if (res.success) sum += res.ret.attenuation + res.ret.ray.direction;
+      }
+    }
+    secs[v] = secondsSince(start);
+    sums[v] = sum;
+  }
+  double count = double(hits.size()) * repeats;
+  print("scatter of", hits.size(), "hits x", repeats);
+  print("  virtual:", count / secs[0] / 1e6, "M/s");
+  print("  switch: ", count / secs[1] / 1e6, "M/s, speedup", secs[0] / secs[1],
+        Same(sums[0], sums[1]) ? "same results" : "DIFFERENT results");
+
+  // whole paths, every pixel draws the same random numbers in both runs
+  std::vector<ColorF3> images[2];
+  uint64_t rayCounts[2] = {0, 0};
+  for (int v = 0; v < 2; v++) {
+    images[v].reserve(size_t(width) * height * spp);
+    auto start = Clock::now();
+    for (int x = 0; x < height; x++) {
+      for (int y = 0; y < width; y++) {
+        RNG rng(uint64_t(x) * width + y);
+        for (int s = 0; s < spp; s++) {
+          Sampler sampler(camera.samplerType, rng, camera.seed, x, y, s);
+          Ray ray = camera.rayToScreenPos(
+              camera.getRandomSamplePos(x, y, sampler) / camera.screenSize,
+              sampler);
+          images[v].push_back(
+              v == 0 ? VirtualRayColor(camera, ray, spheres, sampler,
+                                       rayCounts[0])
+                     : camera.rayColor(ray, spheres, sampler, &rayCounts[1]));
+        }
+      }
+    }
+    secs[v] = secondsSince(start);
+  }
+  print("rayColor,", width, "x", height, "x", spp, "spp,", rayCounts[0],
+        "rays");
+  print("  virtual:", rayCounts[0] / secs[0] / 1e6, "Mrays/s");
+  print("  switch: ", rayCounts[1] / secs[1] / 1e6, "Mrays/s, speedup",
+        secs[0] / secs[1],
+        std::equal(images[0].begin(), images[0].end(), images[1].begin(), Same)
+            ? "same image"
+            : "DIFFERENT image");
+  return 0;
+}
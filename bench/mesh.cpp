@@ -0,0 +1,172 @@
+// triangle meshes: OBJ / PLY load time and memory per million triangles,
+// BVH build, trace speed and a watertightness check
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "MeshLoader.hpp"
+#include "TriangleMesh.hpp"
+#include "Bench.hpp"
+
+// peak resident size in MiB since the last resetPeakMemory(), Linux only
+inline double peakMemoryMiB() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+    if (line.rfind("VmHWM:", 0) == 0) return std::stod(line.substr(6)) / 1024;
+  return NAN;
+}
+
+inline double currentMemoryMiB() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+    if (line.rfind("VmRSS:", 0) == 0) return std::stod(line.substr(6)) / 1024;
+  return NAN;
+}
+
+// also hands memory freed earlier back to the system, so that it isn't
+// counted as part of the next peak
+inline void resetPeakMemory() {
+#ifdef __GLIBC__
+  malloc_trim(0);
+#endif
+  std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+// unit sphere of rings x segments quads (triangles at the poles), written
+// straight to the file so the generator itself needs no memory
+struct SphereMesh {
+  int rings, segments;
+
+  size_t vertexCount() const { return 2 + size_t(rings - 1) * segments; }
+  size_t triangleCount() const { return 2 * size_t(segments) * (rings - 1); }
+
+  template <typename Func>
+  void forEachVertex(Func &&func) const {
+    func(float3(0, 1, 0));
+    for (int r = 1; r < rings; r++) {
+      double theta = PI * r / rings;
+      for (int s = 0; s < segments; s++) {
+        double phi = 2 * PI * s / segments;
+        func(float3(std::sin(theta) * std::cos(phi), std::cos(theta),
+                    std::sin(theta) * std::sin(phi)));
+      }
+    }
+    func(float3(0, -1, 0));
+  }
+
+  // counter-clockwise seen from outside
+  template <typename Func>
+  void forEachTriangle(Func &&func) const {
+    auto ring = [&](int r, int s) {
+      return uint32_t(1 + (r - 1) * segments + (s % segments));
+    };
+    uint32_t bottom = vertexCount() - 1;
+    for (int s = 0; s < segments; s++) {
+      func(0, ring(1, s + 1), ring(1, s));
+      for (int r = 1; r + 1 < rings; r++) {
+        func(ring(r, s), ring(r, s + 1), ring(r + 1, s + 1));
+        func(ring(r, s), ring(r + 1, s + 1), ring(r + 1, s));
+      }
+      func(bottom, ring(rings - 1, s), ring(rings - 1, s + 1));
+    }
+  }
+
+  void writeOBJ(const std::string &path) const {
+    FILE *f = std::fopen(path.c_str(), "w");
+    forEachVertex([&](const float3 &p) {
+      std::fprintf(f, "v %.9g %.9g %.9g\n", double(p.val[0]), double(p.val[1]),
+                   double(p.val[2]));
+    });
+    forEachTriangle([&](uint32_t a, uint32_t b, uint32_t c) {
+      std::fprintf(f, "f %u %u %u\n", a + 1, b + 1, c + 1);
+    });
+    std::fclose(f);
+  }
+
+  void writePLY(const std::string &path) const {
+    FILE *f = std::fopen(path.c_str(), "wb");
+    std::fprintf(f,
+                 "ply\nformat binary_little_endian 1.0\n"
+                 "element vertex %zu\nproperty float x\nproperty float y\n"
+                 "property float z\nelement face %zu\n"
+                 "property list uchar int vertex_indices\nend_header\n",
+                 vertexCount(), triangleCount());
+    forEachVertex([&](const float3 &p) {
+      float xyz[3] = {float(p.val[0]), float(p.val[1]), float(p.val[2])};
+      std::fwrite(xyz, sizeof(float), 3, f);
+    });
+    forEachTriangle([&](uint32_t a, uint32_t b, uint32_t c) {
+      unsigned char count = 3;
+      uint32_t abc[3] = {a, b, c};
+      std::fwrite(&count, 1, 1, f);
+      std::fwrite(abc, sizeof(uint32_t), 3, f);
+    });
+    std::fclose(f);
+  }
+};
+
+int main() {
+  print("SIMD width:", TriangleMesh::width);
+  for (int rings : {316, 1000}) {
+    SphereMesh sphere{rings, 2 * rings};
+    double millions = sphere.triangleCount() / 1e6;
+    print("triangles:", sphere.triangleCount(), "vertices:",
+          sphere.vertexCount());
+
+    TriangleMesh mesh;
+    for (std::string ext : {".obj", ".ply"}) {
+      std::string path = "bench_mesh" + ext;
+      if (ext == ".obj") sphere.writeOBJ(path);
+      else sphere.writePLY(path);
+      double fileMiB = std::filesystem::file_size(path) / 1048576.0;
+
+      mesh = {};
+      resetPeakMemory();
+      double before = currentMemoryMiB();
+      auto start = Clock::now();
+      MeshData data = LoadMesh(path);
+      double loadSecs = secondsSince(start);
+      double peak = peakMemoryMiB() - before;
+      if (data.indices.size() != 3 * sphere.triangleCount())
+        print("  wrong triangle count!");
+
+      start = Clock::now();
+      mesh = TriangleMesh(std::move(data.positions), std::move(data.indices),
+                          nullptr);
+      double buildSecs = secondsSince(start);
+      std::filesystem::remove(path);
+
+      print(" ", ext, fileMiB, "MiB:", "load", loadSecs * 1e3, "ms,",
+            loadSecs / millions * 1e3, "ms per Mtri, peak",
+            peak / millions, "MiB per Mtri");
+      print("    bvh build", buildSecs * 1e3, "ms, mesh + bvh",
+            mesh.memoryBytes() / 1048576.0 / millions, "MiB per Mtri");
+    }
+
+    // rays from the center through every vertex and every edge midpoint
+    // of the last load: a closed mesh must stop all of them
+    std::vector<Ray> rays;
+    for (const float3 &p : mesh.positions)
+      rays.push_back({float3(0, 0, 0), normalize(p)});
+    for (size_t t = 0; t < mesh.triangleCount(); t++)
+      for (int v = 0; v < 3; v++)
+        rays.push_back({float3(0, 0, 0), normalize(mesh.vertex(t, v) +
+                                                   mesh.vertex(t, (v + 1) % 3))});
+    size_t misses = 0;
+    auto start = Clock::now();
+    for (const Ray &ray : rays)
+      misses += !mesh.hit(ray, Interval(0, INF)).success;
+    double secs = secondsSince(start);
+    print("  rays through vertices and edges:", rays.size(), "misses:", misses,
+          ",", rays.size() / secs / 1e6, "Mrays/s");
+  }
+  return 0;
+}
@@ -0,0 +1,103 @@
+// any-hit vs. closest-hit for shadow rays: occluded() against
+// hit().success on segments between two surface points seen by the camera,
+// for every acceleration structure, checking both give the same answers
+//
+// options: --scene PATH (also run a scene file, repeatable)
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "Camera.hpp"
+#include "BVH.hpp"
+#include "SphereSet.hpp"
+#include "Scenes.hpp"
+#include "SceneFile.hpp"
+#include "Bench.hpp"
+
+// Shadow rays from the first hit of each pixel to the first hit of a
+// random other pixel, stopping short of it like the camera's shadow rays.
+// The direction isn't normalized, the segment is rayTime (0, 1).
+std::vector<Ray> ShadowRays(const Hittable &world, Camera camera) {
+  camera = Camera(320, 180, camera.VFoV, camera.camTrans);
+  std::vector<float3> points;
+  std::vector<HitRecord> hits;
+  RNG rng;
+  Sampler sampler(rng);
+  for (int x = 0; x < camera.height; x++) {
+    for (int y = 0; y < camera.width; y++) {
+      Ray ray = camera.rayToScreenPos(
+          (float2(x, y) + float2(0.5, 0.5)) / camera.screenSize, sampler);
+      auto result = world.hit(ray, Interval(0, INF));
+      if (!result.success) continue;
+      result.ret.resolve(ray);
+      hits.push_back(result.ret);
+    }
+  }
+  std::vector<Ray> rays;
+  for (int repeat = 0; repeat < 4; repeat++) {
+    for (const HitRecord &hit : hits) {
+      const HitRecord &target = hits[rng.nextUInt() % hits.size()];
+      float3 dir = target.point - hit.point;
+      if (dir.pow() == 0) continue;
+      rays.push_back(Material::leave(hit, dir));
+    }
+  }
+  return rays;
+}
+
+void Compare(const std::string &name, const Hittable &world,
+             const std::vector<Ray> &rays) {
+  const Interval segment(0, 1 - Camera::ShadowEpsilon);
+  std::vector<char> closest(rays.size()), any(rays.size());
+  auto start = Clock::now();
+  for (size_t i = 0; i < rays.size(); i++)
+    closest[i] = world.hit(rays[i], segment).success;
+  double hitSecs = secondsSince(start);
+  start = Clock::now();
+  for (size_t i = 0; i < rays.size(); i++)
+    any[i] = world.occluded(rays[i], segment);
+  double occludedSecs = secondsSince(start);
+
+  size_t occludedCount = 0, differences = 0;
+  for (size_t i = 0; i < rays.size(); i++) {
+    occludedCount += any[i];
+    differences += closest[i] != any[i];
+  }
+  print(name + ":", rays.size(), "shadow rays,",
+        double(occludedCount) / rays.size() * 100, "% occluded");
+  print("  hit():     ", rays.size() / hitSecs / 1e6, "Mrays/s");
+  print("  occluded():", rays.size() / occludedSecs / 1e6,
+        "Mrays/s, speedup", hitSecs / occludedSecs, ",", differences,
+        "different answers");
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> scenePaths;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string option = argv[i], value = argv[i + 1];
+    if (option == "--scene") scenePaths.push_back(value);
+    else print("unknown option:", option);
+  }
+
+  Scene scene = WeekendScene();
+  BVH bvh(scene.world);
+  SphereSet spheres(scene.world);
+  Camera camera{320, 180, 20, WeekendCameraTransform()};
+  std::vector<Ray> rays = ShadowRays(spheres, camera);
+  Compare("weekend, HittableList", scene.world, rays);
+  Compare("weekend, BVH", bvh, rays);
+  Compare("weekend, SphereSet", spheres, rays);
+
+  for (const auto &path : scenePaths) {
+    SceneFile file;
+    try {
+      file.load(path, false);
+    } catch (const std::exception &e) {
+      print(path + ": failed,", e.what());
+      continue;
+    }
+    std::string name = std::filesystem::path(path).stem().string();
+    Compare(name, file.world(), ShadowRays(file.world(), file.camera));
+  }
+  return 0;
+}
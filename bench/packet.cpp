@@ -0,0 +1,109 @@
+// packet tracing of camera rays: closest hits of every pixel's ray traced
+// one by one against RayPackets of 4 x 4 and 8 x 8 pixels, at 1080p and 4K,
+// checking that both find the same hits
+//
+// options: --scene PATH (also run a scene file, repeatable)
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "Camera.hpp"
+#include "SphereSet.hpp"
+#include "Scenes.hpp"
+#include "SceneFile.hpp"
+#include "Bench.hpp"
+
+bool SameHit(const Result<HitRecord> &a, const Result<HitRecord> &b) {
+  if (a.success != b.success) return false;
+  return !a.success ||
+         (a.ret.rayTime == b.ret.rayTime && a.ret.object == b.ret.object &&
+          a.ret.primIndex == b.ret.primIndex &&
+          a.ret.instance == b.ret.instance);
+}
+
+// camera ray through the center of every pixel, in row-major order
+std::vector<Ray> CameraRays(Camera &camera) {
+  std::vector<Ray> rays;
+  rays.reserve(size_t(camera.width) * camera.height);
+  RNG rng;
+  Sampler sampler(rng);
+  for (int x = 0; x < camera.height; x++)
+    for (int y = 0; y < camera.width; y++)
+      rays.push_back(camera.rayToScreenPos(
+          (float2(x, y) + float2(0.5, 0.5)) / camera.screenSize, sampler));
+  return rays;
+}
+
+void Compare(const std::string &name, const Hittable &world, Camera camera,
+             int width, int height) {
+  camera = Camera(width, height, camera.VFoV, camera.camTrans);
+  std::vector<Ray> rays = CameraRays(camera);
+
+  std::vector<Result<HitRecord>> single(rays.size());
+  auto start = Clock::now();
+  for (size_t i = 0; i < rays.size(); i++)
+    single[i] = world.hit(rays[i], Interval(0, INF));
+  double singleSecs = secondsSince(start);
+  print(name + ",", width, "x", height, "camera rays");
+  print("  single rays:", rays.size() / singleSecs / 1e6, "Mrays/s");
+
+  for (int side : {4, 8}) {
+    std::vector<Result<HitRecord>> packed(rays.size());
+    RayPacket packet;
+    size_t indices[RayPacket::maxSize], coherent = 0, packets = 0;
+    start = Clock::now();
+    for (int bx = 0; bx < height; bx += side) {
+      for (int by = 0; by < width; by += side) {
+        packet.clear();
+        for (int x = bx; x < std::min(bx + side, height); x++) {
+          for (int y = by; y < std::min(by + side, width); y++) {
+            indices[packet.size] = size_t(x) * width + y;
+            packet.add(rays[indices[packet.size]]);
+          }
+        }
+        packet.prepare();
+        world.hitPacket(packet);
+        for (uint32_t i = 0; i < packet.size; i++)
+          packed[indices[i]] = packet.results[i];
+        coherent += packet.coherent;
+        packets++;
+      }
+    }
+    double secs = secondsSince(start);
+    size_t differences = 0;
+    for (size_t i = 0; i < rays.size(); i++)
+      differences += !SameHit(single[i], packed[i]);
+    print("  packets of", side, "x", side, ":", rays.size() / secs / 1e6,
+          "Mrays/s, speedup", singleSecs / secs, ",", coherent, "of", packets,
+          "coherent,", differences, "different hits");
+  }
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> scenePaths;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string option = argv[i], value = argv[i + 1];
+    if (option == "--scene") scenePaths.push_back(value);
+    else print("unknown option:", option);
+  }
+
+  Scene scene = WeekendScene();
+  SphereSet spheres(scene.world);
+  Camera camera{1920, 1080, 20, WeekendCameraTransform()};
+  for (auto [w, h] : {std::pair{1920, 1080}, std::pair{3840, 2160}})
+    Compare("weekend", spheres, camera, w, h);
+
+  for (const auto &path : scenePaths) {
+    SceneFile file;
+    try {
+      file.load(path, false);
+    } catch (const std::exception &e) {
+      print(path + ": failed,", e.what());
+      continue;
+    }
+    std::string name = std::filesystem::path(path).stem().string();
+    for (auto [w, h] : {std::pair{1920, 1080}, std::pair{3840, 2160}})
+      Compare(name, file.world(), file.camera, w, h);
+  }
+  return 0;
+}
@@ -0,0 +1,65 @@
+// float vs. double rendering: build both bench_precision and
+// bench_precision_f32 and run them from the same directory, each writes its
+// image and the second one compares it against the first
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include "Camera.hpp"
+#include "SphereSet.hpp"
+#include "Scenes.hpp"
+
+constexpr bool isFloat32 = sizeof(mfloat) == sizeof(float);
+
+// per-pixel luminance difference of two renders of the same scene
+void CompareImages(const HDRImage &a, const HDRImage &b) {
+  if (a.height != b.height || a.width != b.width) {
+    print("image sizes differ, nothing to compare");
+    return;
+  }
+  size_t pixels = a.height * a.width, outliers = 0;
+  double squared = 0, maxDiff = 0, meanA = 0, meanB = 0;
+  for (size_t i = 0; i < pixels; i++) {
+    const float *pa = &a.data[i * 3], *pb = &b.data[i * 3];
+    double ya = Accumulator::luminance(pa[0], pa[1], pa[2]);
+    double yb = Accumulator::luminance(pb[0], pb[1], pb[2]);
+    double diff = std::abs(ya - yb);
+    squared += diff * diff;
+    maxDiff = std::max(maxDiff, diff);
+    // well above the noise of the render, self-intersection shows up here
+    outliers += diff > 0.25;
+    meanA += ya;
+    meanB += yb;
+  }
+  print("mean luminance:", meanA / pixels, "vs", meanB / pixels);
+  print("RMSE:", std::sqrt(squared / pixels), "max difference:", maxDiff,
+        "pixels off by > 0.25:", outliers);
+}
+
+int main() {
+  Scene scene = WeekendScene();
+  SphereSet spheres(scene.world);
+  auto camTrans = WeekendCameraTransform();
+  Camera camera{320, 180, 20, camTrans, DefocusDisk{2, 10, 0.1, camTrans}};
+  camera.samplesPerPixel = 64;
+  camera.maxDepth = 40;
+
+  auto image = camera.render(spheres, false);
+  const auto &stats = camera.pathStats;
+  print(isFloat32 ? "float:" : "double:", stats.seconds, "s,",
+        stats.paths / stats.seconds / 1e6, "Mpaths/s,",
+        stats.mraysPerSecond(), "Mrays/s, average path length",
+        stats.averagePathLength());
+
+  std::string path = isFloat32 ? "precision_f32.pfm" : "precision_f64.pfm";
+  std::string other = isFloat32 ? "precision_f64.pfm" : "precision_f32.pfm";
+  image.writePFM(path.c_str());
+  HDRImage reference;
+  if (reference.readPFM(other.c_str())) {
+    print("compared with", other);
+    CompareImages(reference, image);
+  } else {
+    print("run the other precision to compare the images");
+  }
+  return 0;
+}
@@ -0,0 +1,92 @@
+// samplers: RMSE against a high-spp reference as the sample count grows,
+// for independent random numbers, Owen-scrambled Sobol and blue-noise
+// Sobol, on the weekend scene with its defocus blur. Also reports the spp
+// each sampler needs to match the independent sampler's error at its
+// highest sample count.
+//
+// options: --scene PATH (use a scene file instead)
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "Camera.hpp"
+#include "SphereSet.hpp"
+#include "Scenes.hpp"
+#include "SceneFile.hpp"
+#include "Bench.hpp"
+
+int main(int argc, char **argv) {
+  std::string scenePath;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string option = argv[i], value = argv[i + 1];
+    if (option == "--scene") scenePath = value;
+    else print("unknown option:", option);
+  }
+
+  Scene scene;
+  SphereSet spheres;
+  SceneFile file;
+  const Hittable *world = &spheres;
+  Camera camera{96, 54, 20};
+  if (scenePath.empty()) {
+    scene = WeekendScene();
+    spheres = SphereSet(scene.world);
+    auto camTrans = WeekendCameraTransform();
+    camera = Camera{96, 54, 20, camTrans, DefocusDisk{2, 10, 0.1, camTrans}};
+    camera.maxDepth = 40;
+  } else {
+    file.load(scenePath, false);
+    world = &file.world();
+    camera = file.camera;
+    camera = Camera(96, 54, camera.VFoV, camera.camTrans, camera.ddisk);
+    camera.maxDepth = file.camera.maxDepth;
+    camera.sky = file.camera.sky;
+  }
+
+  // Sobol with a seed of its own, its scrambles are independent of the
+  // renders compared against it
+  camera.samplerType = SamplerType::Sobol;
+  camera.seed = 12345;
+  camera.samplesPerPixel = 4096;
+  auto reference = camera.render(*world, false);
+  print("reference:", camera.samplesPerPixel, "spp,",
+        camera.pathStats.seconds, "s");
+
+  const std::vector<int> sampleCounts{1, 4, 16, 64, 256};
+  std::vector<double> independentErrors;
+  camera.seed = 0;
+  for (auto [type, name] : {std::pair{SamplerType::Independent, "independent"},
+                            std::pair{SamplerType::Sobol, "sobol"},
+                            std::pair{SamplerType::BlueNoise, "bluenoise"}}) {
+    camera.samplerType = type;
+    print(std::string(name) + ":");
+    std::vector<double> errors;
+    for (int spp : sampleCounts) {
+      camera.samplesPerPixel = spp;
+      auto image = camera.render(*world, false);
+      errors.push_back(RMSE(image, reference));
+      print(" ", spp, "spp: RMSE", errors.back(), ",",
+            camera.pathStats.mraysPerSecond(), "Mrays/s");
+    }
+    if (type == SamplerType::Independent) {
+      independentErrors = errors;
+      continue;
+    }
+    // the fewest spp of the curve at least as good, log-interpolated
+    double target = independentErrors.back();
+    for (size_t i = 0; i < errors.size(); i++) {
+      if (errors[i] > target) continue;
+      double spp = sampleCounts[i];
+      if (i > 0) {
+        double t = std::log(errors[i - 1] / target) /
+                   std::log(errors[i - 1] / errors[i]);
+        spp = sampleCounts[i - 1] *
+              std::pow(double(sampleCounts[i]) / sampleCounts[i - 1], t);
+      }
+      print("  matches independent at", sampleCounts.back(), "spp with about",
+            spp, "spp");
+      break;
+    }
+  }
+  return 0;
+}
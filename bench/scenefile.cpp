@@ -0,0 +1,121 @@
+// scene file load: JSON parse + BVH builds vs. mapping the scene cache, for
+// sphere scenes and a scene of an instanced mesh
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "SceneFile.hpp"
+#include "Scenes.hpp"
+#include "Bench.hpp"
+
+// binary PLY of a wavy n x n grid of quads, two triangles each
+static void WriteGridPLY(const std::string &path, int n) {
+  FILE *f = std::fopen(path.c_str(), "wb");
+  std::fprintf(f,
+               "ply\nformat binary_little_endian 1.0\n"
+               "element vertex %d\nproperty float x\nproperty float y\n"
+               "property float z\nelement face %d\n"
+               "property list uchar int vertex_indices\nend_header\n",
+               (n + 1) * (n + 1), 2 * n * n);
+  for (int i = 0; i <= n; i++)
+    for (int j = 0; j <= n; j++) {
+      float x = float(i) / n, z = float(j) / n;
+      float xyz[3] = {x, 0.05f * std::sin(40 * x) * std::cos(40 * z), z};
+      std::fwrite(xyz, sizeof(float), 3, f);
+    }
+  auto add = [&](int a, int b, int c) {
+    unsigned char count = 3;
+    int abc[3] = {a, b, c};
+    std::fwrite(&count, 1, 1, f);
+    std::fwrite(abc, sizeof(int), 3, f);
+  };
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++) {
+      int v = i * (n + 1) + j;
+      add(v, v + 1, v + n + 2);
+      add(v, v + n + 2, v + n + 1);
+    }
+  std::fclose(f);
+}
+
+// load the scene without and with its cache and print both times
+static void Compare(const std::string &path) {
+  std::filesystem::remove(path + ".cache");
+
+  // min of a few runs, the first run of each also writes the cache
+  double parseSecs = INF, cacheSecs = INF;
+  size_t sphereCount = 0, triangleCount = 0;
+  for (int run = 0; run < 3; run++) {
+    auto start = Clock::now();
+    SceneFile parsed;
+    parsed.load(path, false);
+    parseSecs = std::min(parseSecs, secondsSince(start));
+    sphereCount = parsed.spheres.size();
+    triangleCount = parsed.triangleCount();
+  }
+  {
+    SceneFile first;
+    first.load(path);
+  }
+  bool cached = true;
+  for (int run = 0; run < 3; run++) {
+    auto start = Clock::now();
+    SceneFile mapped;
+    mapped.load(path);
+    // touch every node, sphere and vertex once, as the first frame would;
+    // through a const reference, the buffers are read-only views
+    const SceneFile &view = mapped;
+    mfloat sum = 0;
+    for (const auto &node : view.spheres.tree.nodes) sum += node.count;
+    for (mfloat r : view.spheres.radius) sum += r == r ? r : 0;
+    view.scene.arena.forEach<TriangleMesh>([&](const TriangleMesh &mesh) {
+      for (const auto &node : mesh.tree.nodes) sum += node.count;
+      for (const float3 &p : mesh.positions) sum += p.val[0];
+    });
+    cacheSecs = std::min(cacheSecs, secondsSince(start));
+    volatile mfloat sink = sum;
+    (void)sink;
+    cached &= mapped.fromCache;
+  }
+
+  print("spheres:", sphereCount, "triangles:", triangleCount, "json:",
+        std::filesystem::file_size(path) / 1024, "KiB, cache:",
+        std::filesystem::file_size(path + ".cache") / 1024, "KiB");
+  print("  parse + build:", parseSecs * 1e3, "ms");
+  print("  cache:        ", cacheSecs * 1e3, "ms, speedup",
+        parseSecs / cacheSecs, cached ? "" : "(cache not used!)");
+  std::filesystem::remove(path + ".cache");
+}
+
+int main() {
+  Camera camera{1920, 1080, 20, WeekendCameraTransform()};
+  for (int gridSize : {11, 44, 176}) {
+    std::string path = "bench_scene_" + std::to_string(gridSize) + ".json";
+    Scene scene = WeekendScene(gridSize);
+    if (!SceneFile::WriteJson(path, scene, camera)) {
+      print("failed to write", path);
+      return 1;
+    }
+    Compare(path);
+    std::filesystem::remove(path);
+  }
+
+  // the mesh file placed directly and, loaded once more, by two instances
+  for (int n : {100, 500, 1000}) {
+    std::string meshPath = "bench_grid_" + std::to_string(n) + ".ply";
+    std::string path = "bench_grid_" + std::to_string(n) + ".json";
+    WriteGridPLY(meshPath, n);
+    std::string file = "{\"file\": \"" + meshPath + "\", \"material\": 0";
+    std::ofstream(path) << "{\"materials\": [{\"type\": \"lambertian\", "
+                           "\"albedo\": [0.5, 0.5, 0.5]}],\n"
+                        << " \"meshes\": [" << file << "},\n  " << file
+                        << ", \"instances\": [{\"translate\": [2, 0, 0]}, "
+                           "{\"translate\": [4, 0, 0], \"scale\": 2}]}]}\n";
+    Compare(path);
+    std::filesystem::remove(path);
+    std::filesystem::remove(meshPath);
+  }
+  return 0;
+}
@@ -0,0 +1,79 @@
+// SphereSet (SoA + SIMD leaves) vs. BVH over individual Sphere objects
+#include <vector>
+
+#include "Camera.hpp"
+#include "BVH.hpp"
+#include "SphereSet.hpp"
+#include "Scenes.hpp"
+#include "Bench.hpp"
+
+std::vector<HitRecord> traceAll(const Hittable &scene,
+                                const std::vector<Ray> &rays, double &secs) {
+  std::vector<HitRecord> hits(rays.size());
+  auto start = Clock::now();
+  for (size_t i = 0; i < rays.size(); i++) {
+    auto result = scene.hit(rays[i], Interval(0, INF));
+    hits[i].rayTime = INF;
+    hits[i].material = nullptr;
+    if (result.success) {
+      hits[i] = result.ret;
+      hits[i].resolve(rays[i]);
+    }
+  }
+  secs = secondsSince(start);
+  return hits;
+}
+
+int main() {
+  print("SIMD width:", SphereSet::width);
+  for (int gridSize : {11, 44, 88}) {
+    Scene scene = WeekendScene(gridSize);
+
+    auto start = Clock::now();
+    BVH bvh(scene.world);
+    double bvhBuild = secondsSince(start);
+    start = Clock::now();
+    SphereSet spheres(scene.world);
+    double setBuild = secondsSince(start);
+
+    // jittered primary rays plus a diffuse bounce from each first hit
+    Camera camera{320, 180, 20, WeekendCameraTransform()};
+    std::vector<Ray> rays;
+    RNG rng;
+    Sampler sampler(rng);
+    for (int x = 0; x < camera.height; x++)
+      for (int y = 0; y < camera.width; y++)
+        rays.push_back(camera.rayToScreenPos(
+            camera.getRandomSamplePos(x, y, sampler) / camera.screenSize,
+            sampler));
+    size_t primaryCount = rays.size();
+    for (size_t i = 0; i < primaryCount; i++) {
+      auto result = bvh.hit(rays[i], Interval(0, INF));
+      if (result.success) {
+        auto hit = result.ret;
+        hit.resolve(rays[i]);
+        rays.push_back(
+            Ray{hit.point, normalize(hit.normal + RandomInUnitSphere(rng))});
+      }
+    }
+
+    double bvhSecs, setSecs;
+    auto bvhHits = traceAll(bvh, rays, bvhSecs);
+    auto setHits = traceAll(spheres, rays, setSecs);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < rays.size(); i++)
+      if (bvhHits[i].rayTime != setHits[i].rayTime ||
+          bvhHits[i].material != setHits[i].material)
+        mismatches++;
+
+    print("spheres:", spheres.size(), "rays:", rays.size());
+    print("  build: bvh", bvhBuild * 1e3, "ms, sphere set", setBuild * 1e3,
+          "ms");
+    print("  bvh:       ", rays.size() / bvhSecs / 1e6, "Mrays/s");
+    print("  sphere set:", rays.size() / setSecs / 1e6, "Mrays/s, speedup",
+          bvhSecs / setSecs);
+    print("  mismatched hits:", mismatches);
+  }
+  return 0;
+}
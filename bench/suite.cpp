@@ -0,0 +1,218 @@
+// The render benchmark suite: canonical scenes rendered end to end, with
+// the time of every phase (scene build, acceleration build, render,
+// tonemap, PNG encode), primary and total Mrays/s, and the thread scaling
+// of one case. Results go to stdout and, with --json PATH, to a JSON file
+// for tracking regressions and comparing machines.
+//
+// options: --json PATH, --label TEXT (stored in the JSON, e.g. a commit),
+//          --threads N (most threads of the scaling curve, default: all),
+//          --repeat N (best of N renders per case, default 1),
+//          --scene PATH (also run a scene file, repeatable)
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/Json.hpp"
+#include "Camera.hpp"
+#include "SphereSet.hpp"
+#include "Scenes.hpp"
+#include "SceneFile.hpp"
+#include "Bench.hpp"
+
+struct Case {
+  std::string name;
+  int gridSize;  // weekend scene, 0 for a scene file
+  std::string path;
+  int width, height, spp;
+  int threads = 0;  // 0: all
+  Integrator integrator = Integrator::Megakernel;
+};
+
+struct Measurement {
+  Case c;
+  size_t primitives = 0;
+  // phase times in seconds
+  double scene = 0, accel = 0, render = 0, tonemap = 0, encode = 0;
+  uint64_t paths = 0, rays = 0;
+
+  double primaryMrays() const { return paths / render / 1e6; }
+  double totalMrays() const { return rays / render / 1e6; }
+};
+
+// the render, tonemap and encode phases, the best of `repeat` runs
+void RenderPhases(Camera &camera, const Hittable &world, int repeat,
+                  Measurement &res) {
+  res.render = INF;
+  for (int r = 0; r < repeat; r++) {
+    HDRImage image = camera.render(world, false);
+    if (camera.pathStats.seconds >= res.render) continue;
+    res.render = camera.pathStats.seconds;
+    res.paths = camera.pathStats.paths;
+    res.rays = camera.pathStats.rays;
+
+    auto start = Clock::now();
+    Image ldr = image.toImage();
+    res.tonemap = secondsSince(start);
+    start = Clock::now();
+    std::vector<byte> png = ldr.encodePNG();
+    res.encode = secondsSince(start);
+  }
+}
+
+Measurement Run(const Case &c, int repeat) {
+  Measurement res;
+  res.c = c;
+  if (c.gridSize > 0) {
+    auto start = Clock::now();
+    Scene scene = WeekendScene(c.gridSize);
+    res.scene = secondsSince(start);
+    res.primitives = scene.world.objects.size();
+    start = Clock::now();
+    SphereSet spheres(scene.world);
+    res.accel = secondsSince(start);
+
+    Camera camera{c.width, c.height, 20, WeekendCameraTransform()};
+    camera.samplesPerPixel = c.spp;
+    camera.maxDepth = 40;
+    camera.threadCount = c.threads;
+    camera.integrator = c.integrator;
+    RenderPhases(camera, spheres, repeat, res);
+  } else {
+    // a scene file builds its BVHs while loading, both count as the scene
+    SceneFile file;
+    auto start = Clock::now();
+    file.load(c.path, false);
+    res.scene = secondsSince(start);
+    res.primitives =
+        file.spheres.size() + file.triangleCount() + file.instanceCount();
+    Camera &camera = file.camera;
+    camera = Camera(c.width, c.height, camera.VFoV, camera.camTrans,
+                    camera.ddisk);
+    camera.samplesPerPixel = c.spp;
+    camera.threadCount = c.threads;
+    camera.integrator = c.integrator;
+    RenderPhases(camera, file.world(), repeat, res);
+  }
+  return res;
+}
+
+void PrintResult(const Measurement &r) {
+  print(r.c.name + ":", r.primitives, "primitives,", r.c.width, "x",
+        r.c.height, "x", r.c.spp, "spp,",
+        r.c.threads ? std::to_string(r.c.threads) : "all", "threads");
+  print("  scene", r.scene * 1e3, "ms, accel", r.accel * 1e3, "ms, render",
+        r.render * 1e3, "ms, tonemap", r.tonemap * 1e3, "ms, encode",
+        r.encode * 1e3, "ms");
+  print("  primary", r.primaryMrays(), "Mrays/s, total", r.totalMrays(),
+        "Mrays/s");
+}
+
+bool WriteJson(const std::string &path, const std::string &label,
+               const std::vector<Measurement> &results,
+               const std::vector<Measurement> &scaling) {
+  std::ofstream out(path);
+  if (!out) return false;
+  out.precision(9);
+  out << "{\n  \"label\": " << JsonQuote(label) << ",\n  \"machine\": {"
+      << "\"hardwareThreads\": " << std::thread::hardware_concurrency()
+      << ", \"simdWidth\": " << SimdWidth<mfloat>
+      << ", \"precision\": \"" << (sizeof(mfloat) == 4 ? "f32" : "f64")
+      << "\"},\n";
+  auto list = [&](const char *name, const std::vector<Measurement> &rs) {
+    out << "  \"" << name << "\": [";
+    for (size_t i = 0; i < rs.size(); i++) {
+      const Measurement &r = rs[i];
+      out << (i ? ",\n" : "\n") << "    {\"name\": " << JsonQuote(r.c.name)
+          << ", \"primitives\": " << r.primitives
+          << ", \"width\": " << r.c.width << ", \"height\": " << r.c.height
+          << ", \"spp\": " << r.c.spp << ", \"threads\": " << r.c.threads
+          << ", \"integrator\": \""
+          << (r.c.integrator == Integrator::Wavefront ? "wavefront"
+                                                      : "megakernel")
+          << "\",\n     \"seconds\": {\"scene\": " << r.scene
+          << ", \"accel\": " << r.accel << ", \"render\": " << r.render
+          << ", \"tonemap\": " << r.tonemap << ", \"encode\": " << r.encode
+          << "},\n     \"paths\": " << r.paths << ", \"rays\": " << r.rays
+          << ", \"primaryMrays\": " << r.primaryMrays()
+          << ", \"totalMrays\": " << r.totalMrays() << "}";
+    }
+    out << "\n  ]";
+  };
+  list("cases", results);
+  out << ",\n";
+  list("scaling", scaling);
+  out << "\n}\n";
+  return bool(out);
+}
+
+int main(int argc, char **argv) {
+  std::string jsonPath, label;
+  int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  int repeat = 1;
+  std::vector<std::string> scenePaths;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string option = argv[i], value = argv[i + 1];
+    if (option == "--json") jsonPath = value;
+    else if (option == "--label") label = value;
+    else if (option == "--threads") maxThreads = std::stoi(value);
+    else if (option == "--repeat") repeat = std::max(1, std::stoi(value));
+    else if (option == "--scene") scenePaths.push_back(value);
+    else print("unknown option:", option);
+  }
+
+  // the weekend scene at several sphere counts, resolutions and spp, from
+  // a base case of 485 spheres, 320 x 180 and 8 spp
+  std::vector<Case> cases;
+  for (int grid : {3, 11, 22, 44})
+    cases.push_back({"weekend_grid" + std::to_string(grid), grid, "", 320,
+                     180, 8});
+  for (auto [w, h] : {std::pair{640, 360}, std::pair{960, 540}})
+    cases.push_back({"weekend_" + std::to_string(w) + "x" + std::to_string(h),
+                     11, "", w, h, 8});
+  for (int spp : {1, 32})
+    cases.push_back({"weekend_spp" + std::to_string(spp), 11, "", 320, 180,
+                     spp});
+  cases.push_back({"weekend_wavefront", 11, "", 320, 180, 8, 0,
+                   Integrator::Wavefront});
+  for (const auto &path : scenePaths)
+    cases.push_back({std::filesystem::path(path).stem().string(), 0, path,
+                     320, 180, 8});
+
+  std::vector<Measurement> results;
+  for (const Case &c : cases) {
+    try {
+      results.push_back(Run(c, repeat));
+    } catch (const std::exception &e) {
+      print(c.name + ": failed,", e.what());
+      continue;
+    }
+    PrintResult(results.back());
+  }
+
+  // thread scaling of the base case: 1, 2, 4, ... threads and all of them
+  std::vector<Measurement> scaling;
+  std::vector<int> threadCounts;
+  for (int t = 1; t < maxThreads; t *= 2) threadCounts.push_back(t);
+  threadCounts.push_back(maxThreads);
+  print("thread scaling:");
+  for (int threads : threadCounts) {
+    Case c{"scaling_" + std::to_string(threads), 11, "", 320, 180, 8,
+           threads};
+    scaling.push_back(Run(c, repeat));
+    const Measurement &r = scaling.back();
+    double speedup = scaling.front().render / r.render;
+    print("  threads", threads, ":", r.totalMrays(), "Mrays/s, speedup",
+          speedup, ", efficiency", speedup / threads);
+  }
+
+  if (!jsonPath.empty()) {
+    if (WriteJson(jsonPath, label, results, scaling))
+      print("results saved at", jsonPath);
+    else
+      print("failed to write", jsonPath);
+  }
+  return 0;
+}
@@ -0,0 +1,155 @@
+// float3 vs. a hand-written 3-lane vector on the operations Sphere::hit and
+// Material::scatter are made of. Build once as is and once with
+// `xmake f --padded_vectors=y` to compare the two float3 layouts.
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include "include/Vector.hpp"
+#include "Bench.hpp"
+
+// plain 3 lanes, no alignment, what float3 should compile to by default
+struct Scalar3 {
+  std::array<mfloat, 3> val;
+
+  Scalar3() {}
+  Scalar3(mfloat x, mfloat y, mfloat z) : val{x, y, z} {}
+
+  friend Scalar3 operator+(const Scalar3 &a, const Scalar3 &b) {
+    Scalar3 res;
+    for (size_t i = 0; i < 3; i++) res.val[i] = a.val[i] + b.val[i];
+    return res;
+  }
+  friend Scalar3 operator-(const Scalar3 &a, const Scalar3 &b) {
+    Scalar3 res;
+    for (size_t i = 0; i < 3; i++) res.val[i] = a.val[i] - b.val[i];
+    return res;
+  }
+  friend Scalar3 operator*(const Scalar3 &a, mfloat x) {
+    Scalar3 res;
+    for (size_t i = 0; i < 3; i++) res.val[i] = a.val[i] * x;
+    return res;
+  }
+  mfloat dot(const Scalar3 &v) const {
+    mfloat sum = 0;
+    for (size_t i = 0; i < 3; i++) sum += val[i] * v.val[i];
+    return sum;
+  }
+  mfloat pow() const { return dot(*this); }
+  Scalar3 cross(const Scalar3 &o) const {
+    return {val[1] * o.val[2] - val[2] * o.val[1],
+            val[2] * o.val[0] - val[0] * o.val[2],
+            val[0] * o.val[1] - val[1] * o.val[0]};
+  }
+};
+
+Scalar3 normalize(const Scalar3 &v) { return v * (1 / std::sqrt(v.pow())); }
+
+template <typename V>
+V Normalized(const V &v) {
+  return v * (1 / std::sqrt(v.pow()));
+}
+
+// the kernels, each maps two input vectors (and a scalar) to a number
+template <typename V>
+struct Kernels {
+  static mfloat add(const V &a, const V &b, mfloat) {
+    V c = a + b;
+    return c.val[0];
+  }
+  // Ray::at
+  static mfloat madd(const V &a, const V &b, mfloat t) {
+    V c = a + b * t;
+    return c.val[1];
+  }
+  static mfloat dot(const V &a, const V &b, mfloat) { return a.dot(b); }
+  static mfloat cross(const V &a, const V &b, mfloat) {
+    return a.cross(b).val[2];
+  }
+  static mfloat normalize(const V &a, const V &, mfloat) {
+    return Normalized(a).val[0];
+  }
+  // Sphere::hit up to the discriminant, a = center, b = direction
+  static mfloat sphere(const V &center, const V &dir, mfloat r) {
+    V dis = center - V(0, 1, 0);
+    mfloat a = dir.dot(dir), h = dir.dot(dis);
+    V perp = dis - dir * (h / a);
+    return a * (r * r - perp.pow());
+  }
+  // Metal::scatter without the fuzz
+  static mfloat reflect(const V &in, const V &normal, mfloat) {
+    V out = in - normal * (2 * in.dot(normal));
+    return Normalized(out).val[2];
+  }
+  // Lambertian::scatter, b plays the random point in the unit sphere
+  static mfloat lambertian(const V &normal, const V &offset, mfloat) {
+    return Normalized(normal + offset).val[1];
+  }
+  // RefractedVector
+  static mfloat refract(const V &in, const V &normal, mfloat rri) {
+    mfloat cosTheta = std::min(-in.dot(normal), mfloat(1));
+    V perp = (in + normal * cosTheta) * rri;
+    V para = normal * -std::sqrt(std::abs(1 - perp.pow()));
+    return Normalized(perp + para).val[0];
+  }
+};
+
+// best time per call in ns over a few runs, the calls are independent so
+// this is throughput rather than latency
+template <typename V, typename F>
+double Time(F kernel, const std::vector<V> &a, const std::vector<V> &b,
+            mfloat &sink) {
+  std::vector<mfloat> out(a.size());
+  double best = INFINITY;
+  for (int run = 0; run < 5; run++) {
+    auto start = Clock::now();
+    for (int rep = 0; rep < 64; rep++)
+      for (size_t i = 0; i < a.size(); i++)
+        out[i] = kernel(a[i], b[i], mfloat(0.5));
+    double secs = secondsSince(start);
+    best = std::min(best, secs / (64 * a.size()) * 1e9);
+    for (mfloat x : out) sink += x;
+  }
+  return best;
+}
+
+int main() {
+  const size_t count = 4096;
+  std::vector<float3> a, b;
+  std::vector<Scalar3> sa, sb;
+  RNG rng;
+  for (size_t i = 0; i < count; i++) {
+    float3 u = normalize(RandomInUnitSphere(rng));
+    float3 v = RandomInUnitSphere(rng);
+    a.push_back(u);
+    b.push_back(v);
+    sa.push_back({u.val[0], u.val[1], u.val[2]});
+    sb.push_back({v.val[0], v.val[1], v.val[2]});
+  }
+
+  print("sizeof(float3):", sizeof(float3), "lanes:", float3::lanes,
+        "sizeof(Scalar3):", sizeof(Scalar3));
+  print("ns per call       float3  scalar3");
+  mfloat sink = 0;
+#define BENCH(name)                                                  \
+  {                                                                  \
+    auto kernel = [](const auto &x, const auto &y, mfloat t) {       \
+      return Kernels<std::decay_t<decltype(x)>>::name(x, y, t);      \
+    };                                                               \
+    double vector = Time(kernel, a, b, sink);                        \
+    double scalar = Time(kernel, sa, sb, sink);                      \
+    print("  " #name ":", vector, scalar, "speedup", scalar / vector); \
+  }
+  BENCH(add)
+  BENCH(madd)
+  BENCH(dot)
+  BENCH(cross)
+  BENCH(normalize)
+  BENCH(sphere)
+  BENCH(reflect)
+  BENCH(lambertian)
+  BENCH(refract)
+#undef BENCH
+  print("(checksum", sink, ")");
+  return 0;
+}
@@ -0,0 +1,44 @@
+// megakernel vs. wavefront integrator on the weekend scene
+#include <thread>
+
+#include "Camera.hpp"
+#include "SphereSet.hpp"
+#include "Scenes.hpp"
+#include "Bench.hpp"
+
+int main() {
+  Scene scene = WeekendScene();
+  SphereSet spheres(scene.world);
+  auto camTrans = WeekendCameraTransform();
+  Camera camera{320, 180, 20, camTrans, DefocusDisk{2, 10, 0.1, camTrans}};
+  camera.samplesPerPixel = 32;
+  camera.maxDepth = 40;
+
+  // single-threaded, then every hardware thread
+  std::vector<int> threadCounts{1};
+  int hardwareThreads = std::thread::hardware_concurrency();
+  if (hardwareThreads > 1) threadCounts.push_back(hardwareThreads);
+  for (int threads : threadCounts) {
+    camera.threadCount = threads;
+    for (int tileSize : {16, 32, 64}) {
+      camera.tileSize = tileSize;
+      camera.integrator = Integrator::Megakernel;
+      auto reference = camera.render(spheres, false);
+      auto megakernel = camera.pathStats;
+      camera.integrator = Integrator::Wavefront;
+      auto image = camera.render(spheres, false);
+      auto wavefront = camera.pathStats;
+
+      print("threads:", threads, "tile:", tileSize);
+      print("  megakernel:", megakernel.paths / megakernel.seconds / 1e6,
+            "Mpaths/s,", megakernel.mraysPerSecond(), "Mrays/s");
+      print("  wavefront: ", wavefront.paths / wavefront.seconds / 1e6,
+            "Mpaths/s,", wavefront.mraysPerSecond(), "Mrays/s");
+      print("  mean luminance", MeanLuminance(reference), "vs",
+            MeanLuminance(image), reference.data == image.data
+                                      ? "(identical)"
+                                      : "(DIFFERENT)");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "include/MathUtils.hpp"
+#include "Ray.hpp"
+#include "Interval.hpp"
+
+// axis-aligned bounding box
+struct AABB {
+  float3 min, max;
+
+  // empty box, expanding it with anything yields that thing's bounds
+  AABB() : min(INF, INF, INF), max(-INF, -INF, -INF) {}
+  AABB(const float3 &min, const float3 &max) : min(min), max(max) {}
+
+  bool isEmpty() const { return min.val[0] > max.val[0]; }
+
+  void expand(const float3 &p) {
+    for (size_t i = 0; i < 3; i++) {
+      min.val[i] = std::min(min.val[i], p.val[i]);
+      max.val[i] = std::max(max.val[i], p.val[i]);
+    }
+  }
+
+  void expand(const AABB &box) {
+    for (size_t i = 0; i < 3; i++) {
+      min.val[i] = std::min(min.val[i], box.min.val[i]);
+      max.val[i] = std::max(max.val[i], box.max.val[i]);
+    }
+  }
+
+  float3 centroid() const { return (min + max) * 0.5; }
+  float3 extent() const { return max - min; }
+
+  mfloat surfaceArea() const {
+    if (isEmpty()) return 0;
+    float3 d = extent();
+    return 2 * (d.val[0] * d.val[1] + d.val[1] * d.val[2] +
+                d.val[2] * d.val[0]);
+  }
+
+  int longestAxis() const {
+    float3 d = extent();
+    if (d.val[0] > d.val[1] && d.val[0] > d.val[2]) return 0;
+    return d.val[1] > d.val[2] ? 1 : 2;
+  }
+
+  // slab test, invDir = 1 / ray.direction is precomputed by the caller
+  bool hit(const float3 &origin, const float3 &invDir,
+           Interval rayTime) const {
+    for (size_t i = 0; i < 3; i++) {
+      mfloat t0 = (min.val[i] - origin.val[i]) * invDir.val[i];
+      mfloat t1 = (max.val[i] - origin.val[i]) * invDir.val[i];
+      if (t0 > t1) std::swap(t0, t1);
+      // widen the far side a little so that rounding never culls a
+      // primitive that touches the box surface
+      t1 *= 1 + 4 * std::numeric_limits<mfloat>::epsilon();
+      // written so that NaN (0 * inf) leaves the interval untouched
+      rayTime.min = t0 > rayTime.min ? t0 : rayTime.min;
+      rayTime.max = t1 < rayTime.max ? t1 : rayTime.max;
+      if (rayTime.min > rayTime.max) return false;
+    }
+    return true;
+  }
+
+  static AABB merge(const AABB &a, const AABB &b) {
+    AABB res = a;
+    res.expand(b);
+    return res;
+  }
+};
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "include/MappedFile.hpp"
+#include "Color.hpp"
+#include "Image.hpp"
+
+// Running per-pixel sums of a progressive render together with everything
+// needed to continue it: the sample count and the RNG state of every pixel.
+// A pixel always draws from its own generator, so the image after N samples
+// is the same however the samples were split into passes or checkpoints.
+struct Accumulator {
+  size_t height, width;
+  uint64_t seed;
+  // samples per pixel handed out so far, converged pixels may have fewer
+  uint32_t samplesDone = 0;
+  // what the samples are rendered with (a SamplerType and a hash of the
+  // scene and render settings, see Camera::settingsHash), a checkpoint only
+  // loads if both match
+  uint64_t samplerType = 0, settingsHash = 0;
+
+  std::vector<double> sum;    // linear RGB, 3 per pixel
+  std::vector<double> sumSq;  // squared luminance, for the variance
+  std::vector<uint32_t> sampleCount;
+  // adaptive sampling stopped the pixel, or held it back for a pass
+  std::vector<uint8_t> converged;
+  static constexpr uint8_t held = 2;
+  std::vector<RNG> rng;
+
+  Accumulator(size_t height, size_t width, uint64_t seed)
+      : height(height), width(width), seed(seed) {
+    reset();
+  }
+
+  void reset() {
+    size_t n = height * width;
+    samplesDone = 0;
+    sum.assign(n * 3, 0);
+    sumSq.assign(n, 0);
+    sampleCount.assign(n, 0);
+    converged.assign(n, 0);
+    rng.resize(n);
+    for (size_t i = 0; i < n; i++) rng[i].seed(seed, i);
+  }
+
+  size_t pixelIndex(size_t h, size_t w) const { return h * width + w; }
+
+  void addSample(size_t pixel, const ColorF3 &color) {
+    for (size_t c = 0; c < 3; c++) sum[pixel * 3 + c] += color.val[c];
+    double y = luminance(color.val[0], color.val[1], color.val[2]);
+    sumSq[pixel] += y * y;
+    sampleCount[pixel]++;
+  }
+
+  static double luminance(double r, double g, double b) {
+    return 0.2126 * r + 0.7152 * g + 0.0722 * b;
+  }
+
+  // standard error of the mean luminance relative to the mean, the mean is
+  // clamped from below so that near-black pixels don't need endless samples
+  double relativeError(size_t pixel) const {
+    uint32_t n = sampleCount[pixel];
+    if (n < 2) return INF;
+    const double *s = &sum[pixel * 3];
+    double mean = luminance(s[0], s[1], s[2]) / n;
+    double variance = std::max(sumSq[pixel] / n - mean * mean, 0.0) * n / (n - 1);
+    return std::sqrt(variance / n) / std::max(mean, 1e-2);
+  }
+
+  // mark every pixel whose relative error is below threshold as converged,
+  // returns the number of pixels still sampled
+  size_t updateConvergence(double threshold) {
+    size_t active = 0;
+    long long n = height * width;
+#pragma omp parallel for reduction(+ : active)
+    for (long long i = 0; i < n; i++) {
+      if (!converged[i] && relativeError(i) < threshold) converged[i] = 1;
+      active += !converged[i];
+    }
+    return active;
+  }
+
+  // hold back every active pixel but the `count` with the largest relative
+  // error for the next pass, releaseHeld() lets them go on afterwards
+  void holdBack(size_t count) {
+    std::vector<uint32_t> active;
+    for (size_t i = 0; i < height * width; i++)
+      if (!converged[i]) active.push_back(i);
+    if (count >= active.size()) return;
+    std::vector<double> error(active.size());
+#pragma omp parallel for
+    for (long long k = 0; k < (long long)active.size(); k++)
+      error[k] = relativeError(active[k]);
+    std::vector<uint32_t> order(active.size());
+    for (size_t k = 0; k < order.size(); k++) order[k] = k;
+    std::nth_element(
+        order.begin(), order.begin() + count, order.end(),
+        [&](uint32_t a, uint32_t b) { return error[a] > error[b]; });
+    for (size_t k = count; k < order.size(); k++)
+      converged[active[order[k]]] = held;
+  }
+
+  void releaseHeld() {
+    for (uint8_t &flag : converged)
+      if (flag == held) flag = 0;
+  }
+
+  uint64_t totalSamples() const {
+    uint64_t total = 0;
+    for (uint32_t count : sampleCount) total += count;
+    return total;
+  }
+
+  // samples per pixel as a blue (fewest) - green - red (most) ramp
+  HDRImage sampleHeatmap() const {
+    HDRImage image(height, width, 3);
+    uint32_t maxCount = 1;
+    for (uint32_t count : sampleCount) maxCount = std::max(maxCount, count);
+    for (size_t i = 0; i < height * width; i++) {
+      double t = double(sampleCount[i]) / maxCount;
+      ColorF3 color = t < 0.5 ? lerp(ColorF3(0, 0, 1), ColorF3(0, 1, 0), t * 2)
+                              : lerp(ColorF3(0, 1, 0), ColorF3(1, 0, 0), t * 2 - 1);
+      image.setPixel(i / width, i % width, color);
+    }
+    return image;
+  }
+
+  // average of the samples so far
+  HDRImage resolve() const {
+    HDRImage image(height, width, 3);
+    long long n = height * width;
+#pragma omp parallel for
+    for (long long i = 0; i < n; i++) {
+      double inv = sampleCount[i] > 0 ? 1.0 / sampleCount[i] : 0;
+      for (size_t c = 0; c < 3; c++)
+        image.data[i * 3 + c] = float(sum[i * 3 + c] * inv);
+    }
+    return image;
+  }
+
+  // variance of the mean luminance of every pixel, 1 channel, what the
+  // denoiser weighs the noise with; a pixel of a single sample counts as
+  // all noise
+  HDRImage variance() const {
+    HDRImage image(height, width, 1);
+    long long n = height * width;
+#pragma omp parallel for
+    for (long long i = 0; i < n; i++) {
+      uint32_t count = sampleCount[i];
+      const double *s = &sum[i * 3];
+      double mean = count > 0 ? luminance(s[0], s[1], s[2]) / count : 0;
+      image.data[i] =
+          count < 2 ? float(mean * mean)
+                    : float(std::max(sumSq[i] / count - mean * mean, 0.0) /
+                            (count - 1));
+    }
+    return image;
+  }
+
+#pragma region Checkpoint
+  // file layout: Header, sums, squared sums, RNG states, sample counts,
+  // convergence flags
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t samplesDone;
+    uint64_t height, width, seed;
+    uint64_t samplerType, settingsHash;
+  };
+  static constexpr char checkpointMagic[8] = "RTACCUM";
+  static constexpr uint32_t checkpointVersion = 3;
+
+  size_t checkpointSize() const {
+    size_t n = height * width;
+    return sizeof(Header) + n * (4 * sizeof(double) + sizeof(RNG) +
+                                 sizeof(uint32_t) + sizeof(uint8_t));
+  }
+
+  // Write to a temporary file through a writable mapping, then rename it
+  // over path, so a crash mid-save leaves the previous checkpoint intact.
+  bool save(const std::string &path) const {
+    std::string tempPath = path + ".tmp";
+    {
+      MappedFile file;
+      if (!file.create(tempPath, checkpointSize())) return false;
+      auto dst = static_cast<char *>(file.data);
+      Header header{{}, checkpointVersion, samplesDone, height, width, seed,
+                    samplerType, settingsHash};
+      std::memcpy(header.magic, checkpointMagic, sizeof(header.magic));
+      dst = copyOut(dst, &header, 1);
+      dst = copyOut(dst, sum.data(), sum.size());
+      dst = copyOut(dst, sumSq.data(), sumSq.size());
+      dst = copyOut(dst, rng.data(), rng.size());
+      dst = copyOut(dst, sampleCount.data(), sampleCount.size());
+      dst = copyOut(dst, converged.data(), converged.size());
+      if (!file.flush()) return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    return !error;
+  }
+
+  // Restore a checkpoint written by save(). Fails (leaving this untouched)
+  // if the file is missing or was made for another resolution, seed,
+  // sampler or settings hash.
+  bool load(const std::string &path) {
+    MappedFile file;
+    if (!file.open(path) || file.size != checkpointSize()) return false;
+    auto src = static_cast<const char *>(file.data);
+    Header header;
+    std::memcpy(&header, src, sizeof(header));
+    if (std::memcmp(header.magic, checkpointMagic, sizeof(header.magic)) ||
+        header.version != checkpointVersion || header.height != height ||
+        header.width != width || header.seed != seed ||
+        header.samplerType != samplerType ||
+        header.settingsHash != settingsHash)
+      return false;
+    src += sizeof(header);
+    samplesDone = header.samplesDone;
+    src = copyIn(src, sum.data(), sum.size());
+    src = copyIn(src, sumSq.data(), sumSq.size());
+    src = copyIn(src, rng.data(), rng.size());
+    src = copyIn(src, sampleCount.data(), sampleCount.size());
+    src = copyIn(src, converged.data(), converged.size());
+    return true;
+  }
+#pragma endregion
+
+ private:
+  template <typename T>
+  static char *copyOut(char *dst, const T *src, size_t count) {
+    std::memcpy(dst, src, count * sizeof(T));
+    return dst + count * sizeof(T);
+  }
+
+  template <typename T>
+  static const char *copyIn(const char *src, T *dst, size_t count) {
+    std::memcpy(dst, src, count * sizeof(T));
+    return src + count * sizeof(T);
+  }
+};
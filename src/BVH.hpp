@@ -0,0 +1,368 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "include/Buffer.hpp"
+#include "include/Counters.hpp"
+#include "include/Utils.hpp"
+#include "Ray.hpp"
+#include "Interval.hpp"
+#include "AABB.hpp"
+#include "Hittable.hpp"
+
+struct BVHNode {
+  AABB bounds;
+  // leaf: index of its first primitive
+  // interior: index of the second child, the first one follows the parent
+  uint32_t offset;
+  uint16_t count;  // number of primitives, 0 for interior nodes
+  uint16_t axis;   // split axis, decides which child is visited first
+};
+
+// Flattened bounding volume hierarchy over a set of primitive bounds, built
+// with binned SAH. It only knows about boxes and indices, the primitives
+// themselves are stored (in primIndices order) by whoever owns the tree.
+struct BVHTree {
+  static constexpr int binCount = 16;
+  static constexpr int maxDepth = 64;
+  // most primitives a leaf can hold, BVHNode::count is 16 bits
+  static constexpr size_t maxLeafCount = UINT16_MAX;
+
+  Buffer<BVHNode> nodes;  // may view a scene cache, see SphereSet
+  std::vector<uint32_t> primIndices;
+  // primitives a leaf tests at once (SIMD leaves), the SAH charges a leaf
+  // per started block instead of per primitive
+  size_t blockSize = 1;
+
+  BVHTree() {}
+  BVHTree(const std::vector<AABB> &primBounds, size_t maxLeafSize = 2,
+          size_t blockSize = 1) {
+    build(primBounds, maxLeafSize, blockSize);
+  }
+
+  void build(const std::vector<AABB> &primBounds, size_t maxLeafSize = 2,
+             size_t blockSize = 1) {
+    this->blockSize = blockSize;
+    nodes.clear();
+    primIndices.clear();
+    if (primBounds.empty()) return;
+
+    std::vector<PrimInfo> prims(primBounds.size());
+    for (size_t i = 0; i < prims.size(); i++)
+      prims[i] = {primBounds[i], primBounds[i].centroid(), uint32_t(i)};
+
+    nodes.reserve(2 * prims.size());
+    buildRecursive(prims, 0, prims.size(), maxLeafSize);
+
+    primIndices.resize(prims.size());
+    for (size_t i = 0; i < prims.size(); i++) primIndices[i] = prims[i].index;
+  }
+
+  AABB bounds() const { return nodes.empty() ? AABB() : nodes[0].bounds; }
+
+  // Visit every leaf whose box is hit by the ray, near child first.
+  // leaf(first, count, rayTime) may shrink rayTime.max to cull farther nodes.
+  template <typename LeafFunc>
+  void traverse(const Ray &ray, Interval &rayTime, LeafFunc &&leaf) const {
+    if (nodes.empty()) return;
+    const float3 &dir = ray.direction;
+    float3 invDir(1 / dir.val[0], 1 / dir.val[1], 1 / dir.val[2]);
+    bool dirNeg[3] = {invDir.val[0] < 0, invDir.val[1] < 0, invDir.val[2] < 0};
+
+    uint32_t stack[maxDepth];
+    int stackSize = 0;
+    uint32_t current = 0;
+    uint64_t visited = 0;
+    while (true) {
+      visited++;
+      const BVHNode &node = nodes[current];
+      if (node.bounds.hit(ray.origin, invDir, rayTime)) {
+        if (node.count > 0) {
+          leaf(node.offset, node.count, rayTime);
+        } else if (dirNeg[node.axis]) {
+          stack[stackSize++] = current + 1;
+          current = node.offset;
+          continue;
+        } else {
+          stack[stackSize++] = node.offset;
+          current = current + 1;
+          continue;
+        }
+      }
+      if (stackSize == 0) break;
+      current = stack[--stackSize];
+    }
+    RT_COUNT(BVHNodes, visited);
+  }
+
+  // traverse for any-hit queries: leaf(first, count) returns true once it
+  // found a hit, which ends the walk. True if a leaf did.
+  template <typename LeafFunc>
+  bool traverseAny(const Ray &ray, Interval rayTime, LeafFunc &&leaf) const {
+    if (nodes.empty()) return false;
+    const float3 &dir = ray.direction;
+    float3 invDir(1 / dir.val[0], 1 / dir.val[1], 1 / dir.val[2]);
+    bool dirNeg[3] = {invDir.val[0] < 0, invDir.val[1] < 0, invDir.val[2] < 0};
+
+    uint32_t stack[maxDepth];
+    int stackSize = 0;
+    uint32_t current = 0;
+    uint64_t visited = 0;
+    bool found = false;
+    while (true) {
+      visited++;
+      const BVHNode &node = nodes[current];
+      if (node.bounds.hit(ray.origin, invDir, rayTime)) {
+        if (node.count > 0) {
+          if (leaf(node.offset, node.count)) {
+            found = true;
+            break;
+          }
+        } else if (dirNeg[node.axis]) {
+          stack[stackSize++] = current + 1;
+          current = node.offset;
+          continue;
+        } else {
+          stack[stackSize++] = node.offset;
+          current = current + 1;
+          continue;
+        }
+      }
+      if (stackSize == 0) break;
+      current = stack[--stackSize];
+    }
+    RT_COUNT(BVHNodes, visited);
+    return found;
+  }
+
+  // traverse for a coherent RayPacket, the packet walks the tree once, near
+  // child first by the direction signs its rays share. A node is entered by
+  // the rays from the first one that hits its box on; when that one misses,
+  // the frustum test culls the node for all of them before the others are
+  // tried. leaf(node, firstRay) is called once per leaf with the first ray
+  // that hits it, the later rays still have to test the leaf's box.
+  template <typename LeafFunc>
+  void traversePacket(RayPacket &packet, uint32_t first,
+                      LeafFunc &&leaf) const {
+    if (nodes.empty()) return;
+    struct Entry {
+      uint32_t node, first;
+    };
+    Entry stack[maxDepth];
+    int stackSize = 0;
+    uint32_t current = 0;
+    uint64_t visited = 0;
+    while (true) {
+      visited++;
+      const BVHNode &node = nodes[current];
+      first = packet.firstHit(node.bounds, first);
+      if (first < packet.size) {
+        if (node.count > 0) {
+          leaf(node, first);
+          packet.updateTimeMax();
+        } else if (packet.dirNeg[node.axis]) {
+          stack[stackSize++] = {current + 1, first};
+          current = node.offset;
+          continue;
+        } else {
+          stack[stackSize++] = {node.offset, first};
+          current = current + 1;
+          continue;
+        }
+      }
+      if (stackSize == 0) break;
+      stackSize--;
+      current = stack[stackSize].node;
+      first = stack[stackSize].first;
+    }
+    // nodes the packet visited, not rays times nodes
+    RT_COUNT(BVHNodes, visited);
+  }
+
+ private:
+  struct PrimInfo {
+    AABB bounds;
+    float3 centroid;
+    uint32_t index;
+  };
+
+  struct Bin {
+    AABB bounds;
+    size_t count = 0;
+  };
+
+  uint32_t buildRecursive(std::vector<PrimInfo> &prims, size_t begin,
+                          size_t end, size_t maxLeafSize, int depth = 1) {
+    uint32_t nodeIndex = nodes.size();
+    nodes.push_back({});
+
+    AABB bounds, centroidBounds;
+    for (size_t i = begin; i < end; i++) {
+      bounds.expand(prims[i].bounds);
+      centroidBounds.expand(prims[i].centroid);
+    }
+    nodes[nodeIndex].bounds = bounds;
+
+    size_t count = end - begin;
+    auto makeLeaf = [&]() {
+      nodes[nodeIndex].offset = begin;
+      nodes[nodeIndex].count = count;
+      return nodeIndex;
+    };
+    if (count == 1 || depth >= maxDepth - 1) return makeLeaf();
+
+    // the leaves at the depth limit must still fit maxLeafCount: once the
+    // levels left can only get there by halving, split by index
+    int levelsLeft = maxDepth - 2 - depth;
+    if (levelsLeft < 32 && count > (maxLeafCount << levelsLeft) + 1)
+      return makeInterior(nodeIndex, prims, begin, (begin + end) / 2, end, 0,
+                          maxLeafSize, depth);
+
+    // find the cheapest binned split over all three axes
+    int bestAxis = -1, bestBin = 0;
+    mfloat bestCost = INF;
+    float3 cExtent = centroidBounds.extent();
+    for (int axis = 0; axis < 3; axis++) {
+      if (cExtent.val[axis] <= 0) continue;
+      Bin bins[binCount];
+      for (size_t i = begin; i < end; i++) {
+        int b = binIndex(prims[i].centroid, centroidBounds, axis);
+        bins[b].count++;
+        bins[b].bounds.expand(prims[i].bounds);
+      }
+      // sweep from the right to get the cost of every right side
+      mfloat rightArea[binCount - 1];
+      size_t rightCount[binCount - 1];
+      AABB acc;
+      size_t accCount = 0;
+      for (int b = binCount - 1; b > 0; b--) {
+        acc.expand(bins[b].bounds);
+        accCount += bins[b].count;
+        rightArea[b - 1] = acc.surfaceArea();
+        rightCount[b - 1] = accCount;
+      }
+      acc = AABB();
+      accCount = 0;
+      for (int b = 0; b < binCount - 1; b++) {
+        acc.expand(bins[b].bounds);
+        accCount += bins[b].count;
+        mfloat cost = blocks(accCount) * acc.surfaceArea() +
+                      blocks(rightCount[b]) * rightArea[b];
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = b;
+        }
+      }
+    }
+
+    // relative cost: one traversal step + intersections on both sides
+    mfloat area = bounds.surfaceArea();
+    mfloat leafCost = blocks(count);
+    mfloat splitCost = 0.5 + (area > 0 ? bestCost / area : leafCost);
+    if (count <= maxLeafSize && splitCost >= leafCost) return makeLeaf();
+
+    size_t mid;
+    if (bestAxis >= 0) {
+      auto it = std::partition(
+          prims.begin() + begin, prims.begin() + end, [&](const PrimInfo &p) {
+            return binIndex(p.centroid, centroidBounds, bestAxis) <= bestBin;
+          });
+      mid = it - prims.begin();
+    } else {
+      // all centroids coincide, split in the middle
+      mid = (begin + end) / 2;
+    }
+    if (mid == begin || mid == end) mid = (begin + end) / 2;
+
+    return makeInterior(nodeIndex, prims, begin, mid, end,
+                        bestAxis >= 0 ? bestAxis : 0, maxLeafSize, depth);
+  }
+
+  uint32_t makeInterior(uint32_t nodeIndex, std::vector<PrimInfo> &prims,
+                        size_t begin, size_t mid, size_t end, int axis,
+                        size_t maxLeafSize, int depth) {
+    nodes[nodeIndex].axis = axis;
+    buildRecursive(prims, begin, mid, maxLeafSize, depth + 1);
+    uint32_t right = buildRecursive(prims, mid, end, maxLeafSize, depth + 1);
+    nodes[nodeIndex].offset = right;
+    nodes[nodeIndex].count = 0;
+    return nodeIndex;
+  }
+
+  size_t blocks(size_t count) const {
+    return (count + blockSize - 1) / blockSize;
+  }
+
+  static int binIndex(const float3 &centroid, const AABB &centroidBounds,
+                      int axis) {
+    mfloat lo = centroidBounds.min.val[axis], hi = centroidBounds.max.val[axis];
+    int b = int(binCount * (centroid.val[axis] - lo) / (hi - lo));
+    return std::clamp(b, 0, binCount - 1);
+  }
+};
+
+// Drop-in replacement for HittableList, returns the same closest hit
+struct BVH : public Hittable {
+  std::vector<const Hittable *> objects;  // sorted in leaf order
+  BVHTree tree;
+
+  BVH() {}
+  BVH(const HittableList &list, size_t maxLeafSize = 2)
+      : BVH(list.objects, maxLeafSize) {}
+  BVH(const std::vector<const Hittable *> &list,
+      size_t maxLeafSize = 2) {
+    build(list, maxLeafSize);
+  }
+
+  void build(const std::vector<const Hittable *> &list,
+             size_t maxLeafSize = 2) {
+    std::vector<AABB> bounds(list.size());
+    for (size_t i = 0; i < list.size(); i++)
+      bounds[i] = list[i]->boundingBox();
+    tree.build(bounds, maxLeafSize);
+
+    objects.resize(list.size());
+    for (size_t i = 0; i < list.size(); i++)
+      objects[i] = list[tree.primIndices[i]];
+  }
+
+  Result<HitRecord> hit(const Ray &ray, Interval rayTime) const override {
+    Result<HitRecord> record;
+    tree.traverse(ray, rayTime,
+                  [&](uint32_t first, uint32_t count, Interval &rayTime) {
+                    for (uint32_t i = first; i < first + count; i++) {
+                      auto result = objects[i]->hit(ray, rayTime);
+                      if (result.success) {
+                        record = result;
+                        rayTime.max = record.ret.rayTime;
+                      }
+                    }
+                  });
+    return record;
+  }
+
+  // the objects of a leaf get the rays from the leaf's first one on
+  void hitPacket(RayPacket &packet, uint32_t first = 0) const override {
+    if (!packet.coherent) return Hittable::hitPacket(packet, first);
+    tree.traversePacket(packet, first,
+                        [&](const BVHNode &node, uint32_t firstRay) {
+                          for (uint32_t i = node.offset;
+                               i < node.offset + node.count; i++)
+                            objects[i]->hitPacket(packet, firstRay);
+                        });
+  }
+
+  bool occluded(const Ray &ray, Interval rayTime) const override {
+    return tree.traverseAny(ray, rayTime,
+                            [&](uint32_t first, uint32_t count) {
+                              for (uint32_t i = first; i < first + count; i++)
+                                if (objects[i]->occluded(ray, rayTime))
+                                  return true;
+                              return false;
+                            });
+  }
+
+  AABB boundingBox() const override { return tree.bounds(); }
+};
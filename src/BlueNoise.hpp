@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "include/Random.hpp"
+
+// A size x size tileable blue-noise mask: every texel holds its rank, and
+// the texels of any range of ranks are spread evenly over the tile.
+// Built once on first use with Ulichney's void-and-cluster method ("The
+// void-and-cluster method for dither array generation", 1993), about 20 ms.
+struct BlueNoise {
+  static constexpr int size = 64;
+  static constexpr int count = size * size;
+
+  // rank of texel (x, y) in [0, count), the coordinates wrap around
+  static uint32_t rank(uint32_t x, uint32_t y) {
+    return Get().ranks[(y % size) * size + x % size];
+  }
+
+ private:
+  std::array<uint16_t, count> ranks;
+
+  static const BlueNoise &Get() {
+    static const BlueNoise noise;
+    return noise;
+  }
+
+  // energy of a point at distance (dx, dy), Gaussian with sigma 1.5
+  static constexpr int radius = 6;
+  std::array<float, (2 * radius + 1) * (2 * radius + 1)> kernel;
+  std::vector<float> energy;
+  std::vector<uint8_t> points;
+
+  BlueNoise() {
+    for (int dy = -radius; dy <= radius; dy++)
+      for (int dx = -radius; dx <= radius; dx++)
+        kernel[(dy + radius) * (2 * radius + 1) + dx + radius] =
+            std::exp(-(dx * dx + dy * dy) / (2 * 1.5f * 1.5f));
+
+    // initial pattern: a tenth of the texels at random, relaxed by moving
+    // the tightest cluster into the largest void until that's itself
+    RNG rng(0x6b6c);
+    points.assign(count, 0);
+    energy.assign(count, 0);
+    int initial = count / 10;
+    for (int placed = 0; placed < initial;) {
+      int i = rng.nextUInt() % count;
+      if (points[i]) continue;
+      toggle(i);
+      placed++;
+    }
+    for (int step = 0; step < count; step++) {
+      int cluster = extreme(1, true);
+      toggle(cluster);
+      int gap = extreme(0, false);
+      if (gap == cluster) {
+        toggle(cluster);
+        break;
+      }
+      toggle(gap);
+    }
+    std::vector<uint8_t> start = points;
+    std::vector<float> startEnergy = energy;
+
+    // the initial points get the lowest ranks, tightest cluster last
+    for (int rank = initial - 1; rank >= 0; rank--) {
+      int i = extreme(1, true);
+      toggle(i);
+      ranks[i] = rank;
+    }
+    // then the largest void is filled, up to half of the texels
+    points = start;
+    energy = startEnergy;
+    int rank = initial;
+    for (; rank < count / 2; rank++) {
+      int i = extreme(0, false);
+      toggle(i);
+      ranks[i] = rank;
+    }
+    // past half the empty texels are the minority: their energy decides,
+    // the tightest cluster of empty texels is filled next
+    energy.assign(count, 0);
+    for (int i = 0; i < count; i++)
+      if (!points[i]) splat(i, 1);
+    for (; rank < count; rank++) {
+      int i = extreme(0, true);
+      points[i] = 1;
+      splat(i, -1);
+      ranks[i] = rank;
+    }
+    energy = {};
+    points = {};
+  }
+
+  void splat(int i, float sign) {
+    int x = i % size, y = i / size;
+    for (int dy = -radius; dy <= radius; dy++) {
+      int row = ((y + dy + size) % size) * size;
+      for (int dx = -radius; dx <= radius; dx++)
+        energy[row + (x + dx + size) % size] +=
+            sign * kernel[(dy + radius) * (2 * radius + 1) + dx + radius];
+    }
+  }
+
+  void toggle(int i) {
+    points[i] ^= 1;
+    splat(i, points[i] ? 1 : -1);
+  }
+
+  // the texel with value `value` of highest (or lowest) energy
+  int extreme(uint8_t value, bool highest) const {
+    int best = -1;
+    for (int i = 0; i < count; i++) {
+      if (points[i] != value) continue;
+      if (best < 0 || (highest ? energy[i] > energy[best]
+                               : energy[i] < energy[best]))
+        best = i;
+    }
+    return best;
+  }
+};
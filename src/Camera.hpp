@@ -1,14 +1,26 @@
 #pragma once
 
-#include <omp.h>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <string>
+#include <type_traits>
 
+#include "include/Counters.hpp"
 #include "include/MathUtils.hpp"
+#include "include/ThreadPool.hpp"
 #include "Interval.hpp"
 #include "Hittable.hpp"
 #include "Color.hpp"
 #include "Ray.hpp"
 #include "Image.hpp"
 #include "Material.hpp"
+#include "Tiles.hpp"
+#include "Lights.hpp"
+#include "Progress.hpp"
+#include "Accumulator.hpp"
+#include "Denoiser.hpp"
+#include "Wavefront.hpp"
 
 struct CameraTransform {
   float3 origin, lookAt, up;
@@ -55,18 +67,95 @@ struct DefocusDisk {
     origin = camTrans.origin + k;
     radius = tan(Deg2Rad(angle / 2)) * foucsDist / 2;
   }
-  Ray randomRayToWorldPos(float3 pos) const {
-    float2 randPos = RandomInUnitDisk() * radius;
+  Ray randomRayToWorldPos(float3 pos, Sampler &sampler) const {
+    float2 randPos = SampleUnitDisk(sampler.next2D()) * radius;
     float3 originNew = origin + i * randPos.x() + j * randPos.y();
     float3 dir = pos - originNew;
     return {originNew, normalize(dir)};
   }
 };
 
+struct PathStats {
+  uint64_t paths = 0;  // camera samples
+  uint64_t rays = 0;   // camera, scattered and shadow rays
+  double seconds = 0;  // wall time of the render
+
+  double averagePathLength() const { return paths ? double(rays) / paths : 0; }
+  double mraysPerSecond() const { return seconds > 0 ? rays / seconds / 1e6 : 0; }
+};
+
 struct Camera {
   // renderer settings
   int samplesPerPixel = 4;
   int maxDepth = 10;
+  // bounces before Russian roulette may end a path, >= maxDepth disables it
+  int rouletteMinDepth = 3;
+  // both integrators draw the same random numbers and give the same image
+  Integrator integrator = Integrator::Megakernel;
+  // every pixel draws from its own generator seeded by (seed, pixel index),
+  // so a render is reproducible no matter how many threads run it
+  uint64_t seed = 0;
+  // the random numbers of each sample, indexed by the pixel's sample count
+  // and the dimension of the draw (see Sampler.hpp)
+  SamplerType samplerType = SamplerType::Sobol;
+  // next-event estimation: diffuse surfaces sample the scene's lights
+  // (DiffuseLight primitives, see Lights.hpp) with a shadow ray, weighted
+  // against hitting them by chance with multiple importance sampling
+  bool sampleLights = true;
+  // the sky gradient around the scene, a black background if false
+  bool sky = true;
+
+  // progressive rendering: samples are added in passes of passSamples and,
+  // if checkpointPath is set, saved there every checkpointInterval seconds.
+  // A render resumes from the checkpoint when it matches size, seed,
+  // sampler and settingsHash().
+  int passSamples = 0;  // 0: all samples in one pass
+  std::string checkpointPath;
+  double checkpointInterval = 300;
+  // identifies the scene for checkpoints, SceneFile sets it from the scene
+  // and mesh files; scenes built in code leave it 0
+  uint64_t sceneHash = 0;
+
+  // adaptive sampling: from adaptiveMinSamples on, pixels whose relative
+  // error falls below adaptiveThreshold stop, the samples they save go to
+  // the noisy pixels (up to adaptiveMaxSamples each) until the budget of
+  // samplesPerPixel * pixel count is spent
+  mfloat adaptiveThreshold = 0;  // 0: off
+  int adaptiveMinSamples = 32;
+  int adaptiveMaxSamples = 0;  // 0: 8 * samplesPerPixel
+  // samples each pixel of the last adaptive render received
+  HDRImage sampleHeatmap;
+
+  // denoising: render() returns the image filtered by denoiser, guided by
+  // feature buffers from featureSamples extra camera rays per pixel; the
+  // image before filtering is kept in noisyImage. With outputFeatures the
+  // buffers are made without denoising.
+  bool denoise = false;
+  bool outputFeatures = false;
+  int featureSamples = 8;
+  Denoiser denoiser;
+  FeatureBuffers features;
+  HDRImage noisyImage;
+
+  // scheduler settings
+  int threadCount = 0;  // 0: one per hardware thread
+  int tileSize = 32;
+  TileOrder tileOrder = TileOrder::Hilbert;
+  // camera rays are traced as RayPackets of packetSize x packetSize pixels
+  // (at most 8 x 8), 1 traces them one by one; the image is the same
+  int packetSize = 8;
+  // with printLog, a progress line every progressInterval seconds; the same
+  // progress goes to the JSON file at statusPath if it is set
+  double progressInterval = 1;
+  std::string statusPath;
+  // timing of every tile and pass of the last render, in render order
+  std::vector<TileStat> tileStats;
+  std::vector<PassStat> passStats;
+  PathStats pathStats;
+  // hot-path counts of the last render, zero unless built with RT_COUNTERS
+  CounterBlock counts;
+  // the lights of the scene being rendered
+  LightList lights;
 
   // camera settings
   int width, height;
@@ -100,43 +189,417 @@ struct Camera {
     viewportSize = float2(viewportHeight, viewportWidth);
   }
 
-  Image render(const HittableList &scene, bool printLog = true) {
-    Image image(height, width, 3);
+  // the scene, the view and the settings that change what the samples add
+  // up to; the integrator, scheduling and pass settings don't
+  uint64_t settingsHash() const {
+    uint64_t hash = sceneHash;
+    auto mix = [&](double x) {
+      hash = MixBits(hash ^ std::bit_cast<uint64_t>(x));
+    };
+    mix(maxDepth);
+    mix(rouletteMinDepth);
+    mix(sampleLights);
+    mix(sky);
+    mix(VFoV);
+    for (const float3 &v : {camTrans.origin, camTrans.lookAt, camTrans.up})
+      for (int i = 0; i < 3; i++) mix(v.val[i]);
+    mix(ddisk.angle);
+    mix(ddisk.foucsDist);
+    mix(ddisk.imageDist);
+    return hash;
+  }
 
-    int lines_rendered = 0;
-    omp_lock_t lines_rendered_mutex;
-    if (printLog) omp_init_lock(&lines_rendered_mutex);
+  // linear radiance, tonemap with HDRImage::toImage for 8-bit output
+  HDRImage render(const Hittable &scene, bool printLog = true) {
+    Accumulator accum(height, width, seed);
+    accum.samplerType = uint64_t(samplerType);
+    accum.settingsHash = settingsHash();
+    if (!checkpointPath.empty() && accum.load(checkpointPath) && printLog)
+      print("resumed from", checkpointPath, "at", accum.samplesDone, "spp");
+    render(scene, accum, printLog);
+    if (adaptiveThreshold > 0) sampleHeatmap = accum.sampleHeatmap();
+    if (!denoise && !outputFeatures) return accum.resolve();
 
-#pragma omp parallel for num_threads(16)
-    for (int x = 0; x < height; x++) {
-      for (int y = 0; y < width; y++) {
-        ColorF3 colorSum(0, 0, 0);
-        for (int s = 0; s < samplesPerPixel; s++) {
-          auto samplePos = getRandomSamplePos(x, y);
-          auto ray = rayToScreenPos(samplePos / screenSize);
-          colorSum += rayColor(ray, scene);
+    auto start = std::chrono::steady_clock::now();
+    renderFeatures(scene);
+    auto featuresDone = std::chrono::steady_clock::now();
+    if (printLog)
+      print("feature buffers:", featureSamples, "spp,",
+            std::chrono::duration<double>(featuresDone - start).count(), "s");
+    if (!denoise) return accum.resolve();
+    noisyImage = accum.resolve();
+    auto image = denoiser.denoise(noisyImage, accum.variance(), features);
+    if (printLog)
+      print("denoised in",
+            std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          featuresDone)
+                .count(),
+            "s");
+    return image;
+  }
+
+  // Fill features with the albedo, normal and depth seen through every
+  // pixel, averaged over featureSamples (at least 1) camera rays that start
+  // like the render's first samples. Specular bounces are followed up to
+  // the first diffuse surface, so the denoiser keeps what mirrors and glass
+  // show sharp; the albedo is then tinted by their attenuation.
+  void renderFeatures(const Hittable &scene) {
+    features = FeatureBuffers(height, width);
+    const int samples = std::max(1, featureSamples);
+    auto tiles = MakeTiles(height, width, tileSize, tileOrder);
+    WorkStealingPool pool(threadCount);
+    pool.run(tiles.size(), [&](size_t index, int) {
+      const Tile &tile = tiles[index];
+      for (int x = tile.rowBegin; x < tile.rowEnd; x++) {
+        for (int y = tile.colBegin; y < tile.colEnd; y++) {
+          size_t pixel = size_t(x) * width + y;
+          RNG rng(seed, pixel);
+          ColorF3 albedo(0, 0, 0);
+          float3 normal(0, 0, 0);
+          mfloat depth = 0;
+          for (int s = 0; s < samples; s++) {
+            Sampler sampler(samplerType, rng, seed, x, y, s);
+            auto samplePos = getRandomSamplePos(x, y, sampler);
+            auto ray = rayToScreenPos(samplePos / screenSize, sampler);
+            featureSample(ray, scene, sampler, albedo, normal, depth);
+          }
+          mfloat inv = mfloat(1) / samples;
+          features.albedo.setPixel(x, y, albedo * inv);
+          for (int c = 0; c < 3; c++)
+            features.normal(x, y, c) = normal.val[c] * inv;
+          features.depth(x, y, 0) = depth * inv;
         }
-        colorSum /= samplesPerPixel;
-        image.setPixel(x, y, colorSum);
       }
+    });
+  }
+
+  // distance of the background in the depth buffer
+  static constexpr mfloat BackgroundDepth = 1e6;
+
+  // add the features of one camera ray to albedo, normal and depth
+  void featureSample(Ray ray, const Hittable &scene, Sampler &sampler,
+                     ColorF3 &albedo, float3 &normal, mfloat &depth) const {
+    ColorF3 throughput(1, 1, 1);
+    for (int bounce = 0; bounce < maxDepth; bounce++) {
+      auto result = scene.hit(ray, Interval(0, INF));
+      if (!result.success) {
+        if (bounce == 0) depth += BackgroundDepth;
+        albedo += throughput * saturate(background(ray));
+        normal += ray.direction * -1;
+        return;
+      }
+      auto hit = result.ret;
+      hit.resolve(ray);
+      if (bounce == 0) depth += hit.rayTime;
+      sampler.startVertex(bounce);
+      float3 facing = Lambertian::FacingNormal(hit);
+      if (hit.material->type == MaterialType::DiffuseLight) {
+        albedo += throughput *
+                  saturate(static_cast<const DiffuseLight &>(*hit.material)
+                               .emitted(hit));
+        normal += facing;
+        return;
+      }
+      auto matResult = Scatter(*hit.material, ray, hit, sampler);
+      if (!matResult.success || matResult.ret.pdf > 0 ||
+          bounce + 1 == maxDepth) {
+        if (matResult.success)
+          albedo += throughput * matResult.ret.attenuation;
+        normal += facing;
+        return;
+      }
+      throughput *= matResult.ret.attenuation;
+      ray = matResult.ret.ray;
+    }
+  }
+
+  // add passes to accum until every pixel has samplesPerPixel samples, or
+  // with adaptive sampling until the sample budget is spent
+  void render(const Hittable &scene, Accumulator &accum, bool printLog) {
+    auto tiles = MakeTiles(height, width, tileSize, tileOrder);
+    WorkStealingPool pool(threadCount);
+    tileStats.clear();
+    passStats.clear();
+    pathStats = {};
+    counters::Reset();
+    if (sampleLights)
+      lights.build(scene);
+    else
+      lights.clear();
+
+    bool adaptive = adaptiveThreshold > 0;
+    int maxSamples = samplesPerPixel;
+    if (adaptive)
+      maxSamples = adaptiveMaxSamples > 0 ? adaptiveMaxSamples
+                                          : 8 * samplesPerPixel;
+    uint64_t budget = uint64_t(samplesPerPixel) * width * height;
+    int pass = passSamples > 0 ? passSamples
+               : adaptive      ? adaptiveMinSamples
+                               : samplesPerPixel;
+    int passCount = (maxSamples - int(accum.samplesDone) + pass - 1) / pass;
+    // samples still to render, adaptive passes may stop before all of them.
+    // How many passes that takes isn't known up front, so an adaptive
+    // render reports its progress by samples only.
+    uint64_t samplesTotal =
+        adaptive ? budget - std::min(budget, accum.totalSamples())
+                 : uint64_t(std::max(0, maxSamples - int(accum.samplesDone))) *
+                       width * height;
+    uint64_t tilesTotal = adaptive ? 0 : tiles.size() * std::max(0, passCount);
+    ProgressReporter progress(pathStats.paths, pathStats.rays, tilesTotal,
+                              samplesTotal, printLog, statusPath,
+                              progressInterval);
+    std::vector<Wavefront> wavefronts(
+        integrator == Integrator::Wavefront ? pool.size() : 0);
+    auto renderStart = std::chrono::steady_clock::now();
+    auto lastCheckpoint = renderStart;
+    auto secondsSince = [](auto start) {
+      auto now = std::chrono::steady_clock::now();
+      return std::chrono::duration<double>(now - start).count();
+    };
+    // whether the checkpoint holds every pass rendered so far
+    bool checkpointed = true;
+    auto saveCheckpoint = [&] {
+      if (!accum.save(checkpointPath))
+        print("failed to write checkpoint", checkpointPath);
+      else if (printLog)
+        print("checkpoint saved at", accum.samplesDone, "spp");
+      lastCheckpoint = std::chrono::steady_clock::now();
+      checkpointed = true;
+    };
 
-      if (printLog) {
-        omp_set_lock(&lines_rendered_mutex);
-        lines_rendered++;
-        print("Lines rendered:", lines_rendered, "/", height);
-        omp_unset_lock(&lines_rendered_mutex);
+    while (int(accum.samplesDone) < maxSamples) {
+      int spp = std::min<int>(pass, maxSamples - accum.samplesDone);
+      if (adaptive) {
+        // no pixel stops before adaptiveMinSamples (threshold 0)
+        size_t active = accum.updateConvergence(
+            int(accum.samplesDone) >= adaptiveMinSamples ? adaptiveThreshold
+                                                         : 0);
+        uint64_t total = accum.totalSamples();
+        if (active == 0 || total >= budget) break;
+        // the last passes spend exactly what is left of the budget: as many
+        // samples as every active pixel can get, then one more each for the
+        // noisiest pixels
+        uint64_t left = budget - total;
+        if (uint64_t(spp) * active > left) {
+          spp = int(left / active);
+          if (spp == 0) {
+            accum.holdBack(left);
+            spp = 1;
+          }
+        }
       }
+      size_t statsBegin = tileStats.size();
+      tileStats.resize(statsBegin + tiles.size());
+      int passIndex = passStats.size();
+      passStats.push_back({spp, secondsSince(renderStart), 0});
+
+      pool.run(tiles.size(), [&](size_t index, int thread) {
+        double start = secondsSince(renderStart);
+        if (integrator == Integrator::Wavefront)
+          renderTileWavefront(tiles[index], scene, accum, spp,
+                              wavefronts[thread]);
+        else
+          renderTile(tiles[index], scene, accum, spp);
+        tileStats[statsBegin + index] = {thread, int(index), passIndex,
+                                         start,
+                                         secondsSince(renderStart) - start};
+        progress.tileDone();
+      });
+      accum.samplesDone += spp;
+      accum.releaseHeld();
+      checkpointed = false;
+      PassStat &passStat = passStats.back();
+      passStat.seconds = secondsSince(renderStart) - passStat.start;
+
+      if (!checkpointPath.empty() &&
+          secondsSince(lastCheckpoint) >= checkpointInterval)
+        saveCheckpoint();
     }
+    // the last passes, also when adaptive sampling stopped early
+    if (!checkpointPath.empty() && !checkpointed) saveCheckpoint();
 
+    progress.finish();
+    pathStats.seconds = secondsSince(renderStart);
+    counts = counters::Collect();
     if (printLog) {
-      print("all lines rendered.");
-      omp_destroy_lock(&lines_rendered_mutex);
+      print("all tiles rendered.");
+      PrintTileReport(tileStats, pool.size(), pool.steals());
+      print("paths:", pathStats.paths, "rays:", pathStats.rays,
+            "average path length:", pathStats.averagePathLength(),
+            "Mrays/s:", pathStats.mraysPerSecond());
+      if (CountersEnabled) PrintCounters(counts);
+      if (adaptive)
+        print("adaptive sampling: mean spp",
+              double(accum.totalSamples()) / (width * height), "max spp",
+              accum.samplesDone);
     }
+  }
 
-    return image;
+  // add spp samples to every pixel of the tile that hasn't converged
+  void renderTile(const Tile &tile, const Hittable &scene, Accumulator &accum,
+                  int spp) {
+    if (packetSize > 1) return renderTilePackets(tile, scene, accum, spp);
+    uint64_t paths = 0, rays = 0;
+    for (int x = tile.rowBegin; x < tile.rowEnd; x++) {
+      for (int y = tile.colBegin; y < tile.colEnd; y++) {
+        size_t pixel = accum.pixelIndex(x, y);
+        if (accum.converged[pixel]) continue;
+        for (int s = 0; s < spp; s++) {
+          Sampler sampler = pixelSampler(accum, x, y);
+          auto samplePos = getRandomSamplePos(x, y, sampler);
+          auto ray = rayToScreenPos(samplePos / screenSize, sampler);
+          accum.addSample(pixel, rayColor(ray, scene, sampler, &rays));
+        }
+        paths += spp;
+      }
+    }
+    std::atomic_ref<uint64_t>(pathStats.paths) += paths;
+    std::atomic_ref<uint64_t>(pathStats.rays) += rays;
+  }
+
+  // renderTile with the camera rays of each block of packetSize x
+  // packetSize pixels traced as one packet, the rest of every path is traced
+  // by rayColor. A pixel draws its random numbers in the same order as in
+  // renderTile, only the samples of the block's pixels are interleaved.
+  void renderTilePackets(const Tile &tile, const Hittable &scene,
+                         Accumulator &accum, int spp) {
+    uint64_t paths = 0, rays = 0;
+    int side = std::min(packetSize, 8);
+    RayPacket packet;
+    uint32_t pixels[RayPacket::maxSize];
+    Sampler samplers[RayPacket::maxSize];
+    for (int bx = tile.rowBegin; bx < tile.rowEnd; bx += side) {
+      for (int by = tile.colBegin; by < tile.colEnd; by += side) {
+        for (int s = 0; s < spp; s++) {
+          packet.clear();
+          for (int x = bx; x < std::min(bx + side, tile.rowEnd); x++) {
+            for (int y = by; y < std::min(by + side, tile.colEnd); y++) {
+              size_t pixel = accum.pixelIndex(x, y);
+              if (accum.converged[pixel]) continue;
+              Sampler &sampler = samplers[packet.size];
+              sampler = pixelSampler(accum, x, y);
+              auto samplePos = getRandomSamplePos(x, y, sampler);
+              pixels[packet.size] = pixel;
+              packet.add(rayToScreenPos(samplePos / screenSize, sampler));
+            }
+          }
+          if (packet.size == 0) break;
+          packet.prepare();
+          scene.hitPacket(packet);
+          for (uint32_t i = 0; i < packet.size; i++)
+            accum.addSample(pixels[i],
+                            rayColor(packet.rays[i], scene,
+                                     samplers[i], &rays,
+                                     &packet.results[i]));
+          paths += packet.size;
+        }
+      }
+    }
+    std::atomic_ref<uint64_t>(pathStats.paths) += paths;
+    std::atomic_ref<uint64_t>(pathStats.rays) += rays;
+  }
+
+  // renderTile for the wavefront integrator. A wave holds one path for
+  // every pixel of the tile, so each pixel still draws its random numbers
+  // in the same order as in rayColor and the image is identical.
+  void renderTileWavefront(const Tile &tile, const Hittable &scene,
+                           Accumulator &accum, int spp, Wavefront &wave) {
+    uint64_t paths = 0, rays = 0;
+    for (int s = 0; s < spp; s++) {
+      // camera rays
+      wave.reset();
+      for (int x = tile.rowBegin; x < tile.rowEnd; x++) {
+        for (int y = tile.colBegin; y < tile.colEnd; y++) {
+          size_t pixel = accum.pixelIndex(x, y);
+          if (accum.converged[pixel]) continue;
+          Sampler sampler = pixelSampler(accum, x, y);
+          auto samplePos = getRandomSamplePos(x, y, sampler);
+          wave.addPath(rayToScreenPos(samplePos / screenSize, sampler), pixel,
+                       sampler);
+        }
+      }
+      paths += wave.active.size();
+
+      for (int depth = 0; depth < maxDepth && !wave.active.empty(); depth++) {
+        rays += wave.active.size();
+        // only the camera rays are coherent enough for packets
+        if (depth == 0 && packetSize > 1)
+          wave.intersectPackets(scene);
+        else
+          wave.intersect(scene);
+        // background color (sky color)
+        for (uint32_t path : wave.misses) {
+          RT_COUNT_PATH(PathsEscaped, depth);
+          ColorF3 escaped =
+              wave.throughput[path] * background(wave.rays[path]);
+          accum.addSample(wave.pixels[path], wave.radiance[path] + escaped);
+        }
+        ShadeContext context{scene, accum, depth, rays};
+        shadeQueue<Lambertian>(wave, MaterialType::Lambertian, context);
+        shadeQueue<Metal>(wave, MaterialType::Metal, context);
+        shadeQueue<Dielectric>(wave, MaterialType::Dielectric, context);
+        shadeQueue<DiffuseLight>(wave, MaterialType::DiffuseLight, context);
+        shadeQueue<Material>(wave, MaterialType::Other, context);
+      }
+      // exceed the max depth
+      for (uint32_t path : wave.active) {
+        RT_COUNT_PATH(PathsMaxDepth, maxDepth);
+        accum.addSample(wave.pixels[path], wave.radiance[path]);
+      }
+    }
+    std::atomic_ref<uint64_t>(pathStats.paths) += paths;
+    std::atomic_ref<uint64_t>(pathStats.rays) += rays;
   }
 
-  Ray rayToScreenPos(const float2 &screenPos) {
+  struct ShadeContext {
+    const Hittable &scene;
+    Accumulator &accum;
+    int depth;
+    uint64_t &rays;
+  };
+
+  // add the light of every hit of one material queue and scatter it,
+  // surviving paths go back to the active list. T = Material is the
+  // virtual fallback for other types.
+  template <typename T>
+  void shadeQueue(Wavefront &wave, MaterialType type,
+                  ShadeContext &context) const {
+    Accumulator &accum = context.accum;
+    int depth = context.depth;
+    for (uint32_t path : wave.queues[size_t(type)]) {
+      Sampler &sampler = wave.samplers[path];
+      sampler.startVertex(depth);
+      const HitRecord &hit = wave.hits[path];
+      ColorF3 &radiance = wave.radiance[path];
+      radiance += wave.throughput[path] *
+                  hitRadiance(wave.rays[path], hit, wave.bsdfPdf[path],
+                              context.scene, sampler, &context.rays);
+      auto material = static_cast<const T *>(hit.material);
+      Result<ScatteredRay> matResult;
+      if constexpr (std::is_same_v<T, Material>)
+        matResult = material->scatter(wave.rays[path], hit, sampler);
+      else
+        matResult = material->T::scatter(wave.rays[path], hit, sampler);
+
+      ColorF3 &throughput = wave.throughput[path];
+      if (matResult.success) {
+        throughput *= matResult.ret.attenuation;
+        if (survivesRoulette(throughput, depth, sampler)) {
+          wave.rays[path] = matResult.ret.ray;
+          wave.bsdfPdf[path] = matResult.ret.pdf;
+          wave.active.push_back(path);
+          continue;
+        }
+        RT_COUNT_PATH(PathsRoulette, depth + 1);
+      } else {
+        RT_COUNT_PATH(PathsAbsorbed, depth);
+      }
+      // absorbed
+      accum.addSample(wave.pixels[path], radiance);
+    }
+  }
+
+  Ray rayToScreenPos(const float2 &screenPos, Sampler &sampler) {
     // screenPos: (0, 1)^2
     // screenPosCentered: (-0.5, 0.5)^2
     float2 screenPosCentered = screenPos - viewportCenter;
@@ -146,48 +609,147 @@ struct Camera {
                  camTrans.j * -worldPos.x() +  // up
                  camTrans.k * -1;              // depth
     if (ddisk.angle > 0) {
-      worldPos = camTrans.origin + dir * ddisk.foucsDist;
-      return ddisk.randomRayToWorldPos(worldPos);
+      float3 focusPos = camTrans.origin + dir * ddisk.foucsDist;
+      return ddisk.randomRayToWorldPos(focusPos, sampler);
     }
     // emit a ray from the origin
     return Ray{camTrans.origin, normalize(dir)};
   }
 
-  float2 getRandomSamplePos(int x, int y) {
+  // the sampler of the next sample of pixel (x, y)
+  Sampler pixelSampler(Accumulator &accum, int x, int y) const {
+    size_t pixel = accum.pixelIndex(x, y);
+    return Sampler(samplerType, accum.rng[pixel], accum.seed, x, y,
+                   accum.sampleCount[pixel]);
+  }
+
+  float2 getRandomSamplePos(int x, int y, Sampler &sampler) {
     // x in [0, height), y in [0, width)
     float2 screenPos(x, y);
     // delta.x, delta.y in [0, 1)
-    float2 delta(RandFloat(), RandFloat());
+    float2 delta = sampler.next2D();
     return screenPos + delta;
   }
 
-  ColorF3 rayColor(const Ray &ray, const Hittable &scene, int depth = 0) const {
-    if (depth >= maxDepth)  // exceed the max depth
-      return ColorF3(0, 0, 0);
+  // Iterative path tracer, the product of the attenuations so far is kept
+  // in throughput and the light found so far in radiance. From
+  // rouletteMinDepth bounces on a path survives with probability
+  // q = max(throughput) (at most 0.95) and is weighted by 1 / q, so dim
+  // paths end early without biasing the result.
+  // rayCount, if given, is increased by the number of rays traced.
+  // cameraHit, if given, is the camera ray's closest hit, already traced.
+  ColorF3 rayColor(const Ray &cameraRay, const Hittable &scene,
+                   Sampler &sampler,
+                   uint64_t *rayCount = nullptr,
+                   const Result<HitRecord> *cameraHit = nullptr) const {
+    Ray ray = cameraRay;
+    ColorF3 throughput(1, 1, 1), radiance(0, 0, 0);
+    mfloat bsdfPdf = 0;  // of the bounce that traced ray
+    for (int depth = 0; depth < maxDepth; depth++) {
+      if (rayCount) (*rayCount)++;
 
-    // ray trace
-    auto result = scene.hit(ray, Interval(1e-3, INF));
+      // ray trace
+      auto result = depth == 0 && cameraHit ? *cameraHit
+                                            : scene.hit(ray, Interval(0, INF));
+      // background color (sky color)
+      if (!result.success) {
+        RT_COUNT_PATH(PathsEscaped, depth);
+        return radiance + throughput * background(ray);
+      }
 
-    // hit an object
-    if (result.success) {
       auto hit = result.ret;
+      hit.resolve(ray);
+      sampler.startVertex(depth);
+      radiance += throughput * hitRadiance(ray, hit, bsdfPdf, scene, sampler,
+                                           rayCount);
+      auto matResult = Scatter(*hit.material, ray, hit, sampler);
+      // absorbed
+      if (!matResult.success) {
+        RT_COUNT_PATH(PathsAbsorbed, depth);
+        return radiance;
+      }
 
-      auto matResult = hit.material->scatter(ray, hit);
-      // not absorbed
-      if (matResult.success) {
-        auto scatteredRay = matResult.ret;
-        return scatteredRay.attenuation *
-               rayColor(scatteredRay.ray, scene, depth + 1);
+      throughput *= matResult.ret.attenuation;
+      ray = matResult.ret.ray;
+      bsdfPdf = matResult.ret.pdf;
+      if (!survivesRoulette(throughput, depth, sampler)) {
+        RT_COUNT_PATH(PathsRoulette, depth + 1);
+        return radiance;
       }
-      // absorbed
+    }
+    // exceed the max depth
+    RT_COUNT_PATH(PathsMaxDepth, maxDepth);
+    return radiance;
+  }
+
+  // The light a path picks up at a hit, to be weighted by its throughput:
+  // the emission of a light it hits, and on diffuse surfaces the light of
+  // one sample of the light list through a shadow ray (next-event
+  // estimation). Both can find the same light; they are weighted against
+  // each other with the power heuristic (multiple importance sampling).
+  // bsdfPdf is the pdf of the bounce that traced ray, 0 for the camera ray
+  // and specular bounces, whose hits on lights count in full.
+  ColorF3 hitRadiance(const Ray &ray, const HitRecord &hit, mfloat bsdfPdf,
+                      const Hittable &scene, Sampler &sampler,
+                      uint64_t *rayCount) const {
+    const Material &material = *hit.material;
+    if (material.type == MaterialType::DiffuseLight) {
+      auto &light = static_cast<const DiffuseLight &>(material);
+      ColorF3 emitted = light.emitted(hit);
+      if (bsdfPdf > 0) emitted *= PowerHeuristic(bsdfPdf, lights.pdf(ray, hit));
+      return emitted;
+    }
+    if (material.type != MaterialType::Lambertian || lights.empty())
+      return ColorF3(0, 0, 0);
+
+    auto &lambertian = static_cast<const Lambertian &>(material);
+    LightSample sample = lights.sample(hit.point, sampler);
+    float3 normal = Lambertian::FacingNormal(hit);
+    mfloat cos = normal.dot(sample.direction);
+    if (sample.pdf <= 0 || cos <= 0 || maxAbs(sample.emission) == 0)
+      return ColorF3(0, 0, 0);
+    // stop short of the light, the shadow ray would find the light itself
+    Ray shadow = Material::leave(hit, sample.direction);
+    if (rayCount) (*rayCount)++;
+    RT_COUNT(ShadowRays, 1);
+    if (scene.occluded(shadow,
+                       Interval(0, sample.distance * (1 - ShadowEpsilon)))) {
+      RT_COUNT(ShadowsOccluded, 1);
       return ColorF3(0, 0, 0);
     }
+    // albedo / pi * cos / pdf, the pdf of scatter is cos / pi
+    mfloat scatterPdf = Lambertian::pdf(normal, sample.direction);
+    return lambertian.albedo * sample.emission *
+           (scatterPdf / sample.pdf * PowerHeuristic(sample.pdf, scatterPdf));
+  }
+
+  // relative distance to a sampled light point the shadow ray leaves out
+  static constexpr mfloat ShadowEpsilon = 1e-3;
+
+  // weight of a sample drawn with pdf a against another strategy's pdf b
+  static mfloat PowerHeuristic(mfloat a, mfloat b) {
+    return a * a / (a * a + b * b);
+  }
+
+  ColorF3 background(const Ray &ray) const {
+    return sky ? skyColor(ray) : ColorF3(0, 0, 0);
+  }
+
+  // Russian roulette after the scatter at depth, reweights the survivors
+  bool survivesRoulette(ColorF3 &throughput, int depth,
+                        Sampler &sampler) const {
+    if (depth + 1 < rouletteMinDepth) return true;
+    auto &t = throughput.val;
+    mfloat q = std::min(std::max({t[0], t[1], t[2]}), mfloat(0.95));
+    if (sampler.nextFloat() >= q) return false;
+    throughput /= q;
+    return true;
+  }
 
-    // background color (sky color)
+  static ColorF3 skyColor(const Ray &ray) {
     float3 rayDirN = safeNormalize(ray.direction);
     mfloat blend = 0.5 * (rayDirN.y() + 1.0);
-    ColorF3 color = lerp(ColorF3(1, 1, 1), ColorF3(0.5, 0.7, 1), blend);
-    return color;
+    return lerp(ColorF3(1, 1, 1), ColorF3(0.5, 0.7, 1), blend);
   }
 };
 
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Image.hpp"
+
+// What the camera sees through each pixel besides its color, averaged over
+// the pixel like the color: Camera::renderFeatures writes them, Denoiser
+// uses them to tell edges from noise. Behind mirrors and glass they are
+// those of the first diffuse surface the path reaches.
+struct FeatureBuffers {
+  HDRImage albedo;  // RGB reflectance, the background's color for the sky
+  HDRImage normal;  // world space, towards the camera for the sky
+  HDRImage depth;   // 1 channel, distance of the first hit from the camera
+
+  FeatureBuffers() {}
+  FeatureBuffers(size_t height, size_t width)
+      : albedo(height, width, 3),
+        normal(height, width, 3),
+        depth(height, width, 1) {}
+
+  bool empty() const { return depth.data.empty(); }
+};
+
+// Weighted first-order regression in the spirit of NFOR (Bitterli et al.
+// 2016), with one buffer where NFOR has two. The color is divided by the
+// albedo first, so only the lighting is filtered and textures stay sharp.
+// Around every pixel p, the lighting of the (2 radius + 1)^2 window is fit
+// as a linear function of the screen offset, normal and depth of each
+// pixel q (least squares, q weighted by w_pq), and p gets the fit's value
+// at its own features. Lighting that follows the geometry, like shading
+// across a sphere or a shadow fading along the floor, is then not blurred.
+// w_pq = exp(-sum of):
+//  patch: the NL-means distance (Rousselle et al. 2012) of the lighting
+//    around p and q, relative to their variance (from the render)
+//  normal: normalWeight * (1 - n_p . n_q)
+//  albedo: |a_p - a_q| (sum over RGB) / albedoScale
+//  depth: |z_p - z_q| / (depthScale * z_p)
+// Planes are stored one per channel with a border. The image is split in
+// blocks of a few rows whose sums stay in L1, and the window is walked one
+// offset at a time over a block, so the inner loops run along rows with
+// unit stride and vectorize.
+struct Denoiser {
+  // defaults from bench_denoise: a larger radius does a little better on
+  // the weekend scene and worse on lights.json, a larger colorScale
+  // averages more and blurs more
+  int radius = 3;
+  int patchRadius = 1;
+  float colorScale = 0.6f;
+  float normalWeight = 4;
+  float albedoScale = 0.1f;
+  float depthScale = 1;
+
+  // color: the render, variance: 1 channel, of the mean luminance of every
+  // pixel (Accumulator::variance)
+  HDRImage denoise(const HDRImage &color, const HDRImage &variance,
+                   const FeatureBuffers &features) const {
+    const int height = color.height, width = color.width;
+    const int pad = radius + patchRadius;
+    // rows padded to a multiple of 16 floats
+    const size_t stride = (width + 2 * pad + 15) / 16 * 16;
+    // blocks at the right edge are computed full width, past the border
+    // into the next row and, on the last one, past the end
+    const size_t planeSize = (height + 2 * pad) * stride + blockCols;
+    auto at = [&](int row, int col) {
+      return (row + pad) * stride + col + pad;
+    };
+
+    // lighting (color / albedo), its luminance and variance, and the
+    // features; the border repeats the edge pixels and has inside = 0
+    std::vector<float> light[3], albedo[3], normal[3], luma(planeSize),
+        lightVar(planeSize), depth(planeSize), invDepth(planeSize),
+        inside(planeSize);
+    for (int c = 0; c < 3; c++) {
+      light[c].resize(planeSize);
+      albedo[c].resize(planeSize);
+      normal[c].resize(planeSize);
+    }
+#pragma omp parallel for
+    for (int row = -pad; row < height + pad; row++) {
+      for (int col = -pad; col < width + pad; col++) {
+        size_t p = at(row, col),
+               i = size_t(std::clamp(row, 0, height - 1)) * width +
+                   std::clamp(col, 0, width - 1);
+        for (int c = 0; c < 3; c++) {
+          // no albedo to divide by (black surface or background): the
+          // color is filtered as it is
+          float a = features.albedo.data[i * 3 + c];
+          albedo[c][p] = a > 1e-3f ? a : 1;
+          light[c][p] = color.data[i * 3 + c] / albedo[c][p];
+        }
+        luma[p] = Luminance(light[0][p], light[1][p], light[2][p]);
+        float y = Luminance(albedo[0][p], albedo[1][p], albedo[2][p]);
+        lightVar[p] = variance.data[i] / (y * y);
+        const float *n = &features.normal.data[i * 3];
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for (int c = 0; c < 3; c++)
+          normal[c][p] = length > 0 ? n[c] / length : 0;
+        depth[p] = features.depth.data[i];
+        invDepth[p] = 1 / std::max(depth[p], 1e-6f);
+        inside[p] = row == std::clamp(row, 0, height - 1) &&
+                    col == std::clamp(col, 0, width - 1);
+      }
+    }
+
+    HDRImage image(height, width, 3);
+    const int patchSize = 2 * patchRadius + 1;
+    const float patchArea = float(patchSize * patchSize);
+    const float k2 = colorScale * colorScale;
+    const float invAlbedoScale = 1 / albedoScale;
+    const float invRadius = 1.f / std::max(radius, 1);
+    const int blockRowCount = (height + blockRows - 1) / blockRows,
+              blockColCount = (width + blockCols - 1) / blockCols;
+#pragma omp parallel
+    {
+      // per block: the pixel distances of one offset, their sums along
+      // rows and over patches, a row of weights and regressors, and the
+      // weighted sums of the regression, small enough to stay in L1
+      const int distCols = blockCols + 2 * patchRadius,
+                distRows = blockRows + 2 * patchRadius;
+      std::vector<float> dist(distRows * distCols),
+          rowSum(distRows * blockCols);
+      float patchDist[blockCols], weight[blockCols], weighted[blockCols],
+          x[unknowns][blockCols], rgb[3][blockCols],
+          sums[sumCount][blockRows][blockCols];
+
+#pragma omp for schedule(dynamic)
+      for (int block = 0; block < blockRowCount * blockColCount; block++) {
+        const int rowBegin = block / blockColCount * blockRows,
+                  colBegin = block % blockColCount * blockCols;
+        const int rows = std::min(blockRows, height - rowBegin),
+                  cols = std::min(blockCols, width - colBegin);
+        std::fill_n(&sums[0][0][0], sumCount * blockRows * blockCols, 0.f);
+        for (int dr = -radius; dr <= radius; dr++) {
+          for (int dc = -radius; dc <= radius; dc++) {
+            const ptrdiff_t offset = ptrdiff_t(dr) * ptrdiff_t(stride) + dc;
+            // (l_p - l_q)^2 less the part the noise explains, relative to
+            // the variance, with a border of patchRadius around the block
+            for (int r = 0; r < rows + 2 * patchRadius; r++) {
+              const size_t base =
+                  at(rowBegin + r - patchRadius, colBegin - patchRadius);
+              const float *l = &luma[base], *v = &lightVar[base];
+              float *d = &dist[r * distCols];
+#pragma omp simd
+              for (int col = 0; col < distCols; col++) {
+                const ptrdiff_t q = col + offset;
+                float diff = l[col] - l[q];
+                float vp = v[col], vq = v[q];
+                d[col] = (diff * diff - (vp + std::min(vp, vq))) /
+                         (k2 * (vp + vq) + 1e-10f);
+              }
+            }
+            for (int r = 0; r < rows + 2 * patchRadius; r++) {
+              const float *d = &dist[r * distCols];
+              float *sum = &rowSum[r * blockCols];
+              std::fill(sum, sum + blockCols, 0.f);
+              for (int j = 0; j < patchSize; j++) {
+#pragma omp simd
+                for (int col = 0; col < blockCols; col++)
+                  sum[col] += d[col + j];
+              }
+            }
+
+            for (int r = 0; r < rows; r++) {
+              std::fill(patchDist, patchDist + blockCols, 0.f);
+              for (int j = 0; j < patchSize; j++) {
+                const float *sum = &rowSum[(r + j) * blockCols];
+#pragma omp simd
+                for (int col = 0; col < blockCols; col++)
+                  patchDist[col] += sum[col];
+              }
+              const size_t base = at(rowBegin + r, colBegin);
+              const float *nx = &normal[0][base], *ny = &normal[1][base],
+                          *nz = &normal[2][base];
+              const float *ar = &albedo[0][base], *ag = &albedo[1][base],
+                          *ab = &albedo[2][base];
+              const float *z = &depth[base], *invZ = &invDepth[base],
+                          *in = &inside[base];
+              const float *lr = &light[0][base], *lg = &light[1][base],
+                          *lb = &light[2][base];
+              // the weight, the regressors (1, screen offset, normal
+              // change, depth change relative and times 10 to be about as
+              // large) and R, G, B of q
+#pragma omp simd
+              for (int col = 0; col < blockCols; col++) {
+                const ptrdiff_t q = col + offset;
+                float cosine =
+                    nx[col] * nx[q] + ny[col] * ny[q] + nz[col] * nz[q];
+                float albedoDiff = std::abs(ar[col] - ar[q]) +
+                                   std::abs(ag[col] - ag[q]) +
+                                   std::abs(ab[col] - ab[q]);
+                float depthDiff = (z[q] - z[col]) * invZ[col];
+                float exponent = std::max(patchDist[col] / patchArea, 0.f) +
+                                 normalWeight * (1 - cosine) +
+                                 albedoDiff * invAlbedoScale +
+                                 std::abs(depthDiff) / depthScale;
+                float w = in[q] * Exp(-exponent);
+                // keeps denormals, which are very slow, out of the sums
+                weight[col] = w > minWeight ? w : 0;
+                x[0][col] = 1;
+                x[1][col] = dc * invRadius;
+                x[2][col] = dr * invRadius;
+                x[3][col] = nx[q] - nx[col];
+                x[4][col] = ny[q] - ny[col];
+                x[5][col] = nz[q] - nz[col];
+                x[6][col] = 10 * depthDiff;
+                rgb[0][col] = lr[q];
+                rgb[1][col] = lg[q];
+                rgb[2][col] = lb[q];
+              }
+              // the sums of w x_a x_b for b <= a, then of w x_a R, G, B
+              int j = 0;
+              for (int a = 0; a < unknowns; a++) {
+#pragma omp simd
+                for (int col = 0; col < blockCols; col++)
+                  weighted[col] = weight[col] * x[a][col];
+                for (int b = 0; b < a + 4; b++) {
+                  const float *y = b <= a ? x[b] : rgb[b - a - 1];
+                  float *sum = sums[j++][r];
+#pragma omp simd
+                  for (int col = 0; col < blockCols; col++)
+                    sum[col] += weighted[col] * y[col];
+                }
+              }
+            }
+          }
+        }
+
+        // solve the normal equations of every pixel of the block
+        for (int r = 0; r < rows; r++) {
+          float solution[3][blockCols];
+          Solve(sums, r, solution);
+          for (int col = 0; col < cols; col++) {
+            const int row = rowBegin + r, column = colBegin + col;
+            const size_t p = at(row, column);
+            for (int c = 0; c < 3; c++) {
+              // NaN if the system was singular
+              float value = solution[c][col];
+              image.data[(size_t(row) * width + column) * 3 + c] =
+                  (value == value ? value : light[c][p]) * albedo[c][p];
+            }
+          }
+        }
+      }
+    }
+    return image;
+  }
+
+ private:
+  static constexpr float minWeight = 1e-12f;
+  // pixels the regression sums are kept for at a time
+  static constexpr int blockRows = 4, blockCols = 32;
+  // regressors, and weighted sums per pixel: the lower triangle of the
+  // Gram matrix and the right-hand sides of R, G and B
+  static constexpr int unknowns = 7;
+  static constexpr int sumCount = unknowns * (unknowns + 1) / 2 + 3 * unknowns;
+  // added to the Gram matrix's diagonal, relative to the sum of weights
+  static constexpr float ridge = 1e-3f;
+  // of w x_a x_b (b <= a) and of w x_a times channel c in sums
+  static constexpr int GramIndex(int a, int b) {
+    return a * (a + 1) / 2 + 3 * a + b;
+  }
+  static constexpr int RhsIndex(int a, int c) {
+    return GramIndex(a, a) + 1 + c;
+  }
+
+  // the first coefficient (the fit's value at the pixel itself) of the
+  // regressions of R, G and B for row r of a block, by Cholesky in place,
+  // every pixel of the row at once
+  static void Solve(float (&sums)[sumCount][blockRows][blockCols], int r,
+                    float (&solution)[3][blockCols]) {
+    float invDiagonal[unknowns][blockCols];
+    for (int a = 0; a < unknowns; a++) {
+      for (int b = 0; b <= a; b++) {
+        float *lower = sums[GramIndex(a, b)][r];
+#pragma omp simd
+        for (int col = 0; col < blockCols; col++) {
+          float s = lower[col];
+          if (a == b && a > 0) s += ridge * sums[0][r][col];
+          for (int k = 0; k < b; k++)
+            s -= sums[GramIndex(a, k)][r][col] * sums[GramIndex(b, k)][r][col];
+          if (a == b) {
+            // not positive: NaN, the pixel is left as it is
+            lower[col] = std::sqrt(s > 0 ? s : NAN);
+            invDiagonal[a][col] = 1 / lower[col];
+          } else {
+            lower[col] = s * invDiagonal[b][col];
+          }
+        }
+      }
+    }
+    for (int c = 0; c < 3; c++) {
+      float x[unknowns][blockCols];
+      // L y = rhs, y in place of rhs, then L^T x = y
+      for (int a = 0; a < unknowns; a++) {
+        float *y = sums[RhsIndex(a, c)][r];
+#pragma omp simd
+        for (int col = 0; col < blockCols; col++) {
+          float s = y[col];
+          for (int k = 0; k < a; k++)
+            s -= sums[GramIndex(a, k)][r][col] * sums[RhsIndex(k, c)][r][col];
+          y[col] = s * invDiagonal[a][col];
+        }
+      }
+      for (int a = unknowns - 1; a >= 0; a--) {
+#pragma omp simd
+        for (int col = 0; col < blockCols; col++) {
+          float s = sums[RhsIndex(a, c)][r][col];
+          for (int k = a + 1; k < unknowns; k++)
+            s -= sums[GramIndex(k, a)][r][col] * x[k][col];
+          x[a][col] = s * invDiagonal[a][col];
+        }
+      }
+      std::copy(x[0], x[0] + blockCols, solution[c]);
+    }
+  }
+
+  static float Luminance(float r, float g, float b) {
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+  }
+
+  // e^x for x <= 0, at least 2^-60, relative error below 1e-5: 2^(the
+  // integer nearest to x / ln 2) put together in the exponent bits, times
+  // a polynomial for the rest. Plain float arithmetic, unlike std::exp it
+  // vectorizes without -ffast-math.
+  static float Exp(float x) {
+    float t = x * 1.44269504f;
+    t = t > -60.f ? t : -60.f;
+    // adding 1.5 * 2^23 rounds to an integer, found in the low mantissa bits
+    float shifted = t + 12582912.f;
+    float whole = shifted - 12582912.f;
+    float f = (t - whole) * 0.69314718f;
+    float p = 1 + f * (1 + f * (1 / 2.f + f * (1 / 6.f + f * (1 / 24.f +
+                  f * (1 / 120.f + f * (1 / 720.f))))));
+    uint32_t n = std::bit_cast<uint32_t>(shifted) - 0x4b400000u;
+    return p * std::bit_cast<float>((n + 127) << 23);
+  }
+};
@@ -1,44 +1,200 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <vector>
 #include <memory>
 
 #include "include/Utils.hpp"
+#include "include/Result.hpp"
 #include "Ray.hpp"
 #include "Interval.hpp"
+#include "AABB.hpp"
 // don't import "Material.hpp" here
 
 // avoid circular dependency
 struct Material;
+struct Hittable;
 
 struct HitRecord {
-  mfloat rayTime;
-  float3 point;
-  float3 normal;
-  bool frontFace;
-  std::shared_ptr<Material> material;
+  mfloat rayTime = 0;
+  // primitive that was hit, the fields below are only valid after resolve()
+  const Hittable *object = nullptr;
+  uint32_t primIndex = 0;  // inside object, for primitives that pack many
+  // Instance the hit was found through, object is then in its object space
+  const Hittable *instance = nullptr;
+
+  float3 point{0, 0, 0};
+  mfloat pointError = 0;  // bound on the rounding error of point, per axis
+  float3 normal{0, 0, 0};
+  bool frontFace = false;
+  const Material *material = nullptr;
+
+  // compute the surface data, only done once for the closest hit
+  void resolve(const Ray &ray);
+};
+
+// Up to maxSize rays traced together, Camera puts the camera rays of a
+// block of pixels in one. Every ray keeps its own interval and closest hit,
+// rayTimes[i].max shrinks to results[i] as hits are found, so a packet can
+// go through several objects like a single ray through a HittableList.
+struct RayPacket {
+  static constexpr uint32_t maxSize = 64;
+
+  uint32_t size = 0;
+  Ray rays[maxSize];
+  Interval rayTimes[maxSize];
+  Result<HitRecord> results[maxSize];
+  float3 invDirs[maxSize];
+
+  // set by prepare(): coherent if the rays agree on the sign of every
+  // direction component (dirNeg) and none is parallel to an axis. Only
+  // coherent packets are traced as packets, the others ray by ray.
+  bool coherent = false;
+  bool dirNeg[3];
+  // bounds over all rays, for the frustum test
+  float3 originMin, originMax, invDirMin, invDirMax;
+  mfloat timeMin, timeMax;
+
+  void clear() { size = 0; }
+
+  void add(const Ray &ray, Interval rayTime = Interval(0, INF)) {
+    rays[size] = ray;
+    rayTimes[size] = rayTime;
+    results[size] = {};
+    size++;
+  }
+
+  // call once all rays are added
+  void prepare() {
+    coherent = size > 0;
+    for (int k = 0; k < 3; k++) {
+      originMin.val[k] = invDirMin.val[k] = INF;
+      originMax.val[k] = invDirMax.val[k] = -INF;
+    }
+    timeMin = INF;
+    for (uint32_t i = 0; i < size; i++) {
+      const float3 &o = rays[i].origin, &d = rays[i].direction;
+      float3 &inv = invDirs[i];
+      for (int k = 0; k < 3; k++) {
+        inv.val[k] = 1 / d.val[k];
+        if (i == 0) dirNeg[k] = inv.val[k] < 0;
+        coherent &= (inv.val[k] < 0) == dirNeg[k] && std::isfinite(inv.val[k]);
+        originMin.val[k] = std::min(originMin.val[k], o.val[k]);
+        originMax.val[k] = std::max(originMax.val[k], o.val[k]);
+        invDirMin.val[k] = std::min(invDirMin.val[k], inv.val[k]);
+        invDirMax.val[k] = std::max(invDirMax.val[k], inv.val[k]);
+      }
+      timeMin = std::min(timeMin, rayTimes[i].min);
+    }
+    updateTimeMax();
+  }
+
+  // after rays found closer hits
+  void updateTimeMax() {
+    timeMax = -INF;
+    for (uint32_t i = 0; i < size; i++)
+      timeMax = std::max(timeMax, rayTimes[i].max);
+  }
+
+  bool hitsBox(const AABB &box, uint32_t i) const {
+    return box.hit(rays[i].origin, invDirs[i], rayTimes[i]);
+  }
+
+  // True if no ray of a coherent packet can hit the box. The slab distances
+  // are bounded with interval arithmetic over the origin and inverse
+  // direction bounds; rounding is monotonic, so the bounds hold for the
+  // rounded per-ray distances of AABB::hit as well and the test is exact.
+  bool frustumMisses(const AABB &box) const {
+    mfloat enter = timeMin, exit = timeMax;
+    for (int k = 0; k < 3; k++) {
+      mfloat nearPlane = dirNeg[k] ? box.max.val[k] : box.min.val[k];
+      mfloat farPlane = dirNeg[k] ? box.min.val[k] : box.max.val[k];
+      mfloat n0 = nearPlane - originMin.val[k],
+             n1 = nearPlane - originMax.val[k];
+      mfloat f0 = farPlane - originMin.val[k],
+             f1 = farPlane - originMax.val[k];
+      mfloat i0 = invDirMin.val[k], i1 = invDirMax.val[k];
+      enter = std::max(enter, std::min({n0 * i0, n0 * i1, n1 * i0, n1 * i1}));
+      mfloat far = std::max({f0 * i0, f0 * i1, f1 * i0, f1 * i1});
+      exit = std::min(exit,
+                      far * (1 + 4 * std::numeric_limits<mfloat>::epsilon()));
+    }
+    return enter > exit;
+  }
+
+  // the first ray from `first` on that hits the box, size if none does
+  uint32_t firstHit(const AABB &box, uint32_t first) const {
+    if (first >= size || hitsBox(box, first)) return first;
+    if (frustumMisses(box)) return size;
+    for (uint32_t i = first + 1; i < size; i++)
+      if (hitsBox(box, i)) return i;
+    return size;
+  }
 };
 
 struct Hittable {
-  // virtual ~Hittable() = default;
+  virtual ~Hittable() = default;
 
+  // closest-hit query, only fills rayTime and object of the record
   virtual Result<HitRecord> hit(const Ray &ray, Interval rayTime) const = 0;
+
+  // any-hit query for shadow rays: is anything hit inside rayTime. Stops at
+  // the first hit found, whichever it is, and builds no HitRecord; every
+  // primitive and acceleration structure overrides it.
+  virtual bool occluded(const Ray &ray, Interval rayTime) const {
+    return hit(ray, rayTime).success;
+  }
+
+  // closest hits of the packet's rays from `first` on, the same hit() finds
+  // for each of them. This one traces ray by ray, the acceleration
+  // structures trace coherent packets through their BVH at once.
+  virtual void hitPacket(RayPacket &packet, uint32_t first = 0) const {
+    for (uint32_t i = first; i < packet.size; i++) {
+      auto result = hit(packet.rays[i], packet.rayTimes[i]);
+      if (result.success) {
+        packet.results[i] = result;
+        packet.rayTimes[i].max = result.ret.rayTime;
+      }
+    }
+  }
+
+  // fill the surface data of a hit found by this primitive's hit()
+  virtual void resolveHit(const Ray & /*ray*/,
+                          HitRecord & /*record*/) const {}
+
+  // world-space bounds, used by the acceleration structures
+  virtual AABB boundingBox() const = 0;
 };
 
+inline void HitRecord::resolve(const Ray &ray) {
+  (instance ? instance : object)->resolveHit(ray, *this);
+}
+
+// non-owning, the objects are owned by a Scene
 struct HittableList : public Hittable {
-  std::vector<std::shared_ptr<Hittable>> objects;
+  std::vector<const Hittable *> objects;
+  AABB bbox;
 
   HittableList() {}
-  HittableList(std::shared_ptr<Hittable> object) { add(object); }
+  HittableList(const Hittable *object) { add(object); }
 
-  void clear() { objects.clear(); }
+  void clear() {
+    objects.clear();
+    bbox = AABB();
+  }
 
-  void add(std::shared_ptr<Hittable> object) { objects.push_back(object); }
+  void add(const Hittable *object) {
+    objects.push_back(object);
+    bbox.expand(object->boundingBox());
+  }
 
   Result<HitRecord> hit(const Ray &ray, Interval rayTime) const override {
     Result<HitRecord> record;
 
-    for (const auto &object : objects) {
+    for (const Hittable *object : objects) {
       auto result = object->hit(ray, rayTime);
       if (result.success) {
         record = result;
@@ -48,4 +204,16 @@ struct HittableList : public Hittable {
 
     return record;
   }
+
+  void hitPacket(RayPacket &packet, uint32_t first = 0) const override {
+    for (const Hittable *object : objects) object->hitPacket(packet, first);
+  }
+
+  bool occluded(const Ray &ray, Interval rayTime) const override {
+    for (const Hittable *object : objects)
+      if (object->occluded(ray, rayTime)) return true;
+    return false;
+  }
+
+  AABB boundingBox() const override { return bbox; }
 };
\ No newline at end of file
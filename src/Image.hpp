@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
 #include <vector>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -43,4 +47,165 @@ struct Image {
     stbi_write_png(path, width, height, channels, data.data(),
                    width * channels);
   }
+
+  // the PNG file in memory
+  std::vector<byte> encodePNG() const {
+    std::vector<byte> png;
+    stbi_write_png_to_func(
+        [](void* context, void* bytes, int size) {
+          auto out = static_cast<std::vector<byte>*>(context);
+          out->insert(out->end(), static_cast<byte*>(bytes),
+                      static_cast<byte*>(bytes) + size);
+        },
+        &png, width, height, channels, data.data(), width * channels);
+    return png;
+  }
+};
+
+// linear (not gamma encoded) float image, what the renderer writes into
+// all file formats below are written little-endian, as the host is
+struct HDRImage {
+  std::vector<float> data;
+  size_t height, width, channels;
+
+  HDRImage() : height(0), width(0), channels(0) {}
+  HDRImage(size_t height, size_t width, size_t channels = 3)
+      : height(height), width(width), channels(channels) {
+    data.resize(height * width * channels);
+  }
+
+  float& operator()(size_t h, size_t w, size_t c) {
+    return data[(h * width + w) * channels + c];
+  }
+
+  float operator()(size_t h, size_t w, size_t c) const {
+    return data[(h * width + w) * channels + c];
+  }
+
+  void setPixel(size_t h, size_t w, const ColorF3& color) {
+    for (size_t c = 0; c < 3; c++) (*this)(h, w, c) = color.val[c];
+  }
+
+  ColorF3 getPixel(size_t h, size_t w) const {
+    return ColorF3((*this)(h, w, 0), (*this)(h, w, 1), (*this)(h, w, 2));
+  }
+
+  // exposure, clamp to [0, 1], gamma encode and quantize in a single pass
+  Image toImage(float exposure = 1, float gamma = 2.2f) const {
+    Image image(height, width, channels);
+    const float* src = data.data();
+    byte* dst = image.data.data();
+    float invGamma = 1 / gamma;
+    long long n = data.size();
+#pragma omp parallel for simd
+    for (long long i = 0; i < n; i++) {
+      float v = std::min(std::max(src[i] * exposure, 0.0f), 1.0f);
+      dst[i] = byte(std::pow(v, invGamma) * 255.999f);
+    }
+    return image;
+  }
+
+  // Portable Float Map, RGB (or grayscale with 1 channel), rows stored
+  // bottom to top
+  bool writePFM(const char* path) const {
+    if (channels != 3 && channels != 1) return false;
+    FILE* file = std::fopen(path, "wb");
+    if (!file) return false;
+    std::fprintf(file, "%s\n%zu %zu\n-1.0\n", channels == 3 ? "PF" : "Pf",
+                 width, height);
+    for (size_t h = height; h-- > 0;)
+      std::fwrite(&data[h * width * channels], sizeof(float), width * channels,
+                  file);
+    return std::fclose(file) == 0;
+  }
+
+  bool readPFM(const char* path) {
+    FILE* file = std::fopen(path, "rb");
+    if (!file) return false;
+    char magic[3] = {};
+    float scale;
+    bool ok = std::fscanf(file, "%2s %zu %zu %f", magic, &width, &height,
+                          &scale) == 4 &&
+              std::strcmp(magic, "PF") == 0 && scale < 0 &&
+              std::fgetc(file) != EOF;
+    if (ok) {
+      channels = 3;
+      data.resize(height * width * channels);
+      for (size_t h = height; ok && h-- > 0;)
+        ok = std::fread(&data[h * width * channels], sizeof(float),
+                        width * channels, file) == width * channels;
+    }
+    std::fclose(file);
+    return ok;
+  }
+
+  // OpenEXR, uncompressed scanlines of 32-bit float R, G, B channels
+  bool writeEXR(const char* path) const {
+    if (channels != 3) return false;
+    std::string header;
+    auto put = [&](const void* p, size_t n) {
+      header.append(static_cast<const char*>(p), n);
+    };
+    auto putInt = [&](int32_t v) { put(&v, 4); };
+    auto putFloat = [&](float v) { put(&v, 4); };
+    auto attribute = [&](const char* name, const char* type, int32_t size) {
+      put(name, std::strlen(name) + 1);
+      put(type, std::strlen(type) + 1);
+      putInt(size);
+    };
+
+    putInt(20000630);  // magic number
+    putInt(2);         // version 2, single part scanline file
+    // channel list, sorted by name
+    attribute("channels", "chlist", 3 * 18 + 1);
+    for (const char* name : {"B", "G", "R"}) {
+      put(name, 2);
+      putInt(2);  // pixel type FLOAT
+      putInt(0);  // pLinear + reserved
+      putInt(1);  // x sampling
+      putInt(1);  // y sampling
+    }
+    put("", 1);
+    attribute("compression", "compression", 1);
+    put("", 1);  // NO_COMPRESSION
+    for (const char* name : {"dataWindow", "displayWindow"}) {
+      attribute(name, "box2i", 16);
+      putInt(0);
+      putInt(0);
+      putInt(width - 1);
+      putInt(height - 1);
+    }
+    attribute("lineOrder", "lineOrder", 1);
+    put("", 1);  // INCREASING_Y
+    attribute("pixelAspectRatio", "float", 4);
+    putFloat(1);
+    attribute("screenWindowCenter", "v2f", 8);
+    putFloat(0);
+    putFloat(0);
+    attribute("screenWindowWidth", "float", 4);
+    putFloat(1);
+    put("", 1);  // end of header
+
+    // one offset per scanline, then the scanlines: y, size, B row, G row, R row
+    uint64_t lineSize = 8 + width * 3 * sizeof(float);
+    uint64_t offset = header.size() + height * 8;
+    for (size_t h = 0; h < height; h++) {
+      put(&offset, 8);
+      offset += lineSize;
+    }
+
+    FILE* file = std::fopen(path, "wb");
+    if (!file) return false;
+    std::fwrite(header.data(), 1, header.size(), file);
+    std::vector<float> line(width * 3);
+    for (size_t h = 0; h < height; h++) {
+      int32_t lineInfo[2] = {int32_t(h), int32_t(width * 3 * sizeof(float))};
+      std::fwrite(lineInfo, sizeof(int32_t), 2, file);
+      for (size_t w = 0; w < width; w++)
+        for (size_t c = 0; c < 3; c++)
+          line[(2 - c) * width + w] = (*this)(h, w, c);
+      std::fwrite(line.data(), sizeof(float), line.size(), file);
+    }
+    return std::fclose(file) == 0;
+  }
 };
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <limits>
+
+#include "Ray.hpp"
+#include "Interval.hpp"
+#include "AABB.hpp"
+#include "Hittable.hpp"
+#include "Transform.hpp"
+
+// A shared object placed in the scene through an affine transform. The
+// object (a TriangleMesh, a SphereSet, a BVH over several of them) keeps
+// its own acceleration structure in object space; a BVH over instances is
+// the top level of a two-level hierarchy, and a thousand copies of a mesh
+// cost a thousand Instances, not a thousand meshes.
+// Instances don't nest: the object must not contain Instances itself.
+struct Instance : public Hittable {
+  const Hittable *object;
+  Transform transform;  // object to world
+  const Material *material;  // overrides the object's material if set
+
+  Instance(const Hittable *object, const Transform &transform,
+           const Material *material = nullptr)
+      : object(object),
+        transform(transform),
+        material(material),
+        bbox(transform.boundsToWorld(object->boundingBox())) {}
+
+  Result<HitRecord> hit(const Ray &ray, Interval rayTime) const override {
+    auto record = object->hit(transform.rayToObject(ray), rayTime);
+    if (record.success) record.ret.instance = this;
+    return record;
+  }
+
+  bool occluded(const Ray &ray, Interval rayTime) const override {
+    return object->occluded(transform.rayToObject(ray), rayTime);
+  }
+
+  void resolveHit(const Ray &ray, HitRecord &record) const override {
+    record.object->resolveHit(transform.rayToObject(ray), record);
+    const Affine &m = transform.toWorld;
+    float3 local = record.point;
+    record.point = m.applyPoint(local);
+    // the object's error stretched by the matrix, plus the rounding of the
+    // transform itself
+    record.pointError = m.norm() * record.pointError +
+                        4 * std::numeric_limits<mfloat>::epsilon() *
+                            (m.norm() * maxAbs(local) +
+                             maxAbs(float3(m.m[0][3], m.m[1][3], m.m[2][3])));
+    // frontFace carries over: the dot product of normal and direction
+    // keeps its sign under the transform
+    record.normal = transform.normalToWorld(record.normal);
+    if (material) record.material = material;
+  }
+
+  AABB boundingBox() const override { return bbox; }
+
+ private:
+  AABB bbox;
+};
@@ -1,19 +1,29 @@
 #pragma once
 
+#include <limits>
+
 #include "include/MathUtils.hpp"
 
-struct Interval {
-  mfloat min, max;
-  Interval() : min(-INF), max(INF) {}
-  Interval(mfloat min, mfloat max) : min(min), max(max) {}
-  mfloat length() const { return max - min; }
-  bool contains(mfloat x) const { return x >= min && x <= max; }
-  bool surroeds(mfloat x) const { return x > min && x < max; }
-  mfloat clamp(mfloat x) const { return std::min(std::max(x, min), max); }
+template <typename T>
+struct IntervalT {
+  T min, max;
+  IntervalT() : min(-Inf()), max(Inf()) {}
+  IntervalT(T min, T max) : min(min), max(max) {}
+  T length() const { return max - min; }
+  bool contains(T x) const { return x >= min && x <= max; }
+  bool surroeds(T x) const { return x > min && x < max; }
+  T clamp(T x) const { return std::min(std::max(x, min), max); }
+
+  static const IntervalT empty;
+  static const IntervalT all;
 
-  static const Interval empty;
-  static const Interval all;
+ private:
+  static constexpr T Inf() { return std::numeric_limits<T>::infinity(); }
 };
 
-const Interval Interval::empty = Interval(INF, -INF);
-const Interval Interval::all = Interval();
+template <typename T>
+const IntervalT<T> IntervalT<T>::empty = IntervalT<T>(Inf(), -Inf());
+template <typename T>
+const IntervalT<T> IntervalT<T>::all = IntervalT<T>();
+
+using Interval = IntervalT<mfloat>;
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "include/MathUtils.hpp"
+#include "Color.hpp"
+#include "Ray.hpp"
+#include "Hittable.hpp"
+#include "Material.hpp"
+#include "Sphere.hpp"
+#include "SphereSet.hpp"
+#include "TriangleMesh.hpp"
+#include "BVH.hpp"
+
+// one emitting sphere or triangle
+struct Light {
+  enum class Shape : uint8_t { Sphere, Triangle };
+
+  Shape shape;
+  float3 p0, p1, p2;  // sphere: center in p0, triangle: its vertices
+  mfloat radius;
+  mfloat area;
+  ColorF3 emission;
+};
+
+// a direction towards a light from a point
+struct LightSample {
+  float3 direction;  // unit length
+  mfloat distance;   // to the sampled point on the light
+  ColorF3 emission;  // arriving along direction, 0 from a back face
+  mfloat pdf = 0;    // solid angle pdf, with the choice of the light
+};
+
+// The emitters of a scene for next-event estimation: every primitive with a
+// DiffuseLight material directly in the scene's HittableList / BVH /
+// SphereSet / TriangleMesh. Emitters inside Instances aren't sampled, rays
+// that hit them still pick up their emission.
+// A light is chosen in proportion to its power, then a point on it: spheres
+// are sampled inside the cone they subtend, triangles by area.
+struct LightList {
+  std::vector<Light> lights;
+  std::vector<mfloat> cdf;  // of the light choice
+
+  bool empty() const { return lights.empty(); }
+
+  void clear() {
+    lights.clear();
+    cdf.clear();
+    index.clear();
+  }
+
+  void build(const Hittable &scene) {
+    clear();
+    add(scene);
+    mfloat total = 0;
+    for (const Light &light : lights) {
+      const ColorF3 &e = light.emission;
+      total += light.area * (e.val[0] + e.val[1] + e.val[2]);
+      cdf.push_back(total);
+    }
+    if (total <= 0) return clear();
+    for (mfloat &c : cdf) c /= total;
+  }
+
+  LightSample sample(const float3 &point, Sampler &sampler) const {
+    LightSample res;
+    mfloat u = sampler.nextFloat();
+    float2 uv = sampler.next2D();
+    mfloat u1 = uv.x(), u2 = uv.y();
+    size_t i = std::min<size_t>(
+        std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin(),
+        lights.size() - 1);
+    const Light &light = lights[i];
+    mfloat choice = cdf[i] - (i ? cdf[i - 1] : 0);
+
+    if (light.shape == Light::Shape::Sphere) {
+      float3 toCenter = light.p0 - point;
+      mfloat dist2 = toCenter.pow(), r2 = light.radius * light.radius;
+      if (dist2 <= r2) return res;  // inside the light
+      mfloat dist = std::sqrt(dist2);
+      // 1 - cos(theta max) without cancellation for far, small spheres
+      mfloat sin2Max = r2 / dist2;
+      mfloat oneMinusCosMax = sin2Max / (1 + std::sqrt(1 - sin2Max));
+      mfloat cosTheta = 1 - u1 * oneMinusCosMax;
+      mfloat sin2Theta = std::max(1 - cosTheta * cosTheta, mfloat(0));
+      mfloat sinTheta = std::sqrt(sin2Theta), phi = 2 * PI * u2;
+      float3 w = toCenter / dist, a, b;
+      OrthonormalBasis(w, a, b);
+      res.direction = a * (std::cos(phi) * sinTheta) +
+                      b * (std::sin(phi) * sinTheta) + w * cosTheta;
+      res.distance =
+          dist * cosTheta - std::sqrt(std::max(r2 - dist2 * sin2Theta,
+                                               mfloat(0)));
+      res.emission = light.emission;
+      res.pdf = choice / (2 * PI * oneMinusCosMax);
+    } else {
+      mfloat su = std::sqrt(u1), b0 = 1 - su, b1 = u2 * su;
+      float3 target = light.p0 * b0 + light.p1 * b1 + light.p2 * (1 - b0 - b1);
+      float3 toLight = target - point;
+      mfloat dist2 = toLight.pow();
+      res.distance = std::sqrt(dist2);
+      res.direction = toLight / res.distance;
+      mfloat cosLight = -TriangleNormal(light).dot(res.direction);
+      if (cosLight == 0 || dist2 == 0) return res;
+      res.emission = cosLight > 0 ? light.emission : ColorF3(0, 0, 0);
+      res.pdf = choice * dist2 / (std::abs(cosLight) * light.area);
+    }
+    return res;
+  }
+
+  // the pdf sample() has for the direction of ray, which was traced from
+  // a point to the hit; 0 if the hit isn't on a light of the list
+  mfloat pdf(const Ray &ray, const HitRecord &hit) const {
+    if (hit.instance) return 0;
+    auto it = index.find({hit.object, hit.primIndex});
+    if (it == index.end()) return 0;
+    size_t i = it->second;
+    const Light &light = lights[i];
+    mfloat choice = cdf[i] - (i ? cdf[i - 1] : 0);
+
+    if (light.shape == Light::Shape::Sphere) {
+      mfloat dist2 = (light.p0 - ray.origin).pow();
+      mfloat r2 = light.radius * light.radius;
+      if (dist2 <= r2) return 0;
+      mfloat sin2Max = r2 / dist2;
+      mfloat oneMinusCosMax = sin2Max / (1 + std::sqrt(1 - sin2Max));
+      return choice / (2 * PI * oneMinusCosMax);
+    }
+    mfloat length = ray.direction.length();
+    mfloat dist = hit.rayTime * length;
+    mfloat cosLight =
+        std::abs(TriangleNormal(light).dot(ray.direction)) / length;
+    if (cosLight == 0) return 0;
+    return choice * dist * dist / (cosLight * light.area);
+  }
+
+ private:
+  // light of a primitive, by (object, primIndex) of its hits
+  std::map<std::pair<const Hittable *, uint32_t>, size_t> index;
+
+  static float3 TriangleNormal(const Light &light) {
+    return normalize((light.p1 - light.p0).cross(light.p2 - light.p0));
+  }
+
+  static const DiffuseLight *Emitter(const Material *material) {
+    if (!material || material->type != MaterialType::DiffuseLight)
+      return nullptr;
+    return static_cast<const DiffuseLight *>(material);
+  }
+
+  void addSphere(const Hittable *object, uint32_t prim, const float3 &center,
+                 mfloat radius, const DiffuseLight &material) {
+    index[{object, prim}] = lights.size();
+    lights.push_back({Light::Shape::Sphere, center, center, center, radius,
+                      4 * PI * radius * radius, material.emission});
+  }
+
+  void add(const Hittable &object) {
+    if (auto list = dynamic_cast<const HittableList *>(&object)) {
+      for (const Hittable *o : list->objects) add(*o);
+    } else if (auto bvh = dynamic_cast<const BVH *>(&object)) {
+      for (const Hittable *o : bvh->objects) add(*o);
+    } else if (auto sphere = dynamic_cast<const Sphere *>(&object)) {
+      if (auto emitter = Emitter(sphere->material))
+        addSphere(sphere, 0, sphere->center, sphere->radius, *emitter);
+    } else if (auto set = dynamic_cast<const SphereSet *>(&object)) {
+      for (const BVHNode &node : set->tree.nodes) {
+        for (uint32_t k = node.offset; k < node.offset + node.count; k++) {
+          Sphere s = set->sphere(k);
+          if (auto emitter = Emitter(s.material))
+            addSphere(set, k, s.center, s.radius, *emitter);
+        }
+      }
+    } else if (auto mesh = dynamic_cast<const TriangleMesh *>(&object)) {
+      auto emitter = Emitter(mesh->material);
+      if (!emitter) return;
+      for (uint32_t k = 0; k < mesh->triangleCount(); k++) {
+        const float3 &p0 = mesh->vertex(k, 0), &p1 = mesh->vertex(k, 1),
+                     &p2 = mesh->vertex(k, 2);
+        mfloat area = (p1 - p0).cross(p2 - p0).length() / 2;
+        if (area <= 0) continue;
+        index[{mesh, k}] = lights.size();
+        lights.push_back(
+            {Light::Shape::Triangle, p0, p1, p2, 0, area, emitter->emission});
+      }
+    }
+  }
+};
@@ -1,60 +1,107 @@
 #pragma once
 
 #include "include/Utils.hpp"
+#include "include/Counters.hpp"
 #include "include/Result.hpp"
 #include "Ray.hpp"
 #include "Hittable.hpp"
 #include "Color.hpp"
+#include "Sampler.hpp"
 
 struct ScatteredRay {
   Ray ray;
   ColorF3 attenuation;
+  // solid angle pdf the direction was drawn with, 0 for a specular bounce
+  // (or any the light sampling in Camera doesn't weight against)
+  mfloat pdf = 0;
 };
 
+// concrete type of a material, lets the wavefront integrator group hits by
+// material and Scatter() call scatter without virtual dispatch. Materials
+// defined outside this file keep Other and are called through the vtable;
+// the built-in ones are final, so no custom material inherits their tag.
+enum class MaterialType : uint8_t {
+  Lambertian,
+  Metal,
+  Dielectric,
+  DiffuseLight,
+  Other
+};
+constexpr size_t MaterialTypeCount = 5;
+
 struct Material {
   ColorF3 color;
+  MaterialType type = MaterialType::Other;
   Material() {}
   Material(ColorF3 color) : color(color) {}
-  virtual Result<ScatteredRay> scatter(const Ray& ray,
-                                       const HitRecord& hit) const = 0;
+  Material(MaterialType type) : type(type) {}
+  virtual ~Material() = default;
+  virtual Result<ScatteredRay> scatter(const Ray& ray, const HitRecord& hit,
+                                       Sampler& sampler) const = 0;
+
+  // ray leaving the hit point in direction dir
+  static Ray leave(const HitRecord& hit, const float3& dir) {
+    return {OffsetRayOrigin(hit.point, hit.normal, hit.pointError, dir), dir};
+  }
 };
 
-struct Lambertian : public Material {
+struct Lambertian final : public Material {
   ColorF3 albedo;
-  Lambertian(ColorF3 albedo) : albedo(albedo) {}
+  Lambertian(ColorF3 albedo)
+      : Material(MaterialType::Lambertian), albedo(albedo) {}
 
-  Result<ScatteredRay> scatter(const Ray& ray,
-                               const HitRecord& hit) const override {
-    auto scatterDir = hit.normal + RandomInUnitSphere();
-    if (scatterDir.pow() < 1e-3) scatterDir = hit.normal;
-    Ray scattered = Ray{hit.point, scatterDir.normalize()};
-    return ScatteredRay{scattered, albedo};
+  // cosine-weighted, the cosine and 1 / pi of the BRDF cancel with the pdf
+  Result<ScatteredRay> scatter(const Ray& ray, const HitRecord& hit,
+                               Sampler& sampler) const override {
+    float3 normal = FacingNormal(hit);
+    auto scatterDir = normal + SampleUnitSphere(sampler.next2D());
+    if (scatterDir.pow() < 1e-3) scatterDir = normal;
+    float3 dir = scatterDir.normalize();
+    return ScatteredRay{leave(hit, dir), albedo, pdf(normal, dir)};
+  }
+
+  // the side of the surface the ray came from, diffuse light scatters back
+  // into it
+  static float3 FacingNormal(const HitRecord& hit) {
+    return hit.frontFace ? hit.normal : hit.normal * -1;
+  }
+
+  static mfloat pdf(const float3& normal, const float3& dir) {
+    return std::max(normal.dot(dir), mfloat(0)) / PI;
   }
 };
 
-struct Metal : public Material {
+struct Metal final : public Material {
   ColorF3 albedo;
   mfloat fuzz;
   Metal(ColorF3 albedo, mfloat fuzz)
-      : albedo(albedo), fuzz(std::min(fuzz, mfloat(1))) {}
+      : Material(MaterialType::Metal),
+        albedo(albedo),
+        fuzz(std::min(fuzz, mfloat(1))) {}
 
-  Result<ScatteredRay> scatter(const Ray& ray,
-                               const HitRecord& hit) const override {
+  Result<ScatteredRay> scatter(const Ray& ray, const HitRecord& hit,
+                               Sampler& sampler) const override {
     auto reflected = ReflectedVector(ray.direction, hit.normal);
-    reflected += RandomInUnitSphere() * fuzz;
-    if (reflected.dot(hit.normal) <= 0) return {};  // absorb the ray
-    Ray scattered = Ray{hit.point, reflected.normalize()};
+    float2 u = sampler.next2D();
+    reflected += SampleUnitBall(u, sampler.nextFloat()) * fuzz;
+    RT_COUNT(MetalScatters, 1);
+    if (reflected.dot(hit.normal) <= 0) {  // absorb the ray
+      RT_COUNT(MetalAbsorbed, 1);
+      return {};
+    }
+    Ray scattered = leave(hit, reflected.normalize());
     return ScatteredRay{scattered, albedo};
   }
 };
 
 // 电介质
-struct Dielectric : public Material {
+struct Dielectric final : public Material {
   mfloat refractiveIndex;
-  Dielectric(mfloat refractiveIndex) : refractiveIndex(refractiveIndex) {}
+  Dielectric(mfloat refractiveIndex)
+      : Material(MaterialType::Dielectric), refractiveIndex(refractiveIndex) {}
 
-  Result<ScatteredRay> scatter(const Ray& ray,
-                               const HitRecord& hit) const override {
+  Result<ScatteredRay> scatter(const Ray& ray, const HitRecord& hit,
+                               Sampler& sampler) const override {
     // relative refractive index
     auto rri = hit.frontFace ? (1 / refractiveIndex) : refractiveIndex;
     auto rayIn = ray.direction;
@@ -65,11 +112,11 @@ struct Dielectric : public Material {
     mfloat sinTheta = sqrt(1 - cosTheta * cosTheta);
     bool cannotRefract = rri * sinTheta > 1;
     float3 direction;
-    if (cannotRefract || reflectance(cosTheta, rri) > RandFloat())
+    if (cannotRefract || reflectance(cosTheta, rri) > sampler.nextFloat())
       direction = ReflectedVector(rayIn, normal);
     else
       direction = RefractedVector(rayIn, normal, rri);
-    Ray scattered = Ray{hit.point, normalize(direction)};
+    Ray scattered = leave(hit, normalize(direction));
     return ScatteredRay{scattered, ColorF3(1, 1, 1)};
   }
 
@@ -80,3 +127,43 @@ struct Dielectric : public Material {
     return r0 + (1 - r0) * pow((1 - cos), 5);
   }
 };
+
+// Emits `emission` from its front face (the outside of a sphere, the
+// counter-clockwise side of a triangle) and absorbs every ray. Camera
+// samples these as lights, see Lights.hpp.
+struct DiffuseLight final : public Material {
+  ColorF3 emission;
+  DiffuseLight(ColorF3 emission)
+      : Material(MaterialType::DiffuseLight), emission(emission) {}
+
+  Result<ScatteredRay> scatter(const Ray&, const HitRecord&,
+                               Sampler&) const override {
+    return {};
+  }
+
+  ColorF3 emitted(const HitRecord& hit) const {
+    return hit.frontFace ? emission : ColorF3(0, 0, 0);
+  }
+};
+
+// Material::scatter with the built-in types dispatched by a switch on the
+// tag: their scatter is called directly and can be inlined into the path
+// loop, only custom materials (type Other) take the virtual call.
+inline Result<ScatteredRay> Scatter(const Material& material, const Ray& ray,
+                                    const HitRecord& hit, Sampler& sampler) {
+  switch (material.type) {
+    case MaterialType::Lambertian:
+      return static_cast<const Lambertian&>(material).Lambertian::scatter(
+          ray, hit, sampler);
+    case MaterialType::Metal:
+      return static_cast<const Metal&>(material).Metal::scatter(ray, hit,
+                                                                sampler);
+    case MaterialType::Dielectric:
+      return static_cast<const Dielectric&>(material).Dielectric::scatter(
+          ray, hit, sampler);
+    case MaterialType::DiffuseLight:
+      return {};
+    default:
+      return material.scatter(ray, hit, sampler);
+  }
+}
@@ -0,0 +1,594 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "include/MappedFile.hpp"
+#include "include/Vector.hpp"
+
+// Triangle mesh loaders for Wavefront OBJ and PLY (ASCII and binary).
+//
+// The file is mapped, never copied, and read in chunks of chunkBytes in
+// parallel: a first pass counts the vertices and triangles of every chunk,
+// the prefix sums give each chunk its place in the output, a second pass
+// parses straight into the final arrays. Peak memory is the output plus
+// the chunks in flight, the pages of a parsed chunk are dropped again.
+// Polygons are split into triangle fans. Errors throw std::runtime_error.
+
+struct MeshData {
+  std::vector<float3> positions;
+  std::vector<uint32_t> indices;  // 3 per triangle
+};
+
+namespace mesh_loader {
+
+constexpr size_t chunkBytes = 8 << 20;
+
+// [begin, end) of a chunk of lines
+struct Chunk {
+  size_t begin, end;
+};
+
+// split [begin, end) of text into chunks of about chunkBytes ending at line
+// ends
+inline std::vector<Chunk> SplitLines(const char *text, size_t begin,
+                                     size_t end) {
+  std::vector<Chunk> chunks;
+  while (begin < end) {
+    size_t stop = std::min(begin + chunkBytes, end);
+    auto newline = static_cast<const char *>(
+        std::memchr(text + stop, '\n', end - stop));
+    stop = newline ? newline - text + 1 : end;
+    chunks.push_back({begin, stop});
+    begin = stop;
+  }
+  return chunks;
+}
+
+inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// cursor over one line
+struct LineReader {
+  const char *pos, *end;
+
+  void skipSpace() {
+    while (pos < end && IsSpace(*pos)) pos++;
+  }
+  bool atEnd() {
+    skipSpace();
+    return pos >= end;
+  }
+  std::string_view word() {
+    skipSpace();
+    const char *start = pos;
+    while (pos < end && !IsSpace(*pos)) pos++;
+    return {start, size_t(pos - start)};
+  }
+  template <typename T>
+  bool number(T &value) {
+    skipSpace();
+    if (pos < end && *pos == '+') pos++;
+    auto [next, error] = std::from_chars(pos, end, value);
+    if (error != std::errc()) return false;
+    pos = next;
+    return true;
+  }
+};
+
+// call func(LineReader) for every line of the chunk, returns false as soon
+// as func does
+template <typename Func>
+bool ForEachLine(const char *text, const Chunk &chunk, Func &&func) {
+  const char *pos = text + chunk.begin, *end = text + chunk.end;
+  while (pos < end) {
+    auto newline = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+    const char *lineEnd = newline ? newline : end;
+    if (!func(LineReader{pos, lineEnd})) return false;
+    pos = lineEnd + 1;
+  }
+  return true;
+}
+
+// first error of a parallel pass, rethrown once the pass is over
+struct ErrorSlot {
+  std::atomic<bool> failed{false};
+  std::string message;
+
+  void set(const std::string &what) {
+    bool expected = false;
+    if (failed.compare_exchange_strong(expected, true)) message = what;
+  }
+  void check(const std::string &path) const {
+    if (failed) throw std::runtime_error(path + ": " + message);
+  }
+};
+
+// call func(i, element) for the count fixed-size elements at offset of a
+// binary file, in parallel blocks of about chunkBytes
+template <typename Func>
+void ForEachBlock(MappedFile &file, size_t offset, size_t count, size_t stride,
+                  Func &&func) {
+  auto text = static_cast<const char *>(file.data);
+  size_t perBlock = std::max<size_t>(chunkBytes / std::max<size_t>(stride, 1),
+                                     1);
+  long long blockCount = (count + perBlock - 1) / perBlock;
+#pragma omp parallel for schedule(dynamic)
+  for (long long b = 0; b < blockCount; b++) {
+    size_t begin = b * perBlock, end = std::min(begin + perBlock, count);
+    for (size_t i = begin; i < end; i++) func(i, text + offset + i * stride);
+    file.release(offset + begin * stride, (end - begin) * stride);
+  }
+}
+
+inline void CheckIndices(const MeshData &mesh, const std::string &path) {
+  size_t count = mesh.positions.size();
+  std::atomic<bool> bad{false};
+#pragma omp parallel for
+  for (long long i = 0; i < (long long)mesh.indices.size(); i++)
+    if (mesh.indices[i] >= count) bad = true;
+  if (bad) throw std::runtime_error(path + ": vertex index out of range");
+}
+
+#pragma region OBJ
+inline MeshData LoadOBJ(const std::string &path) {
+  MappedFile file;
+  if (!file.open(path)) throw std::runtime_error("cannot open " + path);
+  auto text = static_cast<const char *>(file.data);
+  auto chunks = SplitLines(text, 0, file.size);
+  long long chunkCount = chunks.size();
+
+  // pass 1: vertices and triangles per chunk
+  std::vector<size_t> vertexBase(chunks.size() + 1, 0),
+      triangleBase(chunks.size() + 1, 0);
+#pragma omp parallel for schedule(dynamic)
+  for (long long c = 0; c < chunkCount; c++) {
+    size_t vertices = 0, triangles = 0;
+    ForEachLine(text, chunks[c], [&](LineReader line) {
+      std::string_view tag = line.word();
+      if (tag == "v") {
+        vertices++;
+      } else if (tag == "f") {
+        size_t corners = 0;
+        while (!line.word().empty()) corners++;
+        if (corners >= 3) triangles += corners - 2;
+      }
+      return true;
+    });
+    vertexBase[c + 1] = vertices;
+    triangleBase[c + 1] = triangles;
+    file.release(chunks[c].begin, chunks[c].end - chunks[c].begin);
+  }
+  for (size_t c = 0; c < chunks.size(); c++) {
+    vertexBase[c + 1] += vertexBase[c];
+    triangleBase[c + 1] += triangleBase[c];
+  }
+
+  MeshData mesh;
+  mesh.positions.resize(vertexBase.back());
+  mesh.indices.resize(triangleBase.back() * 3);
+
+  // pass 2: parse into place
+  ErrorSlot error;
+#pragma omp parallel for schedule(dynamic)
+  for (long long c = 0; c < chunkCount; c++) {
+    size_t vertex = vertexBase[c], index = triangleBase[c] * 3;
+    ForEachLine(text, chunks[c], [&](LineReader line) {
+      std::string_view tag = line.word();
+      if (tag == "v") {
+        float3 &p = mesh.positions[vertex++];
+        if (!line.number(p.val[0]) || !line.number(p.val[1]) ||
+            !line.number(p.val[2])) {
+          error.set("bad vertex");
+          return false;
+        }
+      } else if (tag == "f") {
+        // v, v/vt, v//vn or v/vt/vn, negative indices count back from the
+        // last vertex read
+        uint32_t first = 0, previous = 0;
+        for (int corner = 0; !line.atEnd(); corner++) {
+          long long i;
+          if (!line.number(i) || i == 0) {
+            error.set("bad face");
+            return false;
+          }
+          while (line.pos < line.end && !IsSpace(*line.pos)) line.pos++;
+          uint32_t current = uint32_t(i > 0 ? i - 1 : (long long)vertex + i);
+          if (corner == 0) {
+            first = current;
+          } else if (corner >= 2) {
+            mesh.indices[index++] = first;
+            mesh.indices[index++] = previous;
+            mesh.indices[index++] = current;
+          }
+          previous = current;
+        }
+      }
+      return true;
+    });
+    file.release(chunks[c].begin, chunks[c].end - chunks[c].begin);
+  }
+  error.check(path);
+  CheckIndices(mesh, path);
+  return mesh;
+}
+#pragma endregion
+
+#pragma region PLY
+enum class PlyType {
+  Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64
+};
+
+inline bool ParsePlyType(std::string_view name, PlyType &type) {
+  if (name == "char" || name == "int8") type = PlyType::Int8;
+  else if (name == "uchar" || name == "uint8") type = PlyType::UInt8;
+  else if (name == "short" || name == "int16") type = PlyType::Int16;
+  else if (name == "ushort" || name == "uint16") type = PlyType::UInt16;
+  else if (name == "int" || name == "int32") type = PlyType::Int32;
+  else if (name == "uint" || name == "uint32") type = PlyType::UInt32;
+  else if (name == "float" || name == "float32") type = PlyType::Float32;
+  else if (name == "double" || name == "float64") type = PlyType::Float64;
+  else return false;
+  return true;
+}
+
+inline size_t PlySize(PlyType type) {
+  constexpr size_t sizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+  return sizes[int(type)];
+}
+
+template <typename T>
+T ReadRaw(const char *p, bool swap) {
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, p, sizeof(T));
+  if (swap) std::reverse(bytes, bytes + sizeof(T));
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+inline double ReadPly(const char *p, PlyType type, bool swap) {
+  switch (type) {
+    case PlyType::Int8: return ReadRaw<int8_t>(p, swap);
+    case PlyType::UInt8: return ReadRaw<uint8_t>(p, swap);
+    case PlyType::Int16: return ReadRaw<int16_t>(p, swap);
+    case PlyType::UInt16: return ReadRaw<uint16_t>(p, swap);
+    case PlyType::Int32: return ReadRaw<int32_t>(p, swap);
+    case PlyType::UInt32: return ReadRaw<uint32_t>(p, swap);
+    case PlyType::Float32: return ReadRaw<float>(p, swap);
+    default: return ReadRaw<double>(p, swap);
+  }
+}
+
+struct PlyProperty {
+  std::string name;
+  PlyType type;
+  bool isList = false;
+  PlyType countType;  // lists only
+};
+
+struct PlyElement {
+  std::string name;
+  size_t count;
+  std::vector<PlyProperty> properties;
+
+  bool hasList() const {
+    for (const auto &p : properties)
+      if (p.isList) return true;
+    return false;
+  }
+  // bytes per binary element, elements with lists have no fixed size
+  size_t stride() const {
+    size_t size = 0;
+    for (const auto &p : properties) size += PlySize(p.type);
+    return size;
+  }
+  int find(std::string_view name) const {
+    for (size_t i = 0; i < properties.size(); i++)
+      if (properties[i].name == name) return int(i);
+    return -1;
+  }
+};
+
+struct PlyHeader {
+  enum class Format { Ascii, BinaryLittle, BinaryBig } format;
+  std::vector<PlyElement> elements;
+  size_t dataOffset;  // first byte after end_header
+};
+
+inline PlyHeader ParsePlyHeader(const char *text, size_t size,
+                                const std::string &path) {
+  auto fail = [&](const std::string &message) {
+    throw std::runtime_error(path + ": " + message);
+  };
+  PlyHeader header;
+  bool formatSeen = false;
+  size_t pos = 0;
+  for (int lineNo = 0;; lineNo++) {
+    auto newline =
+        static_cast<const char *>(std::memchr(text + pos, '\n', size - pos));
+    if (!newline) fail("unterminated header");
+    LineReader line{text + pos, newline};
+    pos = newline - text + 1;
+    std::string_view tag = line.word();
+    if (lineNo == 0) {
+      if (tag != "ply") fail("not a PLY file");
+    } else if (tag == "format") {
+      std::string_view name = line.word();
+      if (name == "ascii") header.format = PlyHeader::Format::Ascii;
+      else if (name == "binary_little_endian")
+        header.format = PlyHeader::Format::BinaryLittle;
+      else if (name == "binary_big_endian")
+        header.format = PlyHeader::Format::BinaryBig;
+      else fail("unknown format " + std::string(name));
+      formatSeen = true;
+    } else if (tag == "element") {
+      PlyElement element;
+      element.name = line.word();
+      if (!line.number(element.count)) fail("bad element count");
+      header.elements.push_back(element);
+    } else if (tag == "property") {
+      if (header.elements.empty()) fail("property outside of an element");
+      PlyProperty property;
+      std::string_view type = line.word();
+      if (type == "list") {
+        property.isList = true;
+        if (!ParsePlyType(line.word(), property.countType))
+          fail("bad list count type");
+        type = line.word();
+      }
+      if (!ParsePlyType(type, property.type))
+        fail("unknown type " + std::string(type));
+      property.name = line.word();
+      header.elements.back().properties.push_back(property);
+    } else if (tag == "end_header") {
+      break;
+    }
+    // comment, obj_info: ignored
+  }
+  if (!formatSeen) fail("missing format");
+  header.dataOffset = pos;
+  return header;
+}
+
+inline MeshData LoadPLY(const std::string &path) {
+  MappedFile file;
+  if (!file.open(path)) throw std::runtime_error("cannot open " + path);
+  auto text = static_cast<const char *>(file.data);
+  PlyHeader header = ParsePlyHeader(text, file.size, path);
+  auto fail = [&](const std::string &message) {
+    throw std::runtime_error(path + ": " + message);
+  };
+
+  const PlyElement *vertices = nullptr, *faces = nullptr;
+  for (const auto &element : header.elements) {
+    if (element.name == "vertex") vertices = &element;
+    else if (element.name == "face") faces = &element;
+  }
+  if (!vertices || !faces) fail("vertex or face element missing");
+  int coord[3] = {vertices->find("x"), vertices->find("y"),
+                  vertices->find("z")};
+  if (coord[0] < 0 || coord[1] < 0 || coord[2] < 0)
+    fail("vertex positions missing");
+  if (vertices->hasList()) fail("lists in vertices are not supported");
+  int list = faces->find("vertex_indices");
+  if (list < 0) list = faces->find("vertex_index");
+  if (list < 0 || !faces->properties[list].isList)
+    fail("face vertex indices missing");
+  const PlyProperty &indexList = faces->properties[list];
+
+  MeshData mesh;
+  mesh.positions.resize(vertices->count);
+  ErrorSlot error;
+
+  if (header.format == PlyHeader::Format::Ascii) {
+    // every element is one line: find the first line of each chunk, then
+    // the triangles in its face lines, then parse
+    auto chunks = SplitLines(text, header.dataOffset, file.size);
+    long long chunkCount = chunks.size();
+    std::vector<size_t> lineBase(chunks.size() + 1, 0),
+        triangleBase(chunks.size() + 1, 0);
+#pragma omp parallel for schedule(dynamic)
+    for (long long c = 0; c < chunkCount; c++)
+      lineBase[c + 1] = std::count(text + chunks[c].begin,
+                                   text + chunks[c].end, '\n');
+    for (size_t c = 0; c < chunks.size(); c++) lineBase[c + 1] += lineBase[c];
+
+    // first line of the vertices and of the faces
+    size_t line = 0, vertexLine = 0, faceLine = 0;
+    for (const auto &element : header.elements) {
+      if (&element == vertices) vertexLine = line;
+      if (&element == faces) faceLine = line;
+      line += element.count;
+    }
+    auto isFace = [&](size_t l) {
+      return l >= faceLine && l < faceLine + faces->count;
+    };
+
+    // reads the index list of a face line, skipping the other properties
+    auto readFace = [&](LineReader &reader, auto &&corner) {
+      for (size_t p = 0; p < faces->properties.size(); p++) {
+        size_t count;
+        if (int(p) != list) {
+          double skipped;
+          if (!reader.number(skipped)) return false;
+          if (!faces->properties[p].isList) continue;
+          count = size_t(skipped);
+          for (size_t k = 0; k < count; k++)
+            if (!reader.number(skipped)) return false;
+          continue;
+        }
+        if (!reader.number(count)) return false;
+        for (size_t k = 0; k < count; k++) {
+          uint32_t index;
+          if (!reader.number(index)) return false;
+          corner(k, index);
+        }
+      }
+      return true;
+    };
+
+#pragma omp parallel for schedule(dynamic)
+    for (long long c = 0; c < chunkCount; c++) {
+      size_t l = lineBase[c], triangles = 0;
+      ForEachLine(text, chunks[c], [&](LineReader reader) {
+        if (isFace(l++)) {
+          bool ok = readFace(reader, [&](size_t k, uint32_t) {
+            if (k >= 2) triangles++;
+          });
+          if (!ok) {
+            error.set("bad face");
+            return false;
+          }
+        }
+        return true;
+      });
+      triangleBase[c + 1] = triangles;
+      file.release(chunks[c].begin, chunks[c].end - chunks[c].begin);
+    }
+    error.check(path);
+    for (size_t c = 0; c < chunks.size(); c++)
+      triangleBase[c + 1] += triangleBase[c];
+    mesh.indices.resize(triangleBase.back() * 3);
+
+#pragma omp parallel for schedule(dynamic)
+    for (long long c = 0; c < chunkCount; c++) {
+      size_t l = lineBase[c], index = triangleBase[c] * 3;
+      ForEachLine(text, chunks[c], [&](LineReader reader) {
+        size_t current = l++;
+        if (current >= vertexLine && current < vertexLine + vertices->count) {
+          float3 &p = mesh.positions[current - vertexLine];
+          for (size_t k = 0; k < vertices->properties.size(); k++) {
+            mfloat value;
+            if (!reader.number(value)) {
+              error.set("bad vertex");
+              return false;
+            }
+            for (int axis = 0; axis < 3; axis++)
+              if (coord[axis] == int(k)) p.val[axis] = value;
+          }
+        } else if (isFace(current)) {
+          uint32_t first = 0, previous = 0;
+          readFace(reader, [&](size_t k, uint32_t i) {
+            if (k == 0) {
+              first = i;
+            } else if (k >= 2) {
+              mesh.indices[index++] = first;
+              mesh.indices[index++] = previous;
+              mesh.indices[index++] = i;
+            }
+            previous = i;
+          });
+        }
+        return true;
+      });
+      file.release(chunks[c].begin, chunks[c].end - chunks[c].begin);
+    }
+    error.check(path);
+    CheckIndices(mesh, path);
+    return mesh;
+  }
+
+  // binary: elements before the faces must have a fixed size
+  bool swap = (header.format == PlyHeader::Format::BinaryBig) !=
+              (std::endian::native == std::endian::big);
+  size_t offset = header.dataOffset, vertexOffset = 0;
+  for (const auto &element : header.elements) {
+    if (&element == faces) break;
+    if (element.hasList())
+      fail("list elements before the faces are not supported");
+    if (&element == vertices) vertexOffset = offset;
+    offset += element.count * element.stride();
+  }
+  size_t faceOffset = offset;
+  if (vertexOffset + vertices->count * vertices->stride() > file.size)
+    fail("file too short");
+
+  size_t vertexStride = vertices->stride(), coordOffset[3];
+  for (int axis = 0; axis < 3; axis++) {
+    coordOffset[axis] = 0;
+    for (int k = 0; k < coord[axis]; k++)
+      coordOffset[axis] += PlySize(vertices->properties[k].type);
+  }
+  ForEachBlock(file, vertexOffset, vertices->count, vertexStride,
+               [&](size_t i, const char *p) {
+                 for (int axis = 0; axis < 3; axis++)
+                   mesh.positions[i].val[axis] = mfloat(
+                       ReadPly(p + coordOffset[axis],
+                               vertices->properties[coord[axis]].type, swap));
+               });
+
+  // faces: if every face is a triangle they have a fixed size and are read
+  // in parallel, otherwise one after another
+  size_t before = 0, after = 0;
+  for (size_t p = 0; p < faces->properties.size(); p++) {
+    if (int(p) == list) continue;
+    if (faces->properties[p].isList) fail("more than one list in faces");
+    (int(p) < list ? before : after) += PlySize(faces->properties[p].type);
+  }
+  size_t countSize = PlySize(indexList.countType),
+         indexSize = PlySize(indexList.type);
+  size_t triangleStride = before + countSize + 3 * indexSize + after;
+  size_t faceCount = faces->count;
+
+  std::atomic<bool> allTriangles =
+      faceOffset + faceCount * triangleStride <= file.size;
+  if (allTriangles) {
+    mesh.indices.resize(faceCount * 3);
+    ForEachBlock(file, faceOffset, faceCount, triangleStride,
+                 [&](size_t f, const char *p) {
+                   p += before;
+                   if (ReadPly(p, indexList.countType, swap) != 3) {
+                     allTriangles = false;
+                     return;
+                   }
+                   for (int k = 0; k < 3; k++)
+                     mesh.indices[f * 3 + k] = uint32_t(ReadPly(
+                         p + countSize + k * indexSize, indexList.type, swap));
+                 });
+  }
+  if (!allTriangles) {
+    mesh.indices.clear();
+    const char *p = text + faceOffset, *end = text + file.size;
+    for (size_t f = 0; f < faceCount; f++) {
+      if (p + before + countSize > end) fail("file too short");
+      p += before;
+      size_t count = size_t(ReadPly(p, indexList.countType, swap));
+      p += countSize;
+      if (p + count * indexSize + after > end) fail("file too short");
+      auto index = [&](size_t k) {
+        return uint32_t(ReadPly(p + k * indexSize, indexList.type, swap));
+      };
+      for (size_t k = 2; k < count; k++) {
+        mesh.indices.push_back(index(0));
+        mesh.indices.push_back(index(k - 1));
+        mesh.indices.push_back(index(k));
+      }
+      p += count * indexSize + after;
+    }
+  }
+  CheckIndices(mesh, path);
+  return mesh;
+}
+#pragma endregion
+
+}  // namespace mesh_loader
+
+// load an .obj or .ply file
+inline MeshData LoadMesh(const std::string &path) {
+  std::string ext = std::filesystem::path(path).extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  if (ext == ".obj") return mesh_loader::LoadOBJ(path);
+  if (ext == ".ply") return mesh_loader::LoadPLY(path);
+  throw std::runtime_error("unknown mesh format " + path);
+}
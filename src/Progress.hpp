@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "include/Utils.hpp"
+
+// Progress of one render. The workers only bump atomic counters: the tile
+// count here, paths and rays in the camera's PathStats. One reporter thread
+// wakes every `interval` seconds and prints a line with the samples done,
+// the Mrays/s since its last report and an ETA, and, if statusPath is set,
+// rewrites a small JSON status file a job scheduler can poll. Nothing in
+// the workers waits for it or for the terminal. tilesTotal is 0 when the
+// number of passes isn't known (adaptive sampling), the tiles are then
+// left out of the log line.
+struct ProgressReporter {
+  ProgressReporter(uint64_t &paths, uint64_t &rays, uint64_t tilesTotal,
+                   uint64_t samplesTotal, bool printLog,
+                   std::string statusPath, double interval = 1)
+      : paths(paths),
+        rays(rays),
+        tilesTotal(tilesTotal),
+        samplesTotal(samplesTotal),
+        printLog(printLog),
+        statusPath(std::move(statusPath)),
+        // not below minInterval (also for NaN), a zero wait would spin
+        interval(interval > minInterval ? interval : minInterval),
+        start(Clock::now()) {
+    if (printLog || !this->statusPath.empty())
+      reporter = std::thread([this] { run(); });
+  }
+  ProgressReporter(const ProgressReporter &) = delete;
+  ProgressReporter &operator=(const ProgressReporter &) = delete;
+  ~ProgressReporter() { finish(); }
+
+  // called by a worker after each tile
+  void tileDone() { tiles.fetch_add(1, std::memory_order_relaxed); }
+
+  // stops the reporter, the status file says "done" afterwards
+  void finish() {
+    if (!reporter.joinable()) return;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_one();
+    reporter.join();
+    report(true);
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  // the camera's counters, only read here
+  uint64_t &paths, &rays;
+  std::atomic<uint64_t> tiles{0};
+  uint64_t tilesTotal, samplesTotal;
+  bool printLog;
+  std::string statusPath;
+  static constexpr double minInterval = 0.05;  // seconds
+  double interval;
+
+  Clock::time_point start;
+  // at the last report, for the current rate
+  double lastSeconds = 0;
+  uint64_t lastRays = 0;
+
+  std::thread reporter;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wake.wait_for(lock, std::chrono::duration<double>(interval),
+                          [this] { return stopping; }))
+      report(false);
+  }
+
+  static uint64_t Load(uint64_t &value) {
+    return std::atomic_ref<uint64_t>(value).load(std::memory_order_relaxed);
+  }
+
+  void report(bool done) {
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    uint64_t samples = Load(paths), raysNow = Load(rays);
+    uint64_t tilesNow = tiles.load(std::memory_order_relaxed);
+    // an adaptive render may finish before all of samplesTotal
+    double fraction = done || !samplesTotal
+                          ? 1
+                          : std::min(1.0, double(samples) / samplesTotal);
+    // the rate since the last report, the average once done
+    double since = done ? 0 : lastSeconds;
+    uint64_t raysSince = raysNow - (done ? 0 : lastRays);
+    double mrays = seconds > since ? raysSince / (seconds - since) / 1e6 : 0;
+    // unknown until some samples are done
+    double eta = done ? 0 : fraction > 0 ? seconds * (1 / fraction - 1) : -1;
+    lastSeconds = seconds;
+    lastRays = raysNow;
+
+    if (printLog && !done && tilesTotal)
+      print("progress:", fraction * 100, "%, tiles", tilesNow, "/",
+            tilesTotal, ", samples", samples, "/", samplesTotal, ",", mrays,
+            "Mrays/s, ETA", eta, "s");
+    else if (printLog && !done)
+      print("progress:", fraction * 100, "%, samples", samples, "/",
+            samplesTotal, ",", mrays, "Mrays/s, ETA", eta, "s");
+    if (!statusPath.empty())
+      writeStatus(done, fraction, tilesNow, samples, raysNow, seconds, mrays,
+                  eta);
+  }
+
+  // written to a temporary file and renamed, a reader never sees half of it
+  void writeStatus(bool done, double fraction, uint64_t tilesNow,
+                   uint64_t samples, uint64_t raysNow, double seconds,
+                   double mrays, double eta) const {
+    std::string tempPath = statusPath + ".tmp";
+    FILE *file = std::fopen(tempPath.c_str(), "w");
+    if (!file) return;
+    std::fprintf(file,
+                 "{\"state\": \"%s\", \"progress\": %.6f, \"tiles\": %llu, "
+                 "\"tilesTotal\": %llu, \"samples\": %llu, "
+                 "\"samplesTotal\": %llu, \"rays\": %llu, "
+                 "\"elapsedSeconds\": %.3f, \"etaSeconds\": %.3f, "
+                 "\"mraysPerSecond\": %.3f}\n",
+                 done ? "done" : "rendering", fraction,
+                 (unsigned long long)tilesNow, (unsigned long long)tilesTotal,
+                 (unsigned long long)samples, (unsigned long long)samplesTotal,
+                 (unsigned long long)raysNow, seconds, eta, mrays);
+    if (std::fclose(file) != 0) return;
+    std::error_code error;
+    std::filesystem::rename(tempPath, statusPath, error);
+  }
+};
@@ -1,10 +1,35 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
+
 #include "include/Vector.hpp"
 
-struct Ray {
-  float3 origin, direction;
+template <typename T>
+struct RayT {
+  Vector<T, 3> origin, direction;
+
+  Vector<T, 3> at(T t) const { return origin + direction * t; }
+  Vector<T, 3> operator()(T t) const { return at(t); }
+};
+
+using Ray = RayT<mfloat>;
+
+// relative rounding error allowed for a hit point, on top of the error
+// bound its primitive reports
+template <typename T>
+constexpr T RayOffsetEpsilon = 64 * std::numeric_limits<T>::epsilon();
 
-  float3 at(mfloat t) const { return origin + direction * t; }
-  float3 operator()(mfloat t) const { return at(t); }
-};
\ No newline at end of file
+// Origin of a ray leaving a surface at point in direction dir. The point is
+// pushed along the normal to the side dir goes to, further than the rounding
+// error of point (pointError), so the new ray can't hit the surface it
+// starts on again. Replaces a fixed minimum ray distance, which is too small
+// for float far from the origin and needlessly large for double.
+template <typename T>
+Vector<T, 3> OffsetRayOrigin(const Vector<T, 3> &point,
+                             const Vector<T, 3> &normal, T pointError,
+                             const Vector<T, 3> &dir) {
+  T scale = std::max(maxAbs(point), T(1));
+  Vector<T, 3> offset = normal * (pointError + RayOffsetEpsilon<T> * scale);
+  return normal.dot(dir) > 0 ? point + offset : point - offset;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+#include "include/Vector.hpp"
+#include "include/Random.hpp"
+#include "BlueNoise.hpp"
+
+// where the random numbers of a camera sample come from
+//  independent: the pixel's RNG, every number independent of the others
+//  sobol: Owen-scrambled Sobol points, each dimension of every pixel
+//    scrambled and shuffled on its own; the samples of a pixel stratify
+//    every 1D and 2D dimension, for any sample count
+//  bluenoise: the same Sobol points in every pixel, each pixel shifted by a
+//    blue-noise mask, so the error left is blue noise over the image
+//    instead of white noise; best at low sample counts
+enum class SamplerType : uint8_t { Independent, Sobol, BlueNoise };
+
+inline bool ParseSamplerType(const std::string &name, SamplerType &type) {
+  if (name == "independent") type = SamplerType::Independent;
+  else if (name == "sobol") type = SamplerType::Sobol;
+  else if (name == "bluenoise") type = SamplerType::BlueNoise;
+  else return false;
+  return true;
+}
+
+// The random numbers of one camera sample. Each draw is its own dimension,
+// identified by the path vertex it belongs to and its order at that vertex:
+// the camera draws the pixel position and the lens position at vertex 0,
+// startVertex(depth) moves on to the hit at depth. The same draw of every
+// sample of a pixel (e.g. the scatter direction at the second hit) then
+// takes consecutive points of one sequence, whatever the path did before.
+// Sobol dimensions are padded from 2D Sobol points like in Burley,
+// "Practical Hash-based Owen Scrambling" (JCGT 2020): every dimension gets
+// its own hash-based Owen scramble and shuffle of the sample index.
+struct Sampler {
+  SamplerType type = SamplerType::Independent;
+
+  Sampler() {}
+  // independent numbers from rng, for tools and benchmarks
+  explicit Sampler(RNG &rng) : rng(&rng) {}
+
+  // sample `index` of pixel (x, y); rng is the pixel's, used by
+  // Independent. Renders with the same seed draw the same numbers.
+  Sampler(SamplerType type, RNG &rng, uint64_t seed, uint32_t x, uint32_t y,
+          uint32_t index)
+      : type(type), rng(&rng), index(index), x(x), y(y) {
+    // blue noise: the same sequence in every pixel, the mask decorrelates
+    uint64_t pixel = type == SamplerType::BlueNoise
+                         ? 0
+                         : (uint64_t(x) << 32 | y) + 1;
+    seedHash = MixBits(seed ^ MixBits(pixel));
+  }
+
+  // the draws from here on belong to the hit at depth (0: the camera ray's)
+  void startVertex(int depth) {
+    vertex = depth + 1;
+    draw = 0;
+  }
+
+  // in [0, 1)
+  mfloat nextFloat() {
+    if (type == SamplerType::Independent) return rng->nextFloat();
+    uint64_t hash = dimensionHash();
+    uint32_t i = OwenScramble(index, uint32_t(hash));
+    uint32_t u = OwenScramble(ReverseBits(i), uint32_t(hash >> 32));
+    if (type == SamplerType::BlueNoise) u += maskShift(hash);
+    return ToFloat(u);
+  }
+
+  // in [min, max)
+  mfloat nextFloat(mfloat min, mfloat max) {
+    return min + (max - min) * nextFloat();
+  }
+
+  // one 2D dimension, in [0, 1)^2
+  float2 next2D() {
+    if (type == SamplerType::Independent) {
+      mfloat u0 = rng->nextFloat();
+      return float2(u0, rng->nextFloat());
+    }
+    uint64_t hash = dimensionHash();
+    uint32_t i = OwenScramble(index, uint32_t(hash));
+    uint64_t second = MixBits(hash);
+    uint32_t u0 = OwenScramble(ReverseBits(i), uint32_t(hash >> 32));
+    uint32_t u1 = OwenScramble(Sobol1(i), uint32_t(second));
+    if (type == SamplerType::BlueNoise) {
+      u0 += maskShift(hash);
+      u1 += maskShift(second);
+    }
+    return float2(ToFloat(u0), ToFloat(u1));
+  }
+
+  // the second dimension of the Sobol sequence, the first one is
+  // ReverseBits(index)
+  static uint32_t Sobol1(uint32_t index) {
+    uint32_t res = 0;
+    for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+      if (index & 1) res ^= v;
+    return res;
+  }
+
+  static uint32_t ReverseBits(uint32_t v) {
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+    return (v >> 16) | (v << 16);
+  }
+
+  // Owen scrambling of the bits of v, most significant first: each bit is
+  // flipped depending on the seed and the bits above it. Laine-Karras style
+  // hash with the constants of Vegdahl's improved version, applied to the
+  // reversed bits where every step only carries into higher bits.
+  static uint32_t OwenScramble(uint32_t v, uint32_t seed) {
+    v = ReverseBits(v);
+    v ^= v * 0x3d20adeau;
+    v += seed;
+    v *= (seed >> 16) | 1;
+    v ^= v * 0x05526c56u;
+    v ^= v * 0x53a22864u;
+    return ReverseBits(v);
+  }
+
+ private:
+  RNG *rng = nullptr;
+  uint64_t seedHash = 0;
+  uint32_t index = 0, x = 0, y = 0;
+  uint32_t vertex = 0, draw = 0;
+
+  // of the next draw, different for every (vertex, draw) pair
+  uint64_t dimensionHash() {
+    return MixBits(seedHash ^ (uint64_t(vertex) << 32 | draw++));
+  }
+
+  // Cranley-Patterson shift of a dimension by the pixel's blue-noise rank,
+  // the mask is offset differently for every dimension
+  uint32_t maskShift(uint64_t hash) const {
+    uint32_t rank = BlueNoise::rank(x + uint32_t(hash >> 8),
+                                    y + uint32_t(hash >> 40));
+    return uint32_t((uint64_t(rank) << 32) / BlueNoise::count) +
+           (1u << 31) / BlueNoise::count;
+  }
+
+  static mfloat ToFloat(uint32_t u) {
+    constexpr mfloat oneMinusEpsilon =
+        1 - std::numeric_limits<mfloat>::epsilon() / 2;
+    return std::min(mfloat(u * 0x1p-32), oneMinusEpsilon);
+  }
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include "include/Arena.hpp"
+#include "Hittable.hpp"
+#include "Material.hpp"
+
+// Owns every primitive and material of a scene, packed by type in an Arena.
+// HittableList, BVH and HitRecord only keep plain pointers into it, so
+// rendering never touches a reference count and spheres added one after
+// another sit next to each other in memory.
+struct Scene {
+  Arena arena;
+  std::vector<const Material *> materials;  // in insertion order
+  HittableList world;  // every primitive but the shared ones, in order
+
+  Scene() {}
+  Scene(Scene &&) = default;
+  Scene &operator=(Scene &&) = default;
+
+  template <typename T, typename... Args>
+  const T *addMaterial(Args &&...args) {
+    const T *material = arena.create<T>(std::forward<Args>(args)...);
+    materials.push_back(material);
+    return material;
+  }
+
+  template <typename T, typename... Args>
+  const T *add(Args &&...args) {
+    const T *primitive = addShared<T>(std::forward<Args>(args)...);
+    world.add(primitive);
+    return primitive;
+  }
+
+  // owned like add(), but left out of world: only reachable through the
+  // Instances that reference it
+  template <typename T, typename... Args>
+  const T *addShared(Args &&...args) {
+    primitivesAdded++;
+    return arena.create<T>(std::forward<Args>(args)...);
+  }
+
+  // bulk build: room for `count` more objects of type T in one allocation
+  template <typename T>
+  void reserve(size_t count) {
+    arena.reserve<T>(count);
+  }
+
+  size_t primitiveCount() const { return primitivesAdded; }
+
+  // destroys everything but keeps the arena's memory for the next scene
+  void clear() {
+    world.clear();
+    materials.clear();
+    arena.clear();
+    primitivesAdded = 0;
+  }
+
+ private:
+  size_t primitivesAdded = 0;
+};
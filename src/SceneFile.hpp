@@ -0,0 +1,838 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "include/Json.hpp"
+#include "include/MappedFile.hpp"
+#include "BVH.hpp"
+#include "Camera.hpp"
+#include "Instance.hpp"
+#include "Material.hpp"
+#include "MeshLoader.hpp"
+#include "Scene.hpp"
+#include "Sphere.hpp"
+#include "SphereSet.hpp"
+#include "TriangleMesh.hpp"
+
+// A scene loaded from a JSON file:
+// {
+//   "camera": {"width": 1920, "height": 1080, "vfov": 20,
+//              "origin": [13, 2, 3], "lookAt": [0, 0, 0], "up": [0, 1, 0],
+//              "defocus": {"angle": 2, "focusDist": 10, "imageDist": 0.1}},
+//   "render": {"spp": 4096, "maxDepth": 40, "rouletteMinDepth": 3, "seed": 0,
+//              "sky": true},
+//   "materials": [
+//     {"name": "ground", "type": "lambertian", "albedo": [0.5, 0.5, 0.5]},
+//     {"type": "metal", "albedo": [0.7, 0.6, 0.5], "fuzz": 0},
+//     {"type": "dielectric", "ior": 1.5},
+//     {"type": "light", "emission": [4, 4, 4]}],
+//   "spheres": [
+//     {"center": [0, -1000, 0], "radius": 1000, "material": "ground"},
+//     {"center": [4, 1, 0], "radius": 1, "material": 1}],
+//   "meshes": [{"file": "bunny.ply", "material": 2},
+//              {"file": "tree.obj", "material": 0, "instances": [
+//                {"translate": [1, 0, 2], "rotate": {"axis": [0, 1, 0],
+//                 "angle": 30}, "scale": 0.5, "material": "red"},
+//                {"matrix": [1, 0, 0, 5, 0, 1, 0, 0, 0, 0, 1, 0]}]}]
+// }
+// Spheres and meshes name their material by index or by "name". Mesh files
+// (.obj / .ply, see MeshLoader.hpp) are relative to the scene file. A mesh
+// with "instances" is loaded once and placed by each of them (scale, then
+// rotate, then translate, or a row-major 3x4 "matrix"), an instance may
+// override the material. "sky": false turns the sky off, the scene is then
+// only lit by its lights. Every key is optional.
+//
+// The first load writes <path>.cache next to the file: the materials, the
+// camera, the SphereSet with its BVH and every mesh (vertices, indices in
+// leaf order and BVH nodes) in their in-memory layout, and the instances.
+// Later loads map the cache and the SphereSet and the meshes read the
+// arrays in place, so a big scene is neither parsed nor built again; only
+// the small top-level BVH over the meshes is. The cache is rebuilt when the
+// JSON file or a mesh file changes size or modification time, or the
+// precision differs.
+struct SceneFile {
+  Scene scene;  // the materials and meshes, the spheres live in `spheres`
+  SphereSet spheres;
+  BVH top;  // over spheres and meshes, if there are meshes
+  Camera camera{1920, 1080, 20};
+  bool fromCache = false;
+
+  SceneFile() {}
+  SceneFile(const SceneFile &) = delete;
+  SceneFile &operator=(const SceneFile &) = delete;
+
+  // throws std::runtime_error if the file can't be read or is malformed.
+  // Replaces the scene loaded before, reusing its arena.
+  void load(const std::string &path, bool useCache = true) {
+    clear();
+    std::string cachePath = path + ".cache";
+    Source source = SourceOf(path);
+    std::filesystem::path dir = std::filesystem::path(path).parent_path();
+    if (useCache && loadCache(cachePath, source, dir)) return;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) throw std::runtime_error("cannot open scene " + path);
+    std::stringstream text;
+    text << file.rdbuf();
+    parse(JsonValue::Parse(text.str()), dir);
+    camera.sceneHash = HashSource(camera.sceneHash, source);
+    if (useCache && !saveCache(cachePath, source))
+      print("failed to write scene cache", cachePath);
+  }
+
+  // what to render
+  const Hittable &world() const {
+    if (scene.world.objects.empty()) return spheres;
+    return top;
+  }
+
+  size_t instanceCount() const { return scene.arena.count<Instance>(); }
+
+  // triangles of the loaded meshes, an instanced mesh counts once
+  size_t triangleCount() const {
+    size_t count = 0;
+    scene.arena.forEach<TriangleMesh>(
+        [&](const TriangleMesh &mesh) { count += mesh.triangleCount(); });
+    return count;
+  }
+
+  // heap memory of the loaded scene: the arena, the spheres, the meshes'
+  // buffers and the top-level BVH (a mapped cache is not counted)
+  size_t memoryBytes() const {
+    size_t bytes = scene.arena.stats().bytesReserved + spheres.memoryBytes();
+    scene.arena.forEach<TriangleMesh>(
+        [&](const TriangleMesh &mesh) { bytes += mesh.memoryBytes(); });
+    bytes += top.objects.size() * sizeof(const Hittable *) +
+             top.tree.nodes.size() * sizeof(BVHNode);
+    return bytes;
+  }
+
+  // back to an empty scene, the arena keeps its chunks
+  void clear() {
+    top = BVH();
+    spheres = SphereSet();
+    scene.clear();
+    meshFiles.clear();
+    cache.close();
+    camera = Camera{1920, 1080, 20};
+    fromCache = false;
+  }
+
+  // write scene and camera in the format load() reads, the scene may only
+  // hold spheres
+  static bool WriteJson(const std::string &path, const Scene &scene,
+                        const Camera &camera) {
+    std::ofstream out(path);
+    if (!out) return false;
+    const auto &t = camera.camTrans;
+    out << "{\n  \"camera\": {\"width\": " << camera.width
+        << ", \"height\": " << camera.height
+        << ", \"vfov\": " << Num(camera.VFoV)
+        << ",\n             \"origin\": " << Vec(t.origin)
+        << ", \"lookAt\": " << Vec(t.lookAt) << ", \"up\": " << Vec(t.up);
+    if (camera.ddisk.angle > 0)
+      out << ",\n             \"defocus\": {\"angle\": "
+          << Num(camera.ddisk.angle)
+          << ", \"focusDist\": " << Num(camera.ddisk.foucsDist)
+          << ", \"imageDist\": " << Num(camera.ddisk.imageDist) << "}";
+    out << "},\n  \"render\": {\"spp\": " << camera.samplesPerPixel
+        << ", \"maxDepth\": " << camera.maxDepth
+        << ", \"rouletteMinDepth\": " << camera.rouletteMinDepth
+        << ", \"seed\": " << camera.seed
+        << ", \"sky\": " << (camera.sky ? "true" : "false")
+        << "},\n  \"materials\": [";
+
+    std::unordered_map<const Material *, size_t> materialIndex;
+    for (size_t i = 0; i < scene.materials.size(); i++) {
+      const Material *m = scene.materials[i];
+      materialIndex[m] = i;
+      out << (i ? ",\n" : "\n") << "    {\"type\": ";
+      if (m->type == MaterialType::Lambertian)
+        out << "\"lambertian\", \"albedo\": "
+            << Vec(static_cast<const Lambertian *>(m)->albedo);
+      else if (m->type == MaterialType::Metal)
+        out << "\"metal\", \"albedo\": "
+            << Vec(static_cast<const Metal *>(m)->albedo)
+            << ", \"fuzz\": " << Num(static_cast<const Metal *>(m)->fuzz);
+      else if (m->type == MaterialType::Dielectric)
+        out << "\"dielectric\", \"ior\": "
+            << Num(static_cast<const Dielectric *>(m)->refractiveIndex);
+      else if (m->type == MaterialType::DiffuseLight)
+        out << "\"light\", \"emission\": "
+            << Vec(static_cast<const DiffuseLight *>(m)->emission);
+      else
+        return false;
+      out << "}";
+    }
+    out << "\n  ],\n  \"spheres\": [";
+    for (size_t i = 0; i < scene.world.objects.size(); i++) {
+      auto sphere = dynamic_cast<const Sphere *>(scene.world.objects[i]);
+      if (!sphere) return false;
+      out << (i ? ",\n" : "\n") << "    {\"center\": " << Vec(sphere->center)
+          << ", \"radius\": " << Num(sphere->radius)
+          << ", \"material\": " << materialIndex.at(sphere->material) << "}";
+    }
+    out << "\n  ]\n}\n";
+    return bool(out);
+  }
+
+ private:
+#pragma region JSON
+  // shortest text that reads back as the same number
+  static std::string Num(mfloat x) {
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), x);
+    return std::string(buf, res.ptr);
+  }
+
+  static std::string Vec(const float3 &v) {
+    return "[" + Num(v.val[0]) + ", " + Num(v.val[1]) + ", " + Num(v.val[2]) +
+           "]";
+  }
+
+  static float3 ToFloat3(const JsonValue &value) {
+    auto &items = value.asArray();
+    if (items.size() != 3) throw std::runtime_error("json: 3 numbers expected");
+    return float3(items[0].asNumber(), items[1].asNumber(),
+                  items[2].asNumber());
+  }
+
+  static Transform ToTransform(const JsonValue &value) {
+    if (auto matrix = value.find("matrix")) {
+      auto &items = matrix->asArray();
+      if (items.size() != 12)
+        throw std::runtime_error("json: 12 numbers expected");
+      Affine a;
+      for (int i = 0; i < 12; i++) a.m[i / 4][i % 4] = items[i].asNumber();
+      try {
+        return Transform::FromMatrix(a);
+      } catch (const std::invalid_argument &e) {
+        throw std::runtime_error(e.what());
+      }
+    }
+    Transform res;
+    if (auto scale = value.find("scale")) {
+      float3 s = scale->isArray() ? ToFloat3(*scale)
+                                  : float3(1, 1, 1) * mfloat(scale->asNumber());
+      if (s.val[0] == 0 || s.val[1] == 0 || s.val[2] == 0)
+        throw std::runtime_error("json: zero scale");
+      res = Transform::Scale(s);
+    }
+    if (auto rotate = value.find("rotate"))
+      res = Transform::Rotate(ToFloat3(rotate->at("axis")),
+                              rotate->at("angle").asNumber()) *
+            res;
+    if (auto translate = value.find("translate"))
+      res = Transform::Translate(ToFloat3(*translate)) * res;
+    return res;
+  }
+
+  void parse(const JsonValue &root, const std::filesystem::path &dir) {
+    if (!root.isObject()) throw std::runtime_error("json: object expected");
+    CameraTransform camTrans;
+    DefocusDisk ddisk;
+    int width = camera.width, height = camera.height;
+    mfloat vfov = camera.VFoV;
+    if (auto cam = root.find("camera")) {
+      width = int(cam->get("width", width));
+      height = int(cam->get("height", height));
+      vfov = cam->get("vfov", vfov);
+      if (auto v = cam->find("origin")) camTrans.origin = ToFloat3(*v);
+      if (auto v = cam->find("lookAt")) camTrans.lookAt = ToFloat3(*v);
+      if (auto v = cam->find("up")) camTrans.up = ToFloat3(*v);
+      camTrans.updateVectors();
+      if (auto d = cam->find("defocus"))
+        ddisk = DefocusDisk(d->get("angle", 0), d->get("focusDist", 10),
+                            d->get("imageDist", 0.1), camTrans);
+    }
+    camera = Camera(width, height, vfov, camTrans, ddisk);
+    if (auto render = root.find("render")) {
+      camera.samplesPerPixel = int(render->get("spp", camera.samplesPerPixel));
+      camera.maxDepth = int(render->get("maxDepth", camera.maxDepth));
+      camera.rouletteMinDepth =
+          int(render->get("rouletteMinDepth", camera.rouletteMinDepth));
+      camera.seed = uint64_t(render->get("seed", double(camera.seed)));
+      if (auto sky = render->find("sky")) camera.sky = sky->asBool();
+    }
+
+    std::vector<const Material *> materials;
+    std::unordered_map<std::string, const Material *> named;
+    if (auto list = root.find("materials")) {
+      for (const auto &m : list->asArray()) {
+        const std::string &type = m.at("type").asString();
+        const Material *material;
+        if (type == "lambertian")
+          material = scene.addMaterial<Lambertian>(ToFloat3(m.at("albedo")));
+        else if (type == "metal")
+          material = scene.addMaterial<Metal>(ToFloat3(m.at("albedo")),
+                                              mfloat(m.get("fuzz", 0)));
+        else if (type == "dielectric")
+          material = scene.addMaterial<Dielectric>(mfloat(m.get("ior", 1.5)));
+        else if (type == "light")
+          material =
+              scene.addMaterial<DiffuseLight>(ToFloat3(m.at("emission")));
+        else
+          throw std::runtime_error("unknown material type " + type);
+        materials.push_back(material);
+        if (auto name = m.find("name")) named[name->asString()] = material;
+      }
+    }
+
+    auto materialOf = [&](const JsonValue &object) {
+      const JsonValue &ref = object.at("material");
+      if (ref.type == JsonValue::Type::String) {
+        auto it = named.find(ref.asString());
+        if (it == named.end())
+          throw std::runtime_error("unknown material " + ref.asString());
+        return it->second;
+      }
+      size_t index = size_t(ref.asNumber());
+      if (index >= materials.size())
+        throw std::runtime_error("material index out of range");
+      return materials[index];
+    };
+
+    if (auto list = root.find("spheres"))
+      for (const auto &s : list->asArray())
+        spheres.add(mfloat(s.at("radius").asNumber()),
+                    ToFloat3(s.at("center")), materialOf(s));
+    spheres.build();
+
+    if (auto list = root.find("meshes")) {
+      for (const auto &m : list->asArray()) {
+        const std::string &file = m.at("file").asString();
+        std::string meshPath = (dir / file).string();
+        MeshData data = LoadMesh(meshPath);
+        // the scene's checkpoints and cache are also tied to its mesh files
+        meshFiles.push_back({file, SourceOf(meshPath)});
+        camera.sceneHash =
+            HashSource(camera.sceneHash, meshFiles.back().source);
+        auto instances = m.find("instances");
+        if (!instances) {
+          scene.add<TriangleMesh>(std::move(data.positions),
+                                  std::move(data.indices), materialOf(m));
+          continue;
+        }
+        auto mesh = scene.addShared<TriangleMesh>(
+            std::move(data.positions), std::move(data.indices), materialOf(m));
+        for (const auto &instance : instances->asArray())
+          scene.add<Instance>(
+              mesh, ToTransform(instance),
+              instance.find("material") ? materialOf(instance) : nullptr);
+      }
+    }
+    buildTop();
+  }
+
+  // the top-level BVH over the meshes, instances and spheres
+  void buildTop() {
+    if (scene.world.objects.empty()) return;
+    std::vector<const Hittable *> objects = scene.world.objects;
+    if (spheres.size() > 0) objects.push_back(&spheres);
+    top.build(objects);
+  }
+#pragma endregion
+
+#pragma region Cache
+  // identifies a file a cache was made from
+  struct Source {
+    uint64_t size = 0;
+    int64_t time = 0;
+
+    bool operator==(const Source &) const = default;
+  };
+
+  static Source SourceOf(const std::string &path) {
+    std::error_code error;
+    Source source;
+    source.size = std::filesystem::file_size(path, error);
+    if (error) throw std::runtime_error("cannot open scene " + path);
+    source.time = std::filesystem::last_write_time(path, error)
+                      .time_since_epoch()
+                      .count();
+    return source;
+  }
+
+  // Camera::sceneHash: the scene changed if one of its files did
+  static uint64_t HashSource(uint64_t hash, const Source &source) {
+    return MixBits(MixBits(hash ^ source.size) ^ uint64_t(source.time));
+  }
+
+  // the mesh files of the loaded scene in load order, named as in the JSON
+  struct MeshFile {
+    std::string name;
+    Source source;
+  };
+  std::vector<MeshFile> meshFiles;
+
+  struct CameraRecord {
+    int32_t width, height;
+    mfloat vfov;
+    float3 origin, lookAt, up;
+    mfloat defocusAngle, focusDist, imageDist;
+    int32_t samplesPerPixel, maxDepth, rouletteMinDepth;
+    int32_t sky;
+    uint64_t seed;
+  };
+
+  struct MaterialRecord {
+    MaterialType type;
+    float3 albedo;  // or the emission of a light
+    mfloat fuzz, refractiveIndex;
+  };
+
+  // a TriangleMesh, its arrays are at these file offsets
+  struct MeshRecord {
+    uint64_t vertexCount, indexCount, nodeCount;
+    uint64_t positions, indices, nodes;
+    uint32_t material;
+  };
+
+  // an object of Scene::world, in order: a mesh or an Instance of one
+  struct ObjectRecord {
+    uint32_t mesh;
+    uint32_t instanced;
+    uint32_t material;  // the instance's override, noMaterial if none
+    Transform transform;
+  };
+  static constexpr uint32_t noMaterial = UINT32_MAX;
+
+  // a mesh file, its name is nameSize bytes at nameOffset of the names
+  struct FileRecord {
+    Source source;
+    uint64_t nameOffset, nameSize;
+  };
+
+  // file layout: Header, then materials, the SoA arrays (x, y, z, radius,
+  // material ids), the sphere BVH nodes, the mesh, object and file records,
+  // the file names and the arrays of every mesh (vertices, indices, BVH
+  // nodes), each starting at a multiple of 64 bytes
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t floatSize;   // sizeof(mfloat) of the build that wrote it
+    uint32_t vectorSize;  // sizeof(float3), padded or not
+    Source source;
+    uint64_t materialCount, slotCount, sphereCount, nodeCount;
+    uint64_t meshCount, objectCount, fileCount, namesSize, meshBytes;
+    CameraRecord camera;
+  };
+  static constexpr char cacheMagic[8] = "RTSCENE";
+  static constexpr uint32_t cacheVersion = 3;
+
+  MappedFile cache;
+
+  struct Layout {
+    size_t materials, arrays[4], materialIds, nodes, meshes, objects, files,
+        names, meshData, size;
+  };
+
+  static size_t AlignUp(size_t offset) { return (offset + 63) / 64 * 64; }
+
+  static Layout LayoutOf(const Header &header) {
+    Layout layout;
+    size_t offset = AlignUp(sizeof(Header));
+    layout.materials = offset;
+    offset = AlignUp(offset + header.materialCount * sizeof(MaterialRecord));
+    for (auto &array : layout.arrays) {
+      array = offset;
+      offset = AlignUp(offset + header.slotCount * sizeof(mfloat));
+    }
+    layout.materialIds = offset;
+    offset = AlignUp(offset + header.slotCount * sizeof(uint32_t));
+    layout.nodes = offset;
+    offset = AlignUp(offset + header.nodeCount * sizeof(BVHNode));
+    layout.meshes = offset;
+    offset = AlignUp(offset + header.meshCount * sizeof(MeshRecord));
+    layout.objects = offset;
+    offset = AlignUp(offset + header.objectCount * sizeof(ObjectRecord));
+    layout.files = offset;
+    offset = AlignUp(offset + header.fileCount * sizeof(FileRecord));
+    layout.names = offset;
+    offset = AlignUp(offset + header.namesSize);
+    layout.meshData = offset;
+    layout.size = offset + header.meshBytes;
+    return layout;
+  }
+
+  bool saveCache(const std::string &path, const Source &source) const {
+    Header header{};
+    std::memcpy(header.magic, cacheMagic, sizeof(header.magic));
+    header.version = cacheVersion;
+    header.floatSize = sizeof(mfloat);
+    header.vectorSize = sizeof(float3);
+    header.source = source;
+    const auto &t = camera.camTrans;
+    header.camera = {camera.width,           camera.height,
+                     camera.VFoV,            t.origin,
+                     t.lookAt,               t.up,
+                     camera.ddisk.angle,     camera.ddisk.foucsDist,
+                     camera.ddisk.imageDist, camera.samplesPerPixel,
+                     camera.maxDepth,        camera.rouletteMinDepth,
+                     camera.sky,             camera.seed};
+
+    // every material of the scene, the spheres and meshes refer to them by
+    // index
+    std::vector<MaterialRecord> materials;
+    std::unordered_map<const Material *, uint32_t> materialIndex;
+    for (const Material *m : scene.materials) {
+      MaterialRecord record{m->type, float3(0, 0, 0), 0, 0};
+      if (m->type == MaterialType::Lambertian) {
+        record.albedo = static_cast<const Lambertian *>(m)->albedo;
+      } else if (m->type == MaterialType::Metal) {
+        record.albedo = static_cast<const Metal *>(m)->albedo;
+        record.fuzz = static_cast<const Metal *>(m)->fuzz;
+      } else if (m->type == MaterialType::Dielectric) {
+        record.refractiveIndex =
+            static_cast<const Dielectric *>(m)->refractiveIndex;
+      } else if (m->type == MaterialType::DiffuseLight) {
+        record.albedo = static_cast<const DiffuseLight *>(m)->emission;
+      } else {
+        return false;
+      }
+      materialIndex[m] = materials.size();
+      materials.push_back(record);
+    }
+    auto indexOf = [&](const Material *m) {
+      auto it = materialIndex.find(m);
+      return it == materialIndex.end() ? noMaterial : it->second;
+    };
+    std::vector<uint32_t> sphereIds(spheres.slotCount());
+    for (size_t k = 0; k < sphereIds.size(); k++) {
+      sphereIds[k] = indexOf(spheres.materials[spheres.materialIds[k]]);
+      if (sphereIds[k] == noMaterial) return false;
+    }
+
+    // the world may only hold meshes and instances of meshes
+    std::vector<const TriangleMesh *> meshes;
+    std::unordered_map<const TriangleMesh *, uint32_t> meshIndex;
+    std::vector<ObjectRecord> objects;
+    for (const Hittable *object : scene.world.objects) {
+      auto instance = dynamic_cast<const Instance *>(object);
+      auto mesh = dynamic_cast<const TriangleMesh *>(
+          instance ? instance->object : object);
+      if (!mesh) return false;
+      auto [it, added] = meshIndex.try_emplace(mesh, meshes.size());
+      if (added) meshes.push_back(mesh);
+      ObjectRecord record{it->second, instance != nullptr, noMaterial, {}};
+      if (instance) {
+        record.transform = instance->transform;
+        if (instance->material) {
+          record.material = indexOf(instance->material);
+          if (record.material == noMaterial) return false;
+        }
+      }
+      objects.push_back(record);
+    }
+    std::vector<MeshRecord> meshRecords;
+    size_t meshBytes = 0;
+    for (const TriangleMesh *mesh : meshes) {
+      MeshRecord record{mesh->positions.size(), mesh->indices.size(),
+                        mesh->tree.nodes.size(), 0, 0, 0,
+                        indexOf(mesh->material)};
+      if (record.material == noMaterial) return false;
+      // offsets into the mesh data for now
+      record.positions = meshBytes;
+      meshBytes = AlignUp(meshBytes + record.vertexCount * sizeof(float3));
+      record.indices = meshBytes;
+      meshBytes = AlignUp(meshBytes + record.indexCount * sizeof(uint32_t));
+      record.nodes = meshBytes;
+      meshBytes = AlignUp(meshBytes + record.nodeCount * sizeof(BVHNode));
+      meshRecords.push_back(record);
+    }
+    std::vector<FileRecord> files;
+    std::string names;
+    for (const MeshFile &file : meshFiles) {
+      files.push_back({file.source, names.size(), file.name.size()});
+      names += file.name;
+    }
+
+    header.materialCount = materials.size();
+    header.slotCount = spheres.slotCount();
+    header.sphereCount = spheres.size();
+    header.nodeCount = spheres.tree.nodes.size();
+    header.meshCount = meshRecords.size();
+    header.objectCount = objects.size();
+    header.fileCount = files.size();
+    header.namesSize = names.size();
+    header.meshBytes = meshBytes;
+    Layout layout = LayoutOf(header);
+    for (MeshRecord &record : meshRecords) {
+      record.positions += layout.meshData;
+      record.indices += layout.meshData;
+      record.nodes += layout.meshData;
+    }
+
+    // same temp file + rename as Accumulator::save
+    std::string tempPath = path + ".tmp";
+    {
+      MappedFile file;
+      if (!file.create(tempPath, layout.size)) return false;
+      auto dst = static_cast<char *>(file.data);
+      std::memcpy(dst, &header, sizeof(header));
+      std::memcpy(dst + layout.materials, materials.data(),
+                  materials.size() * sizeof(MaterialRecord));
+      const Buffer<mfloat> *arrays[4] = {&spheres.centerX, &spheres.centerY,
+                                         &spheres.centerZ, &spheres.radius};
+      for (size_t i = 0; i < 4; i++)
+        std::memcpy(dst + layout.arrays[i], arrays[i]->data(),
+                    header.slotCount * sizeof(mfloat));
+      std::memcpy(dst + layout.materialIds, sphereIds.data(),
+                  header.slotCount * sizeof(uint32_t));
+      std::memcpy(dst + layout.nodes, spheres.tree.nodes.data(),
+                  header.nodeCount * sizeof(BVHNode));
+      std::memcpy(dst + layout.meshes, meshRecords.data(),
+                  meshRecords.size() * sizeof(MeshRecord));
+      std::memcpy(dst + layout.objects, objects.data(),
+                  objects.size() * sizeof(ObjectRecord));
+      std::memcpy(dst + layout.files, files.data(),
+                  files.size() * sizeof(FileRecord));
+      std::memcpy(dst + layout.names, names.data(), names.size());
+      for (size_t i = 0; i < meshes.size(); i++) {
+        const MeshRecord &record = meshRecords[i];
+        std::memcpy(dst + record.positions, meshes[i]->positions.data(),
+                    record.vertexCount * sizeof(float3));
+        std::memcpy(dst + record.indices, meshes[i]->indices.data(),
+                    record.indexCount * sizeof(uint32_t));
+        std::memcpy(dst + record.nodes, meshes[i]->tree.nodes.data(),
+                    record.nodeCount * sizeof(BVHNode));
+      }
+      if (!file.flush()) return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    return !error;
+  }
+
+  // walk the tree like BVHTree::traverse: every node reached once, no
+  // deeper than its stack, leafValid(node) for every leaf
+  template <typename LeafValid>
+  static bool TreeValid(const BVHNode *nodes, size_t nodeCount,
+                        LeafValid &&leafValid) {
+    if (nodeCount == 0) return true;
+    std::vector<bool> reached(nodeCount, false);
+    std::vector<std::pair<uint32_t, int>> stack{{0, 1}};
+    while (!stack.empty()) {
+      auto [index, depth] = stack.back();
+      stack.pop_back();
+      if (reached[index] || depth > BVHTree::maxDepth) return false;
+      reached[index] = true;
+      const BVHNode &node = nodes[index];
+      if (node.count > 0) {
+        if (!leafValid(node)) return false;
+        continue;
+      }
+      if (node.axis > 2 || node.offset <= index + 1 ||
+          node.offset >= nodeCount)
+        return false;
+      stack.push_back({index + 1, depth + 1});
+      stack.push_back({node.offset, depth + 1});
+    }
+    return true;
+  }
+
+  // whether the records, indices and BVH nodes of a cache are usable as
+  // they are: a damaged cache must not index out of bounds
+  static bool CacheContentsValid(const Header &header, const Layout &layout,
+                                 const char *src) {
+    auto records =
+        reinterpret_cast<const MaterialRecord *>(src + layout.materials);
+    for (size_t i = 0; i < header.materialCount; i++) {
+      MaterialType type = records[i].type;
+      if (type != MaterialType::Lambertian && type != MaterialType::Metal &&
+          type != MaterialType::Dielectric &&
+          type != MaterialType::DiffuseLight)
+        return false;
+    }
+
+    constexpr size_t width = SphereSet::width;
+    if (header.slotCount % width != 0 ||
+        header.sphereCount > header.slotCount)
+      return false;
+    auto ids = reinterpret_cast<const uint32_t *>(src + layout.materialIds);
+    for (size_t k = 0; k < header.slotCount; k++)
+      if (ids[k] >= header.materialCount) return false;
+    // sphere leaves inside the SoA slots
+    auto nodes = reinterpret_cast<const BVHNode *>(src + layout.nodes);
+    if (!TreeValid(nodes, header.nodeCount, [&](const BVHNode &node) {
+          size_t end = node.offset + (node.count + width - 1) / width * width;
+          return node.offset % width == 0 && end <= header.slotCount;
+        }))
+      return false;
+
+    // mesh arrays inside the mesh data, indices inside the vertices and
+    // leaves inside the triangles
+    auto inMeshData = [&](uint64_t offset, uint64_t count, size_t size) {
+      return offset % 64 == 0 && offset >= layout.meshData &&
+             offset <= layout.size && count <= (layout.size - offset) / size;
+    };
+    auto meshes = reinterpret_cast<const MeshRecord *>(src + layout.meshes);
+    for (size_t i = 0; i < header.meshCount; i++) {
+      const MeshRecord &mesh = meshes[i];
+      if (!inMeshData(mesh.positions, mesh.vertexCount, sizeof(float3)) ||
+          !inMeshData(mesh.indices, mesh.indexCount, sizeof(uint32_t)) ||
+          !inMeshData(mesh.nodes, mesh.nodeCount, sizeof(BVHNode)) ||
+          mesh.indexCount % 3 != 0 || mesh.material >= header.materialCount)
+        return false;
+      auto indices = reinterpret_cast<const uint32_t *>(src + mesh.indices);
+      for (size_t k = 0; k < mesh.indexCount; k++)
+        if (indices[k] >= mesh.vertexCount) return false;
+      if (!TreeValid(reinterpret_cast<const BVHNode *>(src + mesh.nodes),
+                     mesh.nodeCount, [&](const BVHNode &node) {
+                       return uint64_t(node.offset) + node.count <=
+                              mesh.indexCount / 3;
+                     }))
+        return false;
+    }
+
+    auto objects =
+        reinterpret_cast<const ObjectRecord *>(src + layout.objects);
+    for (size_t i = 0; i < header.objectCount; i++) {
+      const ObjectRecord &object = objects[i];
+      if (object.mesh >= header.meshCount || object.instanced > 1 ||
+          (object.material != noMaterial &&
+           object.material >= header.materialCount))
+        return false;
+    }
+    auto files = reinterpret_cast<const FileRecord *>(src + layout.files);
+    for (size_t i = 0; i < header.fileCount; i++)
+      if (files[i].nameSize > header.namesSize ||
+          files[i].nameOffset > header.namesSize - files[i].nameSize)
+        return false;
+    return true;
+  }
+
+  template <typename T>
+  static Buffer<T> ViewOf(const char *src, size_t offset, size_t count) {
+    Buffer<T> buffer;
+    buffer.view(reinterpret_cast<const T *>(src + offset), count);
+    return buffer;
+  }
+
+  bool loadCache(const std::string &path, const Source &source,
+                 const std::filesystem::path &dir) {
+    if (!cache.open(path) || cache.size < sizeof(Header)) return false;
+    auto src = static_cast<const char *>(cache.data);
+    Header header;
+    std::memcpy(&header, src, sizeof(header));
+    // no count can be larger than the file, which keeps LayoutOf from
+    // overflowing
+    bool countsValid = true;
+    for (uint64_t count :
+         {header.materialCount, header.slotCount, header.nodeCount,
+          header.meshCount, header.objectCount, header.fileCount,
+          header.namesSize, header.meshBytes})
+      countsValid &= count <= cache.size;
+    Layout layout = LayoutOf(header);
+    if (std::memcmp(header.magic, cacheMagic, sizeof(header.magic)) ||
+        header.version != cacheVersion || header.floatSize != sizeof(mfloat) ||
+        header.vectorSize != sizeof(float3) || header.source != source ||
+        !countsValid || cache.size != layout.size ||
+        !CacheContentsValid(header, layout, src) ||
+        !meshFilesUnchanged(header, layout, src, dir)) {
+      cache.close();
+      return false;
+    }
+
+    const CameraRecord &c = header.camera;
+    CameraTransform camTrans(c.origin, c.lookAt, c.up);
+    DefocusDisk ddisk;
+    if (c.defocusAngle > 0)
+      ddisk = DefocusDisk(c.defocusAngle, c.focusDist, c.imageDist, camTrans);
+    camera = Camera(c.width, c.height, c.vfov, camTrans, ddisk);
+    camera.samplesPerPixel = c.samplesPerPixel;
+    camera.maxDepth = c.maxDepth;
+    camera.rouletteMinDepth = c.rouletteMinDepth;
+    camera.seed = c.seed;
+    camera.sky = c.sky;
+
+    // materials and the objects of the world have vtables, they are
+    // rebuilt; the arrays they use are read in place
+    auto records =
+        reinterpret_cast<const MaterialRecord *>(src + layout.materials);
+    for (size_t i = 0; i < header.materialCount; i++) {
+      const MaterialRecord &r = records[i];
+      const Material *material;
+      if (r.type == MaterialType::Lambertian)
+        material = scene.addMaterial<Lambertian>(r.albedo);
+      else if (r.type == MaterialType::Metal)
+        material = scene.addMaterial<Metal>(r.albedo, r.fuzz);
+      else if (r.type == MaterialType::DiffuseLight)
+        material = scene.addMaterial<DiffuseLight>(r.albedo);
+      else
+        material = scene.addMaterial<Dielectric>(r.refractiveIndex);
+      spheres.materials.push_back(material);
+    }
+    const auto &materials = scene.materials;
+
+    Buffer<mfloat> *arrays[4] = {&spheres.centerX, &spheres.centerY,
+                                 &spheres.centerZ, &spheres.radius};
+    for (size_t i = 0; i < 4; i++)
+      *arrays[i] = ViewOf<mfloat>(src, layout.arrays[i], header.slotCount);
+    spheres.materialIds =
+        ViewOf<uint32_t>(src, layout.materialIds, header.slotCount);
+    spheres.tree.nodes = ViewOf<BVHNode>(src, layout.nodes, header.nodeCount);
+    spheres.sphereCount = header.sphereCount;
+
+    auto meshRecords =
+        reinterpret_cast<const MeshRecord *>(src + layout.meshes);
+    std::vector<const TriangleMesh *> meshes;
+    for (size_t i = 0; i < header.meshCount; i++) {
+      const MeshRecord &r = meshRecords[i];
+      meshes.push_back(scene.addShared<TriangleMesh>(
+          ViewOf<float3>(src, r.positions, r.vertexCount),
+          ViewOf<uint32_t>(src, r.indices, r.indexCount),
+          ViewOf<BVHNode>(src, r.nodes, r.nodeCount), materials[r.material]));
+    }
+    auto objects =
+        reinterpret_cast<const ObjectRecord *>(src + layout.objects);
+    for (size_t i = 0; i < header.objectCount; i++) {
+      const ObjectRecord &r = objects[i];
+      if (!r.instanced) {
+        scene.world.add(meshes[r.mesh]);
+        continue;
+      }
+      scene.add<Instance>(
+          meshes[r.mesh], r.transform,
+          r.material == noMaterial ? nullptr : materials[r.material]);
+    }
+    buildTop();
+
+    // the same hash parse() and load() give the scene
+    camera.sceneHash = 0;
+    for (const MeshFile &file : meshFiles)
+      camera.sceneHash = HashSource(camera.sceneHash, file.source);
+    camera.sceneHash = HashSource(camera.sceneHash, source);
+    fromCache = true;
+    return true;
+  }
+
+  // whether every mesh file of the cache still has the size and time it
+  // was cached with, fills meshFiles if so
+  bool meshFilesUnchanged(const Header &header, const Layout &layout,
+                          const char *src, const std::filesystem::path &dir) {
+    auto files = reinterpret_cast<const FileRecord *>(src + layout.files);
+    for (size_t i = 0; i < header.fileCount; i++) {
+      std::string name(src + layout.names + files[i].nameOffset,
+                       files[i].nameSize);
+      try {
+        if (SourceOf((dir / name).string()) != files[i].source) break;
+      } catch (const std::runtime_error &) {
+        break;
+      }
+      meshFiles.push_back({name, files[i].source});
+    }
+    if (meshFiles.size() == header.fileCount) return true;
+    meshFiles.clear();
+    return false;
+  }
+#pragma endregion
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "include/MathUtils.hpp"
+#include "Color.hpp"
+#include "Scene.hpp"
+#include "Sphere.hpp"
+#include "Camera.hpp"
+
+// the final scene of "Ray Tracing in One Weekend"
+// gridSize: small spheres are placed on a (2 * gridSize)^2 grid
+inline Scene WeekendScene(int gridSize = 11) {
+  Scene scene;
+  // at most one sphere per grid cell, the ground and the three big ones
+  scene.reserve<Sphere>(4 * gridSize * gridSize + 4);
+  auto groundMat = scene.addMaterial<Lambertian>(ColorF3(0.5, 0.5, 0.5));
+  scene.add<Sphere>(mfloat(1000), float3(0, -1000, 0), groundMat);
+
+  for (int a = -gridSize; a < gridSize; a++) {
+    for (int b = -gridSize; b < gridSize; b++) {
+      auto chooseMat = RandFloat();
+      float3 center(a + 0.9 * RandFloat(), 0.2, b + 0.9 * RandFloat());
+      if ((center - float3(4, 0.2, 0)).length() > 0.9) {
+        const Material *sphereMat;
+        if (chooseMat < 0.8) {
+          // diffuse
+          auto albedo = RandomUnitVector() * RandomUnitVector();
+          sphereMat = scene.addMaterial<Lambertian>(albedo);
+          scene.add<Sphere>(mfloat(0.2), center, sphereMat);
+        } else if (chooseMat < 0.95) {
+          // metal
+          auto albedo = RandomUnitVector() / 2 + 0.5;
+          auto fuzz = RandFloat(0, 0.5);
+          sphereMat = scene.addMaterial<Metal>(albedo, fuzz);
+          scene.add<Sphere>(mfloat(0.2), center, sphereMat);
+        } else {
+          // glass
+          sphereMat = scene.addMaterial<Dielectric>(mfloat(1.5));
+          scene.add<Sphere>(mfloat(0.2), center, sphereMat);
+        }
+      }
+    }
+  }
+
+  auto mat1 = scene.addMaterial<Dielectric>(mfloat(1.5));
+  scene.add<Sphere>(mfloat(1.0), float3(0, 1, 0), mat1);
+
+  auto mat2 = scene.addMaterial<Lambertian>(ColorF3(0.4, 0.2, 0.1));
+  scene.add<Sphere>(mfloat(1.0), float3(-4, 1, 0), mat2);
+
+  auto mat3 = scene.addMaterial<Metal>(ColorF3(0.7, 0.6, 0.5), mfloat(0.0));
+  scene.add<Sphere>(mfloat(1.0), float3(4, 1, 0), mat3);
+
+  return scene;
+}
+
+inline CameraTransform WeekendCameraTransform() {
+  return {
+      float3(13, 2, 3),  // origin
+      float3(0, 0, 0),   // lookAt
+      float3(0, 1, 0)    // up
+  };
+}
@@ -1,7 +1,9 @@
 #pragma once
 
-#include <memory>
+#include <cmath>
+#include <limits>
 
+#include "include/Counters.hpp"
 #include "include/Result.hpp"
 #include "Ray.hpp"
 #include "Color.hpp"
@@ -11,43 +13,83 @@
 struct Sphere : public Hittable {
   mfloat radius;
   float3 center;
-  std::shared_ptr<Material> material;
+  const Material *material;
 
   Sphere() {}
-  Sphere(mfloat radius, float3 center, std::shared_ptr<Material> material)
+  Sphere(mfloat radius, float3 center, const Material *material)
       : radius(radius), center(center), material(material) {}
 
   Result<HitRecord> hit(const Ray &ray, Interval rayTime) const override {
+    mfloat time;
+    if (!intersect(ray, rayTime, time)) return {};
+    HitRecord record;
+    record.rayTime = time;
+    record.object = this;
+    record.primIndex = 0;
+    return record;
+  }
+
+  bool occluded(const Ray &ray, Interval rayTime) const override {
+    mfloat time;
+    return intersect(ray, rayTime, time);
+  }
+
+  // the nearest hit inside rayTime, in time
+  bool intersect(const Ray &ray, Interval rayTime, mfloat &time) const {
+    RT_COUNT(SphereTests, 1);
     float3 orig = ray.origin;
     float3 dir = ray.direction;
     float3 dis = center - orig;
     mfloat a = dir.dot(dir);
     mfloat h = dir.dot(dis);
     mfloat c = dis.pow() - radius * radius;
-    mfloat discriminant = h * h - a * c;
-    if (discriminant < 0) return {};
+    // h * h - a * c, written as r^2 - (distance of center to the ray)^2 so
+    // that it doesn't cancel out for large spheres in float
+    float3 perp = dis - dir * (h / a);
+    mfloat discriminant = a * (radius * radius - perp.pow());
+    if (discriminant < 0) return false;
 
+    // the root nearer to 0 from c / q, no cancellation when h ~ sqrtd
     mfloat sqrtd = sqrt(discriminant);
-    mfloat t1 = (h - sqrtd) / a;
-    mfloat time = t1;
+    mfloat q = h + std::copysign(sqrtd, h);
+    mfloat tNear = c / q, tFar = q / a;
+    mfloat t1 = std::min(tNear, tFar);
+    time = t1;
     if (t1 < rayTime.min || t1 > rayTime.max) {
       // t1 not in range, use t2
-      mfloat t2 = (h + sqrtd) / a;
+      mfloat t2 = std::max(tNear, tFar);
       time = t2;
       if (t2 < rayTime.min || t2 > rayTime.max)  // t2 not in range
-        return {};
+        return false;
     }
 
-    float3 point = ray(time);
-    float3 normal = (point - center) / radius;
+    RT_COUNT(SphereHits, 1);
+    return true;
+  }
+
+  void resolveHit(const Ray &ray, HitRecord &record) const override {
+    ResolveHit(center, radius, ray, record);
+    record.material = material;
+  }
+
+  // surface data of a hit on the sphere (center, radius), shared with
+  // SphereSet
+  static void ResolveHit(const float3 &center, mfloat radius, const Ray &ray,
+                         HitRecord &record) {
+    // snap the point onto the surface, its error is then only that of the
+    // reprojection instead of growing with the ray distance
+    float3 local = ray(record.rayTime) - center;
+    local *= radius / local.length();
+    record.point = center + local;
+    record.pointError = 4 * std::numeric_limits<mfloat>::epsilon() *
+                        (maxAbs(center) + radius);
+    record.normal = local / radius;
     // normal 和 dir 异向，说明射线从球外部射入，为正面
-    bool isFrontFace = normal.dot(dir) < 0;
-    return HitRecord{
-        time,         // ray time
-        point,        // hit point
-        normal,       // normal
-        isFrontFace,  // front face
-        material      // material
-    };
+    record.frontFace = record.normal.dot(ray.direction) < 0;
+  }
+
+  AABB boundingBox() const override {
+    float3 r(radius, radius, radius);
+    return {center - r, center + r};
   }
 };
\ No newline at end of file
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "include/Buffer.hpp"
+#include "include/Counters.hpp"
+#include "include/Simd.hpp"
+#include "Ray.hpp"
+#include "Interval.hpp"
+#include "AABB.hpp"
+#include "Hittable.hpp"
+#include "Sphere.hpp"
+#include "BVH.hpp"
+
+// Many spheres in one primitive, stored as structure-of-arrays and tested
+// `width` at a time. A BVH with leaves of up to `width` spheres sits on top,
+// every leaf is padded to whole SIMD blocks.
+struct SphereSet : public Hittable {
+  static constexpr size_t width = SimdWidth<mfloat>;
+  using Pack = ::Pack<mfloat, width>;
+
+  // SoA storage in BVH leaf order, padding lanes hold NaN and never hit.
+  // Built here or viewed in place from a scene cache (SceneFile.hpp).
+  Buffer<mfloat> centerX, centerY, centerZ, radius;
+  Buffer<uint32_t> materialIds;  // index into materials
+  std::vector<const Material *> materials;
+  BVHTree tree;
+
+  SphereSet() {}
+  // packs every sphere of the list, which must not hold anything else
+  SphereSet(const HittableList &list) {
+    for (const Hittable *object : list.objects) {
+      auto sphere = dynamic_cast<const Sphere *>(object);
+      if (!sphere) throw std::invalid_argument("SphereSet: not a sphere!");
+      add(*sphere);
+    }
+    build();
+  }
+
+  void add(mfloat r, const float3 &center, const Material *material) {
+    pending.push_back({r, center, material});
+  }
+  void add(const Sphere &sphere) {
+    add(sphere.radius, sphere.center, sphere.material);
+  }
+
+  size_t size() const { return sphereCount; }
+  // SoA slots including the padding lanes
+  size_t slotCount() const { return centerX.size(); }
+
+  // bytes of the arrays and nodes it owns, views of a scene cache are free
+  size_t memoryBytes() const {
+    size_t bytes = 0;
+    if (!centerX.isView())
+      bytes += slotCount() * (4 * sizeof(mfloat) + sizeof(uint32_t));
+    if (!tree.nodes.isView()) bytes += tree.nodes.size() * sizeof(BVHNode);
+    return bytes;
+  }
+
+  // build the BVH over every sphere added so far and lay out the SoA arrays
+  void build() {
+    // keep the spheres of a previous build
+    const BVHTree &built = tree;
+    for (const auto &node : built.nodes)
+      for (size_t k = node.offset; k < node.offset + node.count; k++)
+        pending.push_back(sphere(k));
+
+    std::vector<AABB> bounds(pending.size());
+    for (size_t i = 0; i < pending.size(); i++)
+      bounds[i] = pending[i].boundingBox();
+    tree.build(bounds, width, width);
+
+    for (auto arr : {&centerX, &centerY, &centerZ, &radius}) arr->clear();
+    materialIds.clear();
+    materials.clear();
+    std::unordered_map<const Material *, uint32_t> materialIndex;
+    for (auto &node : tree.nodes) {
+      if (node.count == 0) continue;
+      uint32_t first = centerX.size();
+      for (size_t i = node.offset; i < node.offset + node.count; i++) {
+        const Sphere &s = pending[tree.primIndices[i]];
+        centerX.push_back(s.center.val[0]);
+        centerY.push_back(s.center.val[1]);
+        centerZ.push_back(s.center.val[2]);
+        radius.push_back(s.radius);
+        auto [it, added] = materialIndex.try_emplace(s.material, materials.size());
+        if (added) materials.push_back(s.material);
+        materialIds.push_back(it->second);
+      }
+      while (centerX.size() % width != 0) {
+        for (auto arr : {&centerX, &centerY, &centerZ, &radius})
+          arr->push_back(std::numeric_limits<mfloat>::quiet_NaN());
+        materialIds.push_back(0);
+      }
+      node.offset = first;
+    }
+    sphereCount = pending.size();
+    pending.clear();
+  }
+
+  Result<HitRecord> hit(const Ray &ray, Interval rayTime) const override {
+    Result<HitRecord> record;
+    RayLanes lanes(ray);
+    uint64_t tests = 0, hits = 0;
+    tree.traverse(ray, rayTime, [&](uint32_t first, uint32_t count,
+                                    Interval &rayTime) {
+      tests += count;
+      hitLeaf(lanes, first, count, rayTime, record, hits);
+    });
+    RT_COUNT(SphereTests, tests);
+    RT_COUNT(SphereHits, hits);
+    return record;
+  }
+
+  // every ray of the packet tests the leaves its own BVH walk would reach,
+  // in the same order, and gets the same hit
+  void hitPacket(RayPacket &packet, uint32_t first = 0) const override {
+    if (!packet.coherent) return Hittable::hitPacket(packet, first);
+    uint64_t tests = 0, hits = 0;
+    tree.traversePacket(
+        packet, first, [&](const BVHNode &node, uint32_t firstRay) {
+          for (uint32_t i = firstRay; i < packet.size; i++) {
+            if (i > firstRay && !packet.hitsBox(node.bounds, i)) continue;
+            tests += node.count;
+            hitLeaf(RayLanes(packet.rays[i]), node.offset, node.count,
+                    packet.rayTimes[i], packet.results[i], hits);
+          }
+        });
+    RT_COUNT(SphereTests, tests);
+    RT_COUNT(SphereHits, hits);
+  }
+
+  // leaves in the same order as hit(), up to the first sphere hit
+  bool occluded(const Ray &ray, Interval rayTime) const override {
+    RayLanes lanes(ray);
+    uint64_t tests = 0;
+    bool found = tree.traverseAny(ray, rayTime, [&](uint32_t first,
+                                                    uint32_t count) {
+      for (uint32_t block = first; block < first + count; block += width) {
+        tests += std::min<size_t>(width, first + count - block);
+        mfloat times[width];
+        if (blockTimes(lanes, block, rayTime, times)) return true;
+      }
+      return false;
+    });
+    RT_COUNT(SphereTests, tests);
+    RT_COUNT(SphereHits, found);
+    return found;
+  }
+
+  void resolveHit(const Ray &ray, HitRecord &record) const override {
+    size_t k = record.primIndex;
+    float3 center(centerX[k], centerY[k], centerZ[k]);
+    Sphere::ResolveHit(center, radius[k], ray, record);
+    record.material = materials[materialIds[k]];
+  }
+
+  // the sphere in SoA slot k
+  Sphere sphere(size_t k) const {
+    return {radius[k], float3(centerX[k], centerY[k], centerZ[k]),
+            materials[materialIds[k]]};
+  }
+
+  AABB boundingBox() const override { return tree.bounds(); }
+
+ private:
+  friend struct SceneFile;  // fills the arrays from a scene cache
+
+  std::vector<Sphere> pending;
+  size_t sphereCount = 0;
+
+  // a ray broadcast to every lane
+  struct RayLanes {
+    Pack ox, oy, oz, dx, dy, dz, a;
+
+    RayLanes(const Ray &ray) {
+      const float3 &o = ray.origin, &d = ray.direction;
+      ox = Pack::broadcast(o.val[0]);
+      oy = Pack::broadcast(o.val[1]);
+      oz = Pack::broadcast(o.val[2]);
+      dx = Pack::broadcast(d.val[0]);
+      dy = Pack::broadcast(d.val[1]);
+      dz = Pack::broadcast(d.val[2]);
+      a = Pack::broadcast(d.dot(d));
+    }
+  };
+
+  // test the spheres of one leaf, record the closest hit inside rayTime
+  void hitLeaf(const RayLanes &ray, uint32_t first, uint32_t count,
+               Interval &rayTime, Result<HitRecord> &record,
+               uint64_t &hits) const {
+    for (uint32_t block = first; block < first + count; block += width) {
+      mfloat times[width];
+      if (!blockTimes(ray, block, rayTime, times)) continue;
+      for (size_t i = 0; i < width; i++) {
+        hits += times[i] < INF;
+        if (times[i] < INF && times[i] <= rayTime.max) {
+          rayTime.max = times[i];
+          record.success = true;
+          record.ret.rayTime = times[i];
+          record.ret.primIndex = block + i;
+          record.ret.object = this;
+          record.ret.instance = nullptr;
+        }
+      }
+    }
+  }
+
+  // hit times inside rayTime of the `width` spheres from SoA slot block on,
+  // INF where a sphere isn't hit; false if none is
+  bool blockTimes(const RayLanes &ray, uint32_t block, Interval rayTime,
+                  mfloat times[width]) const {
+    Pack inf = Pack::broadcast(INF), zero = Pack::broadcast(0);
+    Pack tMin = Pack::broadcast(rayTime.min),
+         tMax = Pack::broadcast(rayTime.max);
+    // same operations in the same order as Sphere::intersect, one sphere
+    // per lane, so that both give bitwise the same times
+    Pack disX = Pack::load(&centerX[block]) - ray.ox;
+    Pack disY = Pack::load(&centerY[block]) - ray.oy;
+    Pack disZ = Pack::load(&centerZ[block]) - ray.oz;
+    Pack r = Pack::load(&radius[block]);
+    // the sum starts from +0 like float3::dot, h = -0 would flip copysign
+    Pack h = zero + ray.dx * disX + ray.dy * disY + ray.dz * disZ;
+    Pack c = disX * disX + disY * disY + disZ * disZ - r * r;
+    Pack s = h / ray.a;
+    Pack perpX = disX - ray.dx * s, perpY = disY - ray.dy * s,
+         perpZ = disZ - ray.dz * s;
+    Pack discriminant =
+        ray.a * (r * r - (perpX * perpX + perpY * perpY + perpZ * perpZ));
+    auto valid = discriminant >= zero;
+    if (!any(valid)) return false;
+
+    Pack sqrtd = sqrt(max(discriminant, zero));
+    Pack q = h + copysign(sqrtd, h);
+    Pack tNear = c / q, tFar = q / ray.a;
+    // std::min / std::max argument order, they agree on ties and NaNs
+    Pack t1 = min(tFar, tNear), t2 = max(tFar, tNear);
+    Pack t = select((t1 < tMin) | (t1 > tMax),
+                    select((t2 < tMin) | (t2 > tMax), inf, t2), t1);
+    t = select(valid, t, inf);
+    t.store(times);
+    return any(t < inf);
+  }
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "include/Utils.hpp"
+
+// image region [rowBegin, rowEnd) x [colBegin, colEnd)
+struct Tile {
+  int rowBegin, rowEnd, colBegin, colEnd;
+
+  int pixelCount() const { return (rowEnd - rowBegin) * (colEnd - colBegin); }
+};
+
+// order the tiles are handed out in, space filling curves keep the tiles a
+// thread renders one after another next to each other
+enum class TileOrder { Scanline, Morton, Hilbert };
+
+inline bool ParseTileOrder(const std::string &name, TileOrder &order) {
+  if (name == "scanline") order = TileOrder::Scanline;
+  else if (name == "morton") order = TileOrder::Morton;
+  else if (name == "hilbert") order = TileOrder::Hilbert;
+  else return false;
+  return true;
+}
+
+inline uint64_t MortonIndex(uint32_t x, uint32_t y) {
+  uint64_t index = 0;
+  for (int bit = 0; bit < 32; bit++) {
+    index |= uint64_t((x >> bit) & 1) << (2 * bit + 1);
+    index |= uint64_t((y >> bit) & 1) << (2 * bit);
+  }
+  return index;
+}
+
+// distance along the Hilbert curve filling a n x n grid, n a power of 2
+inline uint64_t HilbertIndex(uint32_t n, uint32_t x, uint32_t y) {
+  uint64_t index = 0;
+  for (uint32_t s = n / 2; s > 0; s /= 2) {
+    uint32_t rx = (x & s) > 0, ry = (y & s) > 0;
+    index += uint64_t(s) * s * ((3 * rx) ^ ry);
+    // rotate the quadrant
+    if (ry == 0) {
+      if (rx == 1) {
+        x = s - 1 - x;
+        y = s - 1 - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return index;
+}
+
+inline std::vector<Tile> MakeTiles(int height, int width, int tileSize,
+                                   TileOrder order = TileOrder::Hilbert) {
+  tileSize = std::max(tileSize, 1);
+  uint32_t rows = (height + tileSize - 1) / tileSize;
+  uint32_t cols = (width + tileSize - 1) / tileSize;
+  uint32_t n = 1;
+  while (n < std::max(rows, cols)) n *= 2;
+
+  std::vector<std::pair<uint64_t, Tile>> keyed;
+  for (uint32_t r = 0; r < rows; r++) {
+    for (uint32_t c = 0; c < cols; c++) {
+      Tile tile{int(r) * tileSize, std::min(int(r + 1) * tileSize, height),
+                int(c) * tileSize, std::min(int(c + 1) * tileSize, width)};
+      uint64_t key = r * uint64_t(cols) + c;
+      if (order == TileOrder::Morton) key = MortonIndex(r, c);
+      else if (order == TileOrder::Hilbert) key = HilbertIndex(n, r, c);
+      keyed.push_back({key, tile});
+    }
+  }
+  std::sort(keyed.begin(), keyed.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  std::vector<Tile> tiles;
+  for (const auto &[key, tile] : keyed) tiles.push_back(tile);
+  return tiles;
+}
+
+struct TileStat {
+  int thread;      // worker that rendered the tile
+  int tile;        // index in render order
+  int pass;
+  double start;    // seconds since the render started
+  double seconds;  // time spent on the tile
+};
+
+// one pass over every tile, spp samples per pixel
+struct PassStat {
+  int spp;
+  double start, seconds;
+};
+
+// per-tile timing summary, imbalance = busiest thread / average thread
+inline void PrintTileReport(const std::vector<TileStat> &stats,
+                            int threadCount, size_t steals) {
+  if (stats.empty()) return;
+  double minTile = INFINITY, maxTile = 0, sum = 0, end = 0;
+  std::vector<double> busy(threadCount, 0);
+  for (const auto &stat : stats) {
+    minTile = std::min(minTile, stat.seconds);
+    maxTile = std::max(maxTile, stat.seconds);
+    sum += stat.seconds;
+    end = std::max(end, stat.start + stat.seconds);
+    busy[stat.thread] += stat.seconds;
+  }
+  double maxBusy = *std::max_element(busy.begin(), busy.end());
+  double meanBusy = sum / threadCount;
+  print("tiles:", stats.size(), "threads:", threadCount, "steals:", steals);
+  print("tile time (ms): min", minTile * 1e3, "mean", sum / stats.size() * 1e3,
+        "max", maxTile * 1e3);
+  print("thread busy (ms): mean", meanBusy * 1e3, "max", maxBusy * 1e3,
+        "imbalance", maxBusy / meanBusy, "idle",
+        (1 - sum / (end * threadCount)) * 100, "%");
+}
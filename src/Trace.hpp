@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#include "include/Counters.hpp"
+#include "Camera.hpp"
+
+// Timeline of the camera's last render in the Chrome trace event format,
+// opened by chrome://tracing and https://ui.perfetto.dev: one row with the
+// passes, one row per worker thread with its tiles. The path statistics and
+// the hot-path counters (with RT_COUNTERS) go into the trace's metadata.
+inline bool WriteChromeTrace(const std::string &path, const Camera &camera) {
+  std::ofstream out(path);
+  if (!out) return false;
+  out.precision(15);
+  auto us = [](double seconds) { return seconds * 1e6; };
+
+  int threads = 0;
+  for (const TileStat &stat : camera.tileStats)
+    threads = std::max(threads, stat.thread + 1);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  out << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, "
+         "\"args\": {\"name\": \"render\"}},\n";
+  out << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+         "\"tid\": 0, \"args\": {\"name\": \"passes\"}}";
+  for (int t = 0; t < threads; t++)
+    out << ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+        << "\"tid\": " << t + 1 << ", \"args\": {\"name\": \"worker " << t
+        << "\"}}";
+
+  for (size_t p = 0; p < camera.passStats.size(); p++) {
+    const PassStat &pass = camera.passStats[p];
+    out << ",\n  {\"name\": \"pass " << p << "\", \"cat\": \"pass\", "
+        << "\"ph\": \"X\", \"pid\": 0, \"tid\": 0, \"ts\": " << us(pass.start)
+        << ", \"dur\": " << us(pass.seconds)
+        << ", \"args\": {\"spp\": " << pass.spp << "}}";
+  }
+  for (const TileStat &stat : camera.tileStats)
+    out << ",\n  {\"name\": \"tile " << stat.tile << "\", \"cat\": \"tile\", "
+        << "\"ph\": \"X\", \"pid\": 0, \"tid\": " << stat.thread + 1
+        << ", \"ts\": " << us(stat.start) << ", \"dur\": " << us(stat.seconds)
+        << ", \"args\": {\"pass\": " << stat.pass << "}}";
+
+  const PathStats &paths = camera.pathStats;
+  out << "\n], \"otherData\": {\"paths\": " << paths.paths
+      << ", \"rays\": " << paths.rays << ", \"seconds\": " << paths.seconds
+      << ", \"mraysPerSecond\": " << paths.mraysPerSecond();
+  if (CountersEnabled) {
+    const CounterBlock &counts = camera.counts;
+    for (size_t i = 0; i < CounterCount; i++)
+      out << ", \"" << CounterName(Counter(i)) << "\": " << counts.counts[i];
+    size_t last = 0;
+    for (size_t d = 0; d < CounterBlock::depthBins; d++)
+      if (counts.depths[d]) last = d;
+    // paths ending after 0, 1, 2, ... bounces
+    out << ", \"pathDepths\": [";
+    for (size_t d = 0; d <= last; d++)
+      out << (d ? ", " : "") << counts.depths[d];
+    out << "]";
+  }
+  out << "}}\n";
+  return bool(out);
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "include/MathUtils.hpp"
+#include "Ray.hpp"
+#include "AABB.hpp"
+
+// 3x4 affine matrix, row major
+struct Affine {
+  mfloat m[3][4];
+
+  static constexpr Affine Identity() {
+    return {{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}}};
+  }
+
+  float3 applyPoint(const float3 &p) const {
+    float3 res;
+    for (int i = 0; i < 3; i++)
+      res.val[i] = m[i][0] * p.val[0] + m[i][1] * p.val[1] +
+                   m[i][2] * p.val[2] + m[i][3];
+    return res;
+  }
+
+  float3 applyVector(const float3 &v) const {
+    float3 res;
+    for (int i = 0; i < 3; i++)
+      res.val[i] = m[i][0] * v.val[0] + m[i][1] * v.val[1] + m[i][2] * v.val[2];
+    return res;
+  }
+
+  // transpose of the 3x3 part times v
+  float3 applyTransposed(const float3 &v) const {
+    float3 res;
+    for (int i = 0; i < 3; i++)
+      res.val[i] = m[0][i] * v.val[0] + m[1][i] * v.val[1] + m[2][i] * v.val[2];
+    return res;
+  }
+
+  // largest row sum of |m|, bounds how much the 3x3 part stretches a vector
+  // in the max norm
+  mfloat norm() const {
+    mfloat res = 0;
+    for (int i = 0; i < 3; i++)
+      res = std::max(res, std::abs(m[i][0]) + std::abs(m[i][1]) +
+                              std::abs(m[i][2]));
+    return res;
+  }
+
+  friend Affine operator*(const Affine &a, const Affine &b) {
+    Affine res;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 4; j++) {
+        res.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] +
+                      a.m[i][2] * b.m[2][j];
+      }
+      res.m[i][3] += a.m[i][3];
+    }
+    return res;
+  }
+};
+
+// Object-to-world affine transform together with its inverse, so that rays
+// go into object space and normals come back out without inverting per hit.
+struct Transform {
+  Affine toWorld = Affine::Identity(), toObject = Affine::Identity();
+
+  Transform() {}
+  Transform(const Affine &toWorld, const Affine &toObject)
+      : toWorld(toWorld), toObject(toObject) {}
+
+  // throws std::invalid_argument if the matrix is singular
+  static Transform FromMatrix(const Affine &a) {
+    // inverse of the 3x3 part from its cofactors
+    const auto &m = a.m;
+    mfloat c[3][3];
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+        int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+        c[i][j] = m[i1][j1] * m[i2][j2] - m[i1][j2] * m[i2][j1];
+      }
+    }
+    mfloat det = m[0][0] * c[0][0] + m[0][1] * c[0][1] + m[0][2] * c[0][2];
+    if (det == 0 || !std::isfinite(det))
+      throw std::invalid_argument("Transform: singular matrix");
+    Affine inv;
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++) inv.m[i][j] = c[j][i] / det;
+    for (int i = 0; i < 3; i++)
+      inv.m[i][3] = -(inv.m[i][0] * m[0][3] + inv.m[i][1] * m[1][3] +
+                      inv.m[i][2] * m[2][3]);
+    return {a, inv};
+  }
+
+  static Transform Translate(const float3 &d) {
+    Affine a = Affine::Identity(), inv = Affine::Identity();
+    for (int i = 0; i < 3; i++) {
+      a.m[i][3] = d.val[i];
+      inv.m[i][3] = -d.val[i];
+    }
+    return {a, inv};
+  }
+
+  static Transform Scale(const float3 &s) {
+    Affine a = Affine::Identity(), inv = Affine::Identity();
+    for (int i = 0; i < 3; i++) {
+      a.m[i][i] = s.val[i];
+      inv.m[i][i] = 1 / s.val[i];
+    }
+    return {a, inv};
+  }
+
+  // counter-clockwise around axis when looking against it
+  static Transform Rotate(const float3 &axis, mfloat degrees) {
+    float3 u = normalize(axis);
+    mfloat s = std::sin(Deg2Rad(degrees)), c = std::cos(Deg2Rad(degrees));
+    Affine a = Affine::Identity();
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++)
+        a.m[i][j] = u.val[i] * u.val[j] * (1 - c) + (i == j ? c : 0);
+    }
+    a.m[0][1] -= u.val[2] * s;
+    a.m[0][2] += u.val[1] * s;
+    a.m[1][0] += u.val[2] * s;
+    a.m[1][2] -= u.val[0] * s;
+    a.m[2][0] -= u.val[1] * s;
+    a.m[2][1] += u.val[0] * s;
+    // orthonormal, the inverse is the transpose
+    Affine inv = Affine::Identity();
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++) inv.m[i][j] = a.m[j][i];
+    return {a, inv};
+  }
+
+  // apply b first, then a
+  friend Transform operator*(const Transform &a, const Transform &b) {
+    return {a.toWorld * b.toWorld, b.toObject * a.toObject};
+  }
+
+  Transform inverse() const { return {toObject, toWorld}; }
+
+  // ray in object space, the direction is not renormalized so that hit
+  // times stay the same in both spaces
+  Ray rayToObject(const Ray &ray) const {
+    return {toObject.applyPoint(ray.origin), toObject.applyVector(ray.direction)};
+  }
+
+  float3 normalToWorld(const float3 &n) const {
+    return normalize(toObject.applyTransposed(n));
+  }
+
+  // world bounds of an object-space box (Arvo's method)
+  AABB boundsToWorld(const AABB &box) const {
+    if (box.isEmpty()) return box;
+    AABB res;
+    for (int i = 0; i < 3; i++) {
+      mfloat lo = toWorld.m[i][3], hi = toWorld.m[i][3];
+      for (int j = 0; j < 3; j++) {
+        mfloat a = toWorld.m[i][j] * box.min.val[j];
+        mfloat b = toWorld.m[i][j] * box.max.val[j];
+        lo += std::min(a, b);
+        hi += std::max(a, b);
+      }
+      // rounding of the sums above
+      mfloat pad = 4 * std::numeric_limits<mfloat>::epsilon() *
+                   std::max(std::abs(lo), std::abs(hi));
+      res.min.val[i] = lo - pad;
+      res.max.val[i] = hi + pad;
+    }
+    return res;
+  }
+};
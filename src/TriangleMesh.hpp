@@ -0,0 +1,306 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "include/Buffer.hpp"
+#include "include/Counters.hpp"
+#include "include/Simd.hpp"
+#include "Ray.hpp"
+#include "Interval.hpp"
+#include "AABB.hpp"
+#include "Hittable.hpp"
+#include "BVH.hpp"
+
+// Indexed triangle mesh: vertex positions shared by every triangle using
+// them, three indices per triangle. A BVH with leaves of up to `width`
+// triangles sits on top and a leaf is tested `width` triangles at a time.
+//
+// The ray-triangle test is the watertight one of Woop, Benthin and Wald
+// ("Watertight Ray/Triangle Intersection", JCGT 2013): the triangle is
+// sheared into the ray's space and the edge functions are evaluated in 2D,
+// so the two triangles sharing an edge agree on which side of it a ray
+// passes and no ray slips through the seams of a closed mesh.
+struct TriangleMesh : public Hittable {
+  static constexpr size_t width = SimdWidth<mfloat>;
+  using Pack = ::Pack<mfloat, width>;
+
+  // built here or viewed in place from a scene cache (SceneFile.hpp)
+  Buffer<float3> positions;
+  Buffer<uint32_t> indices;  // 3 per triangle, leaf order after build()
+  const Material *material = nullptr;
+  BVHTree tree;
+
+  TriangleMesh() {}
+  TriangleMesh(std::vector<float3> positions, std::vector<uint32_t> indices,
+               const Material *material)
+      : positions(std::move(positions)),
+        indices(std::move(indices)),
+        material(material) {
+    build();
+  }
+  // a mesh built before: indices in leaf order, nodes the BVH over them
+  TriangleMesh(Buffer<float3> positions, Buffer<uint32_t> indices,
+               Buffer<BVHNode> nodes, const Material *material)
+      : positions(std::move(positions)),
+        indices(std::move(indices)),
+        material(material) {
+    tree.nodes = std::move(nodes);
+    tree.blockSize = width;
+  }
+
+  size_t triangleCount() const { return indices.size() / 3; }
+
+  // bytes of the vertex, index and node buffers it owns, views of a scene
+  // cache are free
+  size_t memoryBytes() const {
+    size_t bytes = 0;
+    if (!positions.isView()) bytes += positions.size() * sizeof(float3);
+    if (!indices.isView()) bytes += indices.size() * sizeof(uint32_t);
+    if (!tree.nodes.isView()) bytes += tree.nodes.size() * sizeof(BVHNode);
+    return bytes;
+  }
+
+  // build the BVH and put the triangles in leaf order
+  void build() {
+    size_t count = triangleCount();
+    std::vector<AABB> bounds(count);
+#pragma omp parallel for
+    for (long long i = 0; i < (long long)count; i++) {
+      AABB box;
+      for (int v = 0; v < 3; v++) box.expand(vertex(i, v));
+      bounds[i] = box;
+    }
+    tree.build(bounds, width, width);
+    bounds = {};
+
+    std::vector<uint32_t> sorted(indices.size());
+    for (size_t i = 0; i < count; i++)
+      std::copy_n(&indices[tree.primIndices[i] * 3], 3, &sorted[i * 3]);
+    indices = Buffer<uint32_t>(std::move(sorted));
+    // the triangles now are in leaf order, the mapping isn't needed
+    tree.primIndices = {};
+  }
+
+  Result<HitRecord> hit(const Ray &ray, Interval rayTime) const override {
+    Result<HitRecord> record;
+    Shear shear(ray);
+    uint64_t tests = 0, hits = 0;
+    tree.traverse(ray, rayTime, [&](uint32_t first, uint32_t count,
+                                    Interval &rayTime) {
+      tests += count;
+      hitLeaf(ray, shear, first, count, rayTime, record, hits);
+    });
+    RT_COUNT(TriangleTests, tests);
+    RT_COUNT(TriangleHits, hits);
+    return record;
+  }
+
+  // like SphereSet::hitPacket, every ray gets the hit hit() finds
+  void hitPacket(RayPacket &packet, uint32_t first = 0) const override {
+    if (!packet.coherent) return Hittable::hitPacket(packet, first);
+    uint64_t tests = 0, hits = 0;
+    tree.traversePacket(
+        packet, first, [&](const BVHNode &node, uint32_t firstRay) {
+          for (uint32_t i = firstRay; i < packet.size; i++) {
+            if (i > firstRay && !packet.hitsBox(node.bounds, i)) continue;
+            tests += node.count;
+            const Ray &ray = packet.rays[i];
+            hitLeaf(ray, Shear(ray), node.offset, node.count,
+                    packet.rayTimes[i], packet.results[i], hits);
+          }
+        });
+    RT_COUNT(TriangleTests, tests);
+    RT_COUNT(TriangleHits, hits);
+  }
+
+  // leaves in the same order as hit(), up to the first triangle hit
+  bool occluded(const Ray &ray, Interval rayTime) const override {
+    Shear shear(ray);
+    uint64_t tests = 0;
+    bool found = tree.traverseAny(ray, rayTime, [&](uint32_t first,
+                                                    uint32_t count) {
+      for (uint32_t block = first; block < first + count; block += width) {
+        size_t n = std::min<size_t>(width, first + count - block);
+        tests += n;
+        mfloat times[width];
+        if (blockTimes(ray, shear, block, n, rayTime, times)) return true;
+      }
+      return false;
+    });
+    RT_COUNT(TriangleTests, tests);
+    RT_COUNT(TriangleHits, found);
+    return found;
+  }
+
+  void resolveHit(const Ray &ray, HitRecord &record) const override {
+    uint32_t k = record.primIndex;
+    const float3 &p0 = vertex(k, 0), &p1 = vertex(k, 1), &p2 = vertex(k, 2);
+    // the barycentrics of the hit, the same test hit() ran
+    mfloat t, b[3] = {1, 0, 0};
+    Intersect(Shear(ray), ray.origin, p0, p1, p2, Interval(-INF, INF), t, b);
+    // interpolating the vertices is far more accurate than origin + t * dir
+    record.point = p0 * b[0] + p1 * b[1] + p2 * b[2];
+    record.pointError =
+        8 * std::numeric_limits<mfloat>::epsilon() *
+        (std::abs(b[0]) * maxAbs(p0) + std::abs(b[1]) * maxAbs(p1) +
+         std::abs(b[2]) * maxAbs(p2));
+    // geometric normal, counter-clockwise triangles face the viewer
+    record.normal = normalize((p1 - p0).cross(p2 - p0));
+    record.frontFace = record.normal.dot(ray.direction) < 0;
+    record.material = material;
+  }
+
+  AABB boundingBox() const override { return tree.bounds(); }
+
+  const float3 &vertex(size_t triangle, int v) const {
+    return positions[indices[triangle * 3 + v]];
+  }
+
+  // ray direction permuted so that z is its largest component, and the
+  // shear that maps it onto (0, 0, 1)
+  struct Shear {
+    int kx, ky, kz;
+    mfloat sx, sy, sz;
+
+    Shear(const Ray &ray) {
+      const float3 &d = ray.direction;
+      kz = 0;
+      for (int i = 1; i < 3; i++)
+        if (std::abs(d.val[i]) > std::abs(d.val[kz])) kz = i;
+      kx = (kz + 1) % 3;
+      ky = (kx + 1) % 3;
+      // keep the winding of the triangles
+      if (d.val[kz] < 0) std::swap(kx, ky);
+      sz = 1 / d.val[kz];
+      sx = d.val[kx] * sz;
+      sy = d.val[ky] * sz;
+    }
+  };
+
+  // scalar watertight test, b gets the barycentric coordinates
+  static bool Intersect(const Shear &s, const float3 &origin, const float3 &p0,
+                        const float3 &p1, const float3 &p2, Interval rayTime,
+                        mfloat &t, mfloat b[3]) {
+    float3 a = p0 - origin, bv = p1 - origin, c = p2 - origin;
+    mfloat ax = a.val[s.kx] - s.sx * a.val[s.kz];
+    mfloat ay = a.val[s.ky] - s.sy * a.val[s.kz];
+    mfloat bx = bv.val[s.kx] - s.sx * bv.val[s.kz];
+    mfloat by = bv.val[s.ky] - s.sy * bv.val[s.kz];
+    mfloat cx = c.val[s.kx] - s.sx * c.val[s.kz];
+    mfloat cy = c.val[s.ky] - s.sy * c.val[s.kz];
+
+    mfloat u = cx * by - cy * bx, v = ax * cy - ay * cx, w = bx * ay - by * ax;
+    if constexpr (sizeof(mfloat) < sizeof(double)) {
+      // on an edge in float, decide it in double like the paper does
+      if (u == 0 || v == 0 || w == 0) {
+        u = mfloat(double(cx) * by - double(cy) * bx);
+        v = mfloat(double(ax) * cy - double(ay) * cx);
+        w = mfloat(double(bx) * ay - double(by) * ax);
+      }
+    }
+    if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) return false;
+    mfloat det = u + v + w;
+    if (det == 0) return false;
+
+    t = (u * s.sz * a.val[s.kz] + v * s.sz * bv.val[s.kz] +
+         w * s.sz * c.val[s.kz]) / det;
+    if (t < rayTime.min || t > rayTime.max) return false;
+    b[0] = u / det;
+    b[1] = v / det;
+    b[2] = w / det;
+    return true;
+  }
+
+ private:
+  // test the triangles of one leaf, record the closest hit inside rayTime
+  void hitLeaf(const Ray &ray, const Shear &shear, uint32_t first,
+               uint32_t count, Interval &rayTime, Result<HitRecord> &record,
+               uint64_t &hits) const {
+    for (uint32_t block = first; block < first + count; block += width) {
+      size_t n = std::min<size_t>(width, first + count - block);
+      mfloat times[width];
+      if (!blockTimes(ray, shear, block, n, rayTime, times)) continue;
+      for (size_t i = 0; i < n; i++) {
+        hits += times[i] < INF;
+        if (times[i] < INF && times[i] <= rayTime.max)
+          setHit(record, rayTime, times[i], block + i);
+      }
+    }
+  }
+
+  // hit times inside rayTime of the n triangles from `block` on, INF where
+  // a triangle isn't hit; false if none is
+  bool blockTimes(const Ray &ray, const Shear &shear, uint32_t block,
+                  size_t n, Interval rayTime, mfloat times[width]) const {
+    Pack sx = Pack::broadcast(shear.sx), sy = Pack::broadcast(shear.sy),
+         sz = Pack::broadcast(shear.sz), zero = Pack::broadcast(0),
+         inf = Pack::broadcast(INF);
+    // vertices relative to the ray origin, permuted to (kx, ky, kz), empty
+    // lanes hold NaN like the padding of SphereSet: all their edge tests
+    // fail, so they neither hit nor send the block to the scalar test
+    mfloat rel[9][width];
+    for (auto &row : rel)
+      std::fill(row, row + width, std::numeric_limits<mfloat>::quiet_NaN());
+    for (size_t i = 0; i < n; i++) {
+      for (int v = 0; v < 3; v++) {
+        float3 p = vertex(block + i, v) - ray.origin;
+        rel[v * 3 + 0][i] = p.val[shear.kx];
+        rel[v * 3 + 1][i] = p.val[shear.ky];
+        rel[v * 3 + 2][i] = p.val[shear.kz];
+      }
+    }
+    Pack az = Pack::load(rel[2]), bz = Pack::load(rel[5]),
+         cz = Pack::load(rel[8]);
+    Pack ax = Pack::load(rel[0]) - sx * az, ay = Pack::load(rel[1]) - sy * az;
+    Pack bx = Pack::load(rel[3]) - sx * bz, by = Pack::load(rel[4]) - sy * bz;
+    Pack cx = Pack::load(rel[6]) - sx * cz, cy = Pack::load(rel[7]) - sy * cz;
+
+    // edge functions, the ray hits if all three have the same sign
+    Pack u = cx * by - cy * bx, v = ax * cy - ay * cx, w = bx * ay - by * ax;
+    if constexpr (sizeof(mfloat) < sizeof(double)) {
+      // a zero edge function may be a rounding artifact in float, let the
+      // scalar test redo the block with the double fallback
+      auto isZero = [&](const Pack &e) { return (e >= zero) & (e <= zero); };
+      if (any(isZero(u) | isZero(v) | isZero(w))) {
+        bool found = false;
+        for (size_t i = 0; i < width; i++) {
+          mfloat t, b[3];
+          times[i] = i < n && Intersect(shear, ray.origin,
+                                        vertex(block + i, 0),
+                                        vertex(block + i, 1),
+                                        vertex(block + i, 2), rayTime, t, b)
+                         ? t
+                         : INF;
+          found |= times[i] < INF;
+        }
+        return found;
+      }
+    }
+    auto sameSign = ((u >= zero) & (v >= zero) & (w >= zero)) |
+                    ((u <= zero) & (v <= zero) & (w <= zero));
+    Pack det = u + v + w;
+    auto valid = sameSign & ((det > zero) | (det < zero));
+    if (!any(valid)) return false;
+
+    Pack t = (u * (sz * az) + v * (sz * bz) + w * (sz * cz)) / det;
+    Pack tMin = Pack::broadcast(rayTime.min),
+         tMax = Pack::broadcast(rayTime.max);
+    t = select(valid & (t >= tMin) & (t <= tMax), t, inf);
+    t.store(times);
+    return any(t < inf);
+  }
+
+  void setHit(Result<HitRecord> &record, Interval &rayTime, mfloat t,
+              uint32_t triangle) const {
+    rayTime.max = t;
+    record.success = true;
+    record.ret.rayTime = t;
+    record.ret.primIndex = triangle;
+    record.ret.object = this;
+    record.ret.instance = nullptr;
+  }
+};
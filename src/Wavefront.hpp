@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Hittable.hpp"
+#include "Material.hpp"
+#include "Color.hpp"
+#include "Ray.hpp"
+
+// how Camera traces the paths of a tile
+//  megakernel: one path at a time from the camera to its end (rayColor)
+//  wavefront: one path per pixel of the tile at once, bounce by bounce
+enum class Integrator { Megakernel, Wavefront };
+
+inline bool ParseIntegrator(const std::string &name, Integrator &integrator) {
+  if (name == "megakernel") integrator = Integrator::Megakernel;
+  else if (name == "wavefront") integrator = Integrator::Wavefront;
+  else return false;
+  return true;
+}
+
+// Paths of a wavefront, one entry per path. Every bounce intersects all
+// active paths, sorts the hits into one queue per material type (and one
+// for the misses) and then shades each queue in its own loop.
+// Kept per worker thread so the buffers are reused from tile to tile.
+struct Wavefront {
+  std::vector<Ray> rays;
+  std::vector<ColorF3> throughput;
+  std::vector<ColorF3> radiance;  // light found so far, see Camera::rayColor
+  std::vector<mfloat> bsdfPdf;    // of the bounce that traced the ray
+  std::vector<uint32_t> pixels;  // accumulator pixel of the path
+  std::vector<Sampler> samplers;  // of the path's camera sample
+  std::vector<HitRecord> hits;
+
+  std::vector<uint32_t> active;  // paths still traced
+  std::vector<uint32_t> queues[MaterialTypeCount];
+  std::vector<uint32_t> misses;
+
+  void reset() {
+    rays.clear();
+    throughput.clear();
+    radiance.clear();
+    bsdfPdf.clear();
+    pixels.clear();
+    samplers.clear();
+    hits.clear();
+    active.clear();
+  }
+
+  uint32_t addPath(const Ray &ray, uint32_t pixel, const Sampler &sampler) {
+    uint32_t path = rays.size();
+    rays.push_back(ray);
+    throughput.push_back(ColorF3(1, 1, 1));
+    radiance.push_back(ColorF3(0, 0, 0));
+    bsdfPdf.push_back(0);
+    pixels.push_back(pixel);
+    samplers.push_back(sampler);
+    hits.emplace_back();
+    active.push_back(path);
+    return path;
+  }
+
+  // closest hit of every active path, hits go to the queue of their
+  // material, misses to misses
+  void intersect(const Hittable &scene) {
+    for (auto &queue : queues) queue.clear();
+    misses.clear();
+    for (uint32_t path : active)
+      sortHit(path, scene.hit(rays[path], Interval(0, INF)));
+    active.clear();
+  }
+
+  // intersect, tracing the active paths RayPacket::maxSize at a time. For
+  // the camera rays, whose paths are in pixel order.
+  void intersectPackets(const Hittable &scene) {
+    for (auto &queue : queues) queue.clear();
+    misses.clear();
+    for (size_t begin = 0; begin < active.size();
+         begin += RayPacket::maxSize) {
+      size_t end = std::min<size_t>(begin + RayPacket::maxSize, active.size());
+      packet.clear();
+      for (size_t i = begin; i < end; i++) packet.add(rays[active[i]]);
+      packet.prepare();
+      scene.hitPacket(packet);
+      for (size_t i = begin; i < end; i++)
+        sortHit(active[i], packet.results[i - begin]);
+    }
+    active.clear();
+  }
+
+ private:
+  RayPacket packet;
+
+  void sortHit(uint32_t path, const Result<HitRecord> &result) {
+    if (!result.success) {
+      misses.push_back(path);
+      return;
+    }
+    HitRecord &hit = hits[path];
+    hit = result.ret;
+    hit.resolve(rays[path]);
+    queues[size_t(hit.material->type)].push_back(path);
+  }
+};
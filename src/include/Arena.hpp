@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Pool allocator for the objects of a scene. Objects of one type are packed
+// next to each other in chunks that never move, so the pointer create()
+// returns is a stable handle until clear(). Chunks grow geometrically and
+// reserve() sizes one for a whole batch, so a scene of a million objects
+// takes a few dozen allocations instead of a million.
+//
+// clear() destroys every object but keeps the chunks: loading the next
+// scene of a sequence reuses them and allocates nothing if it fits.
+struct Arena {
+  struct Stats {
+    size_t objects = 0;
+    size_t allocations = 0;  // chunks allocated since construction
+    size_t bytesUsed = 0, bytesReserved = 0;
+  };
+
+  Arena() {}
+  Arena(Arena &&) = default;
+  Arena &operator=(Arena &&) = default;
+
+  template <typename T, typename... Args>
+  T *create(Args &&...args) {
+    Pool<T> &pool = poolOf<T>();
+    T *slot = pool.next();
+    T *object = new (slot) T(std::forward<Args>(args)...);
+    pool.chunks[pool.current].size++;
+    return object;
+  }
+
+  // room for `count` more objects of type T in at most one new chunk
+  template <typename T>
+  void reserve(size_t count) {
+    poolOf<T>().reserve(count);
+  }
+
+  // visit every live object of type T, in creation order
+  template <typename T, typename Func>
+  void forEach(Func &&func) const {
+    if (auto pool = findPool<T>())
+      for (const auto &chunk : pool->chunks)
+        for (size_t i = 0; i < chunk.size; i++) func(chunk.data[i]);
+  }
+
+  template <typename T>
+  size_t count() const {
+    auto pool = findPool<T>();
+    return pool ? pool->stats().objects : 0;
+  }
+
+  // destroy every object, the chunks are kept for reuse
+  void clear() {
+    for (auto &pool : pools)
+      if (pool) pool->clear();
+  }
+
+  // destroy every object and free the chunks
+  void release() { pools.clear(); }
+
+  Stats stats() const {
+    Stats res;
+    for (const auto &pool : pools) {
+      if (!pool) continue;
+      Stats s = pool->stats();
+      res.objects += s.objects;
+      res.allocations += s.allocations;
+      res.bytesUsed += s.bytesUsed;
+      res.bytesReserved += s.bytesReserved;
+    }
+    return res;
+  }
+
+ private:
+  // chunks start at a cache line
+  static constexpr size_t chunkAlign = 64;
+  static constexpr size_t minChunkBytes = 4096;
+
+  struct PoolBase {
+    virtual ~PoolBase() = default;
+    virtual void clear() = 0;
+    virtual Stats stats() const = 0;
+  };
+
+  template <typename T>
+  struct Pool : PoolBase {
+    static constexpr size_t align = std::max(chunkAlign, alignof(T));
+
+    struct Chunk {
+      T *data;
+      size_t size, capacity;
+    };
+    std::vector<Chunk> chunks;
+    size_t current = 0;  // first chunk with free slots
+    size_t allocations = 0;
+
+    Pool() {}
+    Pool(const Pool &) = delete;
+    Pool &operator=(const Pool &) = delete;
+    ~Pool() override {
+      clear();
+      for (const Chunk &chunk : chunks)
+        ::operator delete(chunk.data, std::align_val_t(align));
+    }
+
+    // a free slot in chunks[current], allocates a chunk if all are full
+    T *next() {
+      while (current < chunks.size() &&
+             chunks[current].size == chunks[current].capacity)
+        current++;
+      if (current == chunks.size()) {
+        size_t capacity = std::max<size_t>(minChunkBytes / sizeof(T), 1);
+        if (!chunks.empty())
+          capacity = std::max(capacity, 2 * chunks.back().capacity);
+        allocate(capacity);
+      }
+      const Chunk &chunk = chunks[current];
+      return chunk.data + chunk.size;
+    }
+
+    void reserve(size_t count) {
+      size_t room = 0;
+      for (size_t i = current; i < chunks.size(); i++)
+        room += chunks[i].capacity - chunks[i].size;
+      if (room < count) allocate(count - room);
+    }
+
+    void allocate(size_t capacity) {
+      void *data = ::operator new(capacity * sizeof(T), std::align_val_t(align));
+      chunks.push_back({static_cast<T *>(data), 0, capacity});
+      allocations++;
+    }
+
+    void clear() override {
+      for (Chunk &chunk : chunks) {
+        for (size_t i = chunk.size; i > 0; i--) chunk.data[i - 1].~T();
+        chunk.size = 0;
+      }
+      current = 0;
+    }
+
+    Stats stats() const override {
+      Stats res;
+      res.allocations = allocations;
+      for (const Chunk &chunk : chunks) {
+        res.objects += chunk.size;
+        res.bytesUsed += chunk.size * sizeof(T);
+        res.bytesReserved += chunk.capacity * sizeof(T);
+      }
+      return res;
+    }
+  };
+
+  std::vector<std::unique_ptr<PoolBase>> pools;  // indexed by TypeIndex<T>()
+
+  static size_t NextTypeIndex() {
+    static size_t next = 0;
+    return next++;
+  }
+
+  template <typename T>
+  static size_t TypeIndex() {
+    static const size_t index = NextTypeIndex();
+    return index;
+  }
+
+  template <typename T>
+  Pool<T> &poolOf() {
+    size_t index = TypeIndex<T>();
+    if (index >= pools.size()) pools.resize(index + 1);
+    if (!pools[index]) pools[index] = std::make_unique<Pool<T>>();
+    return static_cast<Pool<T> &>(*pools[index]);
+  }
+
+  template <typename T>
+  const Pool<T> *findPool() const {
+    size_t index = TypeIndex<T>();
+    if (index >= pools.size() || !pools[index]) return nullptr;
+    return static_cast<const Pool<T> *>(pools[index].get());
+  }
+};
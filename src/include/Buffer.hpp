@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Contiguous array that either owns its elements or views memory owned by
+// someone else (a MappedFile), so data loaded from a file can be used in
+// place. Only an owning Buffer may be modified; view() drops the owned
+// elements.
+template <typename T>
+struct Buffer {
+  Buffer() {}
+  Buffer(std::vector<T> values) : owned(std::move(values)) {}
+
+  void view(const T *data, size_t size) {
+    owned.clear();
+    owned.shrink_to_fit();
+    viewData = data;
+    viewSize = size;
+  }
+
+  bool isView() const { return viewData != nullptr; }
+
+  const T *data() const { return isView() ? viewData : owned.data(); }
+  size_t size() const { return isView() ? viewSize : owned.size(); }
+  bool empty() const { return size() == 0; }
+
+  const T &operator[](size_t i) const { return data()[i]; }
+  const T *begin() const { return data(); }
+  const T *end() const { return data() + size(); }
+
+  // modifiers, an owning Buffer only (clear() turns a view into one)
+  T &operator[](size_t i) {
+    assert(!isView());
+    return owned[i];
+  }
+  T *begin() {
+    assert(!isView());
+    return owned.data();
+  }
+  T *end() {
+    assert(!isView());
+    return owned.data() + owned.size();
+  }
+  T &back() {
+    assert(!isView());
+    return owned.back();
+  }
+
+  void clear() {
+    owned.clear();
+    viewData = nullptr;
+    viewSize = 0;
+  }
+  void reserve(size_t size) { owned.reserve(size); }
+  void push_back(const T &value) {
+    assert(!isView());
+    owned.push_back(value);
+  }
+
+ private:
+  std::vector<T> owned;
+  const T *viewData = nullptr;
+  size_t viewSize = 0;
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Utils.hpp"
+
+// Hot-path counters, built only with RT_COUNTERS (`xmake f --counters=y`).
+// Every thread counts into a block of its own and the blocks are summed by
+// counters::Collect() once a render is done, so counting never contends
+// for a cache line. Without RT_COUNTERS the RT_COUNT macros expand to
+// nothing, Collect() returns zeros and no counting code is compiled in.
+enum class Counter : uint32_t {
+  BVHNodes,       // nodes visited by BVHTree::traverse
+  SphereTests,    // ray-sphere tests, a SIMD lane counts as one
+  SphereHits,     // tests that hit inside the ray's interval
+  TriangleTests,
+  TriangleHits,
+  Paths,          // camera paths ended, by how:
+  PathsEscaped,   //   left the scene
+  PathsAbsorbed,  //   the material absorbed the ray
+  PathsRoulette,  //   killed by Russian roulette
+  PathsMaxDepth,  //   reached maxDepth
+  MetalScatters,  // Metal::scatter calls
+  MetalAbsorbed,  //   that reflected below the surface
+  ShadowRays,     // next-event estimation
+  ShadowsOccluded,
+  Count
+};
+constexpr size_t CounterCount = size_t(Counter::Count);
+
+inline const char *CounterName(Counter counter) {
+  static const char *names[CounterCount] = {
+      "bvhNodes",      "sphereTests",   "sphereHits",   "triangleTests",
+      "triangleHits",  "pathsEnded",    "pathsEscaped", "pathsAbsorbed",
+      "pathsRoulette", "pathsMaxDepth", "metalScatters", "metalAbsorbed",
+      "shadowRays",    "shadowsOccluded"};
+  return names[size_t(counter)];
+}
+
+// one thread's counts, padded to whole cache lines
+struct alignas(64) CounterBlock {
+  // paths ending after d bounces, the last bin holds the longer ones
+  static constexpr size_t depthBins = 64;
+
+  uint64_t counts[CounterCount] = {};
+  uint64_t depths[depthBins] = {};
+
+  uint64_t operator[](Counter counter) const {
+    return counts[size_t(counter)];
+  }
+
+  void add(const CounterBlock &other) {
+    for (size_t i = 0; i < CounterCount; i++) counts[i] += other.counts[i];
+    for (size_t i = 0; i < depthBins; i++) depths[i] += other.depths[i];
+  }
+};
+
+#ifdef RT_COUNTERS
+constexpr bool CountersEnabled = true;
+
+namespace counters {
+// every block ever handed out, a thread gives its block back when it exits
+// and the next thread reuses it, keeping its counts
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<CounterBlock>> blocks;
+  std::vector<CounterBlock *> unused;
+};
+
+inline Registry &GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+struct ThreadSlot {
+  CounterBlock *block;
+
+  ThreadSlot() {
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (!registry.unused.empty()) {
+      block = registry.unused.back();
+      registry.unused.pop_back();
+    } else {
+      registry.blocks.push_back(std::make_unique<CounterBlock>());
+      block = registry.blocks.back().get();
+    }
+  }
+  ~ThreadSlot() {
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.unused.push_back(block);
+  }
+};
+
+// the calling thread's block, the registry is only locked on first use
+inline CounterBlock &Local() {
+  thread_local CounterBlock *block = nullptr;
+  if (!block) [[unlikely]] {
+    thread_local ThreadSlot slot;
+    block = slot.block;
+  }
+  return *block;
+}
+
+// sum of every thread's counts, call while no thread is counting
+inline CounterBlock Collect() {
+  Registry &registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  CounterBlock res;
+  for (const auto &block : registry.blocks) res.add(*block);
+  return res;
+}
+
+// zero every thread's counts, call while no thread is counting
+inline void Reset() {
+  Registry &registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  for (auto &block : registry.blocks) *block = CounterBlock();
+}
+}  // namespace counters
+
+#define RT_COUNT(counter, n) \
+  (counters::Local().counts[size_t(Counter::counter)] += (n))
+// a path ending the way `reason` (one of the Paths* counters) after
+// `bounces` bounces
+#define RT_COUNT_PATH(reason, bounces)                             \
+  do {                                                             \
+    CounterBlock &local = counters::Local();                       \
+    local.counts[size_t(Counter::Paths)]++;                        \
+    local.counts[size_t(Counter::reason)]++;                       \
+    local.depths[std::min<size_t>((bounces),                       \
+                                  CounterBlock::depthBins - 1)]++; \
+  } while (0)
+#else
+constexpr bool CountersEnabled = false;
+
+namespace counters {
+inline CounterBlock Collect() { return {}; }
+inline void Reset() {}
+}  // namespace counters
+
+// sizeof keeps the arguments used without evaluating them
+#define RT_COUNT(counter, n) ((void)sizeof(n))
+#define RT_COUNT_PATH(reason, bounces) ((void)sizeof(bounces))
+#endif
+
+// the counters with the rates derived from them
+inline void PrintCounters(const CounterBlock &c) {
+  auto ratio = [](uint64_t a, uint64_t b) { return b ? double(a) / b : 0.0; };
+  print("counters:");
+  for (size_t i = 0; i < CounterCount; i++)
+    print(" ", CounterName(Counter(i)), c.counts[i]);
+  print("  sphere hit rate", ratio(c[Counter::SphereHits],
+                                   c[Counter::SphereTests]),
+        ", triangle hit rate",
+        ratio(c[Counter::TriangleHits], c[Counter::TriangleTests]),
+        ", metal absorption rate",
+        ratio(c[Counter::MetalAbsorbed], c[Counter::MetalScatters]),
+        ", shadow ray occlusion rate",
+        ratio(c[Counter::ShadowsOccluded], c[Counter::ShadowRays]));
+  // the bounce histogram up to its last non-empty bin
+  size_t last = 0;
+  for (size_t d = 0; d < CounterBlock::depthBins; d++)
+    if (c.depths[d]) last = d;
+  std::string histogram;
+  for (size_t d = 0; d <= last; d++)
+    histogram += (d ? " " : "") + std::to_string(c.depths[d]);
+  print("  paths ending after 0, 1, 2, ... bounces:", histogram);
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Small JSON reader for scene files: objects (key order kept), arrays,
+// numbers, strings, true / false / null. Errors throw std::runtime_error
+// with the line they were found on.
+struct JsonValue {
+  enum class Type { Null, Bool, Number, String, Array, Object };
+
+  Type type = Type::Null;
+  bool boolean = false;
+  double number = 0;
+  std::string string;
+  std::vector<JsonValue> items;   // array elements or object values
+  std::vector<std::string> keys;  // object keys, same order as items
+
+  bool isObject() const { return type == Type::Object; }
+  bool isArray() const { return type == Type::Array; }
+
+  // member of an object, nullptr if missing
+  const JsonValue *find(const std::string &key) const {
+    for (size_t i = 0; i < keys.size(); i++)
+      if (keys[i] == key) return &items[i];
+    return nullptr;
+  }
+
+  const JsonValue &at(const std::string &key) const {
+    auto value = find(key);
+    if (!value) throw std::runtime_error("json: missing \"" + key + "\"");
+    return *value;
+  }
+
+  double asNumber() const {
+    if (type != Type::Number) throw std::runtime_error("json: number expected");
+    return number;
+  }
+  const std::string &asString() const {
+    if (type != Type::String) throw std::runtime_error("json: string expected");
+    return string;
+  }
+  bool asBool() const {
+    if (type != Type::Bool) throw std::runtime_error("json: boolean expected");
+    return boolean;
+  }
+  const std::vector<JsonValue> &asArray() const {
+    if (type != Type::Array) throw std::runtime_error("json: array expected");
+    return items;
+  }
+
+  // number member with a default
+  double get(const std::string &key, double fallback) const {
+    auto value = find(key);
+    return value ? value->asNumber() : fallback;
+  }
+
+  static JsonValue Parse(const std::string &text) {
+    Parser parser{text.data(), text.data() + text.size(), text.data()};
+    JsonValue value = parser.value();
+    parser.skipSpace();
+    if (parser.pos != parser.end) parser.fail("trailing characters");
+    return value;
+  }
+
+ private:
+  struct Parser {
+    const char *pos, *end, *begin;
+
+    [[noreturn]] void fail(const std::string &message) {
+      int line = 1;
+      for (const char *p = begin; p < pos && p < end; p++) line += *p == '\n';
+      throw std::runtime_error("json: line " + std::to_string(line) + ": " +
+                               message);
+    }
+
+    void skipSpace() {
+      while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' ||
+                           *pos == '\r'))
+        pos++;
+    }
+
+    bool consume(char c) {
+      skipSpace();
+      if (pos < end && *pos == c) {
+        pos++;
+        return true;
+      }
+      return false;
+    }
+
+    void expect(char c) {
+      if (!consume(c)) fail(std::string("'") + c + "' expected");
+    }
+
+    bool literal(const char *word) {
+      size_t n = std::char_traits<char>::length(word);
+      if (size_t(end - pos) < n || std::string_view(pos, n) != word)
+        return false;
+      pos += n;
+      return true;
+    }
+
+    JsonValue value() {
+      skipSpace();
+      if (pos >= end) fail("unexpected end of input");
+      JsonValue res;
+      if (*pos == '{') {
+        pos++;
+        res.type = Type::Object;
+        if (consume('}')) return res;
+        do {
+          skipSpace();
+          res.keys.push_back(stringValue());
+          expect(':');
+          res.items.push_back(value());
+        } while (consume(','));
+        expect('}');
+      } else if (*pos == '[') {
+        pos++;
+        res.type = Type::Array;
+        if (consume(']')) return res;
+        do {
+          res.items.push_back(value());
+        } while (consume(','));
+        expect(']');
+      } else if (*pos == '"') {
+        res.type = Type::String;
+        res.string = stringValue();
+      } else if (literal("true")) {
+        res.type = Type::Bool;
+        res.boolean = true;
+      } else if (literal("false")) {
+        res.type = Type::Bool;
+      } else if (literal("null")) {
+        res.type = Type::Null;
+      } else {
+        res.type = Type::Number;
+        // from_chars doesn't take a leading '+', JSON doesn't either
+        auto [next, error] = std::from_chars(pos, end, res.number);
+        if (error != std::errc()) fail("unexpected character");
+        pos = next;
+      }
+      return res;
+    }
+
+    std::string stringValue() {
+      if (pos >= end || *pos != '"') fail("string expected");
+      pos++;
+      std::string res;
+      while (pos < end && *pos != '"') {
+        char c = *pos++;
+        if (c != '\\') {
+          res += c;
+          continue;
+        }
+        if (pos >= end) break;
+        char e = *pos++;
+        switch (e) {
+          case 'n': res += '\n'; break;
+          case 't': res += '\t'; break;
+          case 'r': res += '\r'; break;
+          case 'b': res += '\b'; break;
+          case 'f': res += '\f'; break;
+          case 'u': {
+            if (end - pos < 4) fail("bad \\u escape");
+            unsigned code = 0;
+            auto [ptr, ec] = std::from_chars(pos, pos + 4, code, 16);
+            if (ec != std::errc() || ptr != pos + 4) fail("bad \\u escape");
+            pos += 4;
+            // scene files are ASCII in practice, encode the BMP as UTF-8
+            if (code < 0x80) {
+              res += char(code);
+            } else if (code < 0x800) {
+              res += char(0xc0 | (code >> 6));
+              res += char(0x80 | (code & 0x3f));
+            } else {
+              res += char(0xe0 | (code >> 12));
+              res += char(0x80 | ((code >> 6) & 0x3f));
+              res += char(0x80 | (code & 0x3f));
+            }
+            break;
+          }
+          default: res += e;  // \" \\ \/
+        }
+      }
+      if (pos >= end) fail("unterminated string");
+      pos++;
+      return res;
+    }
+  };
+};
+
+// text as a JSON string literal, quotes included
+inline std::string JsonQuote(std::string_view text) {
+  static constexpr char hex[] = "0123456789abcdef";
+  std::string res = "\"";
+  for (char ch : text) {
+    if (ch == '"' || ch == '\\') {
+      res += '\\';
+      res += ch;
+    } else if (ch == '\n') {
+      res += "\\n";
+    } else if (ch == '\t') {
+      res += "\\t";
+    } else if (ch == '\r') {
+      res += "\\r";
+    } else if (static_cast<unsigned char>(ch) < 0x20) {
+      res += "\\u00";
+      res += hex[ch >> 4];
+      res += hex[ch & 15];
+    } else {
+      res += ch;
+    }
+  }
+  return res + '"';
+}
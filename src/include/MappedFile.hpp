@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A whole file mapped into memory. open() maps an existing file, create()
+// makes (or truncates) one of the given size and maps it writable.
+struct MappedFile {
+  void *data = nullptr;
+  size_t size = 0;
+
+  MappedFile() {}
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() { close(); }
+
+  bool open(const std::string &path, bool writable = false) {
+    return map(path, 0, writable, false);
+  }
+
+  bool create(const std::string &path, size_t fileSize) {
+    return map(path, fileSize, true, true);
+  }
+
+  // write dirty pages back to the file
+  bool flush() {
+    if (!data) return false;
+#ifdef _WIN32
+    return FlushViewOfFile(data, 0) && FlushFileBuffers(file);
+#else
+    return msync(data, size, MS_SYNC) == 0;
+#endif
+  }
+
+  // drop the pages of [offset, offset + length) of a read-only mapping from
+  // the process, they are read again (usually from the page cache) if
+  // touched later. Lets a streaming reader keep its resident size bounded.
+  void release(size_t offset, size_t length) {
+#ifndef _WIN32
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t begin = (offset + page - 1) / page * page;
+    size_t end = std::min(offset + length, size) / page * page;
+    if (data && begin < end)
+      madvise(static_cast<char *>(data) + begin, end - begin, MADV_DONTNEED);
+#endif
+  }
+
+  void close() {
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (data) munmap(data, size);
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+#endif
+    data = nullptr;
+    size = 0;
+  }
+
+ private:
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#else
+  int fd = -1;
+#endif
+
+  bool map(const std::string &path, size_t fileSize, bool writable,
+           bool truncate) {
+    close();
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ | (writable ? GENERIC_WRITE : 0),
+                       FILE_SHARE_READ, nullptr,
+                       truncate ? CREATE_ALWAYS : OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER length;
+    if (truncate) {
+      length.QuadPart = fileSize;
+    } else if (!GetFileSizeEx(file, &length)) {
+      close();
+      return false;
+    }
+    size = length.QuadPart;
+    if (size == 0) return true;
+    mapping = CreateFileMappingA(file, nullptr,
+                                 writable ? PAGE_READWRITE : PAGE_READONLY,
+                                 length.HighPart, length.LowPart, nullptr);
+    if (mapping)
+      data = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+                           0, 0, 0);
+#else
+    fd = ::open(path.c_str(),
+                writable ? O_RDWR | (truncate ? O_CREAT | O_TRUNC : 0)
+                         : O_RDONLY,
+                0644);
+    if (fd < 0) return false;
+    if (truncate) {
+      if (ftruncate(fd, fileSize) != 0) {
+        close();
+        return false;
+      }
+      size = fileSize;
+    } else {
+      struct stat info;
+      if (fstat(fd, &info) != 0) {
+        close();
+        return false;
+      }
+      size = info.st_size;
+    }
+    if (size == 0) return true;
+    void *ptr = mmap(nullptr, size, PROT_READ | (writable ? PROT_WRITE : 0),
+                     MAP_SHARED, fd, 0);
+    data = ptr == MAP_FAILED ? nullptr : ptr;
+#endif
+    if (!data) {
+      close();
+      return false;
+    }
+    return true;
+  }
+};
@@ -4,6 +4,9 @@
 #include <limits>
 #include <algorithm>
 
+#include "Precision.hpp"
+#include "Random.hpp"
+
 constexpr const mfloat PI = 3.1415927f;
 constexpr const mfloat INF = std::numeric_limits<mfloat>().infinity();
 
@@ -23,15 +26,17 @@ T saturate(T x) {
 inline mfloat Deg2Rad(mfloat degrees) { return degrees * PI / 180; }
 
 // rand float in [0, 1)
+// only meant for scene setup, render code takes an explicit RNG. Drawn in
+// double whatever mfloat is, so float and double builds get the same scene.
 inline mfloat RandFloat() {
-  static std::uniform_real_distribution<mfloat> distribution(0, 1);
-  static std::mt19937 generator;
-  return distribution(generator);
+  static std::uniform_real_distribution<double> distribution(0, 1);
+  thread_local std::mt19937 generator;
+  return mfloat(distribution(generator));
 }
 
 // rand float in [min, max)
 inline mfloat RandFloat(mfloat min, mfloat max) {
-  std::uniform_real_distribution<mfloat> distribution(min, max);
-  static std::mt19937 generator;
-  return distribution(generator);
+  std::uniform_real_distribution<double> distribution(min, max);
+  thread_local std::mt19937 generator;
+  return mfloat(distribution(generator));
 }
\ No newline at end of file
@@ -0,0 +1,9 @@
+#pragma once
+
+// Floating point type of the renderer. A build target picks it with a
+// define: RT_FLOAT32 renders in single precision, the default is double.
+#ifdef RT_FLOAT32
+using mfloat = float;
+#else
+using mfloat = double;
+#endif
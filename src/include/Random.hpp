@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "Precision.hpp"
+
+// SplitMix64 finalizer, turns nearby integers (seed, pixel index, ...) into
+// well distributed 64-bit values
+constexpr uint64_t MixBits(uint64_t v) {
+  v ^= v >> 30;
+  v *= 0xbf58476d1ce4e5b9ULL;
+  v ^= v >> 27;
+  v *= 0x94d049bb133111ebULL;
+  v ^= v >> 31;
+  return v;
+}
+
+// PCG32 generator (https://www.pcg-random.org)
+// 16 bytes of state, cheap to create one per thread or per pixel, so no
+// generator is ever shared between threads
+struct RNG {
+  uint64_t state, inc;
+
+  RNG() { seed(0); }
+  RNG(uint64_t seedValue, uint64_t stream = 0) { seed(seedValue, stream); }
+
+  void seed(uint64_t seedValue, uint64_t stream = 0) {
+    state = 0;
+    inc = (MixBits(stream) << 1) | 1;
+    nextUInt();
+    state += MixBits(seedValue);
+    nextUInt();
+  }
+
+  uint32_t nextUInt() {
+    uint64_t old = state;
+    state = old * 0x5851f42d4c957f2dULL + inc;
+    uint32_t xorShifted = uint32_t(((old >> 18) ^ old) >> 27);
+    uint32_t rot = uint32_t(old >> 59);
+    return (xorShifted >> rot) | (xorShifted << ((-rot) & 31));
+  }
+
+  // rand float in [0, 1)
+  mfloat nextFloat() {
+    constexpr mfloat oneMinusEpsilon =
+        1 - std::numeric_limits<mfloat>::epsilon() / 2;
+    return std::min(mfloat(nextUInt() * 0x1p-32), oneMinusEpsilon);
+  }
+
+  // rand float in [min, max)
+  mfloat nextFloat(mfloat min, mfloat max) {
+    return min + (max - min) * nextFloat();
+  }
+};
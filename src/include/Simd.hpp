@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+// register width of the instruction set this translation unit targets
+#if defined(__AVX512F__)
+constexpr size_t SimdBytes = 64;
+#elif defined(__AVX2__)
+constexpr size_t SimdBytes = 32;
+#else
+constexpr size_t SimdBytes = 16;
+#endif
+
+// lanes per pack, at least 4 so that SSE-only builds still get wide leaves
+template <typename T>
+constexpr size_t SimdWidth = std::max<size_t>(SimdBytes / sizeof(T), 4);
+
+// Pack<T, W>: W lanes of T with the few operations the intersection kernels
+// need. The generic version is a plain loop the compiler auto-vectorizes,
+// AVX2 / AVX-512 builds get intrinsics specializations below.
+template <typename T, size_t W>
+struct Pack {
+  T v[W];
+
+  struct Mask {
+    bool m[W];
+    friend Mask operator&(const Mask &a, const Mask &b) {
+      Mask res;
+#pragma omp simd
+      for (size_t i = 0; i < W; i++) res.m[i] = a.m[i] && b.m[i];
+      return res;
+    }
+    friend Mask operator|(const Mask &a, const Mask &b) {
+      Mask res;
+#pragma omp simd
+      for (size_t i = 0; i < W; i++) res.m[i] = a.m[i] || b.m[i];
+      return res;
+    }
+  };
+
+  static Pack load(const T *p) {
+    Pack res;
+#pragma omp simd
+    for (size_t i = 0; i < W; i++) res.v[i] = p[i];
+    return res;
+  }
+
+  static Pack broadcast(T x) {
+    Pack res;
+#pragma omp simd
+    for (size_t i = 0; i < W; i++) res.v[i] = x;
+    return res;
+  }
+
+  void store(T *p) const {
+#pragma omp simd
+    for (size_t i = 0; i < W; i++) p[i] = v[i];
+  }
+
+#define PACK_BINARY_OP(op)                                 \
+  friend Pack operator op(const Pack &a, const Pack &b) {  \
+    Pack res;                                              \
+    _Pragma("omp simd") for (size_t i = 0; i < W; i++)     \
+        res.v[i] = a.v[i] op b.v[i];                       \
+    return res;                                            \
+  }
+  PACK_BINARY_OP(+)
+  PACK_BINARY_OP(-)
+  PACK_BINARY_OP(*)
+  PACK_BINARY_OP(/)
+#undef PACK_BINARY_OP
+
+#define PACK_COMPARE_OP(op)                                \
+  friend Mask operator op(const Pack &a, const Pack &b) {  \
+    Mask res;                                              \
+    _Pragma("omp simd") for (size_t i = 0; i < W; i++)     \
+        res.m[i] = a.v[i] op b.v[i];                       \
+    return res;                                            \
+  }
+  PACK_COMPARE_OP(<)
+  PACK_COMPARE_OP(<=)
+  PACK_COMPARE_OP(>)
+  PACK_COMPARE_OP(>=)
+#undef PACK_COMPARE_OP
+
+  friend Pack sqrt(const Pack &a) {
+    Pack res;
+#pragma omp simd
+    for (size_t i = 0; i < W; i++) res.v[i] = std::sqrt(a.v[i]);
+    return res;
+  }
+
+  friend Pack max(const Pack &a, const Pack &b) {
+    Pack res;
+#pragma omp simd
+    for (size_t i = 0; i < W; i++) res.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+    return res;
+  }
+
+  friend Pack min(const Pack &a, const Pack &b) {
+    Pack res;
+#pragma omp simd
+    for (size_t i = 0; i < W; i++) res.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i];
+    return res;
+  }
+
+  // magnitude of a with the sign bit of b
+  friend Pack copysign(const Pack &a, const Pack &b) {
+    Pack res;
+#pragma omp simd
+    for (size_t i = 0; i < W; i++) res.v[i] = std::copysign(a.v[i], b.v[i]);
+    return res;
+  }
+
+  // mask ? a : b, lane-wise
+  friend Pack select(const Mask &mask, const Pack &a, const Pack &b) {
+    Pack res;
+#pragma omp simd
+    for (size_t i = 0; i < W; i++) res.v[i] = mask.m[i] ? a.v[i] : b.v[i];
+    return res;
+  }
+
+  friend bool any(const Mask &mask) {
+    bool res = false;
+    for (size_t i = 0; i < W; i++) res |= mask.m[i];
+    return res;
+  }
+};
+
+// intrinsics specializations, one per (type, width) the build can target.
+// FLOAT: scalar type, W: lanes, V: register type, M: mask type, P: the
+// intrinsics suffix (pd / ps)
+#define PACK_AVX_COMMON(FLOAT, W, V, PREFIX, P)                               \
+  V v;                                                                        \
+  static Pack load(const FLOAT *p) { return {PREFIX##_loadu_##P(p)}; }        \
+  static Pack broadcast(FLOAT x) { return {PREFIX##_set1_##P(x)}; }           \
+  void store(FLOAT *p) const { PREFIX##_storeu_##P(p, v); }                   \
+  friend Pack operator+(Pack a, Pack b) { return {PREFIX##_add_##P(a.v, b.v)}; } \
+  friend Pack operator-(Pack a, Pack b) { return {PREFIX##_sub_##P(a.v, b.v)}; } \
+  friend Pack operator*(Pack a, Pack b) { return {PREFIX##_mul_##P(a.v, b.v)}; } \
+  friend Pack operator/(Pack a, Pack b) { return {PREFIX##_div_##P(a.v, b.v)}; } \
+  friend Pack sqrt(Pack a) { return {PREFIX##_sqrt_##P(a.v)}; }               \
+  friend Pack max(Pack a, Pack b) { return {PREFIX##_max_##P(a.v, b.v)}; }    \
+  friend Pack min(Pack a, Pack b) { return {PREFIX##_min_##P(a.v, b.v)}; }
+
+#if defined(__AVX512F__)
+#define PACK_AVX512(FLOAT, W, V, MASK, P)                                      \
+  template <>                                                                  \
+  struct Pack<FLOAT, W> {                                                      \
+    struct Mask {                                                              \
+      MASK m;                                                                  \
+      friend Mask operator&(Mask a, Mask b) { return {MASK(a.m & b.m)}; }      \
+      friend Mask operator|(Mask a, Mask b) { return {MASK(a.m | b.m)}; }      \
+    };                                                                         \
+    PACK_AVX_COMMON(FLOAT, W, V, _mm512, P)                                    \
+    friend Mask operator<(Pack a, Pack b) {                                    \
+      return {_mm512_cmp_##P##_mask(a.v, b.v, _CMP_LT_OQ)};                    \
+    }                                                                          \
+    friend Mask operator<=(Pack a, Pack b) {                                   \
+      return {_mm512_cmp_##P##_mask(a.v, b.v, _CMP_LE_OQ)};                    \
+    }                                                                          \
+    friend Mask operator>(Pack a, Pack b) {                                    \
+      return {_mm512_cmp_##P##_mask(a.v, b.v, _CMP_GT_OQ)};                    \
+    }                                                                          \
+    friend Mask operator>=(Pack a, Pack b) {                                   \
+      return {_mm512_cmp_##P##_mask(a.v, b.v, _CMP_GE_OQ)};                    \
+    }                                                                          \
+    friend Pack select(Mask mask, Pack a, Pack b) {                            \
+      return {_mm512_mask_blend_##P(mask.m, b.v, a.v)};                        \
+    }                                                                          \
+    friend Pack copysign(Pack a, Pack b) {                                     \
+      __m512i sign = _mm512_cast##P##_si512(_mm512_set1_##P(FLOAT(-0.0)));     \
+      __m512i bits = _mm512_or_si512(                                          \
+          _mm512_andnot_si512(sign, _mm512_cast##P##_si512(a.v)),              \
+          _mm512_and_si512(sign, _mm512_cast##P##_si512(b.v)));                \
+      return {_mm512_castsi512_##P(bits)};                                     \
+    }                                                                          \
+    friend bool any(Mask mask) { return mask.m != 0; }                         \
+  };
+PACK_AVX512(double, 8, __m512d, __mmask8, pd)
+PACK_AVX512(float, 16, __m512, __mmask16, ps)
+#undef PACK_AVX512
+#endif
+
+#if defined(__AVX2__)
+#define PACK_AVX2(FLOAT, W, V, P)                                              \
+  template <>                                                                  \
+  struct Pack<FLOAT, W> {                                                      \
+    struct Mask {                                                              \
+      V m;                                                                     \
+      friend Mask operator&(Mask a, Mask b) {                                  \
+        return {_mm256_and_##P(a.m, b.m)};                                     \
+      }                                                                        \
+      friend Mask operator|(Mask a, Mask b) {                                  \
+        return {_mm256_or_##P(a.m, b.m)};                                      \
+      }                                                                        \
+    };                                                                         \
+    PACK_AVX_COMMON(FLOAT, W, V, _mm256, P)                                    \
+    friend Mask operator<(Pack a, Pack b) {                                    \
+      return {_mm256_cmp_##P(a.v, b.v, _CMP_LT_OQ)};                           \
+    }                                                                          \
+    friend Mask operator<=(Pack a, Pack b) {                                   \
+      return {_mm256_cmp_##P(a.v, b.v, _CMP_LE_OQ)};                           \
+    }                                                                          \
+    friend Mask operator>(Pack a, Pack b) {                                    \
+      return {_mm256_cmp_##P(a.v, b.v, _CMP_GT_OQ)};                           \
+    }                                                                          \
+    friend Mask operator>=(Pack a, Pack b) {                                   \
+      return {_mm256_cmp_##P(a.v, b.v, _CMP_GE_OQ)};                           \
+    }                                                                          \
+    friend Pack select(Mask mask, Pack a, Pack b) {                            \
+      return {_mm256_blendv_##P(b.v, a.v, mask.m)};                            \
+    }                                                                          \
+    friend Pack copysign(Pack a, Pack b) {                                     \
+      V sign = _mm256_set1_##P(FLOAT(-0.0));                                   \
+      return {_mm256_or_##P(_mm256_andnot_##P(sign, a.v),                      \
+                            _mm256_and_##P(sign, b.v))};                       \
+    }                                                                          \
+    friend bool any(Mask mask) { return _mm256_movemask_##P(mask.m) != 0; }    \
+  };
+PACK_AVX2(double, 4, __m256d, pd)
+PACK_AVX2(float, 8, __m256, ps)
+#undef PACK_AVX2
+#endif
+
+#undef PACK_AVX_COMMON
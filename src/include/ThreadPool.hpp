@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads with one task queue per worker.
+// run() deals the tasks out in contiguous chunks (so neighbouring tasks stay
+// on one core), every worker pops from the front of its own queue and, once
+// that is empty, steals from the back of the others.
+struct WorkStealingPool {
+  // threadCount <= 0: one thread per hardware thread
+  WorkStealingPool(int threadCount = 0) {
+    if (threadCount <= 0)
+      threadCount = std::max(1u, std::thread::hardware_concurrency());
+    queueCount = threadCount;
+    queues = std::make_unique<Queue[]>(threadCount);
+    // the thread calling run() works as worker 0
+    for (int i = 1; i < threadCount; i++)
+      workers.emplace_back([this, i] { workerLoop(i); });
+  }
+
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) worker.join();
+  }
+
+  int size() const { return queueCount; }
+
+  // tasks taken from another worker's queue since the pool was created
+  size_t steals() const { return stealCount.load(); }
+
+  // call func(task, workerIndex) for every task in [0, taskCount), returns
+  // when all of them are done
+  void run(size_t taskCount, const std::function<void(size_t, int)> &func) {
+    for (int i = 0; i < queueCount; i++) {
+      std::lock_guard<std::mutex> lock(queues[i].mutex);
+      size_t begin = taskCount * i / queueCount;
+      size_t end = taskCount * (i + 1) / queueCount;
+      for (size_t task = begin; task < end; task++)
+        queues[i].tasks.push_back(task);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job = &func;
+      busyWorkers = queueCount - 1;
+      generation++;
+    }
+    wake.notify_all();
+
+    process(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busyWorkers == 0; });
+    job = nullptr;
+  }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+  };
+
+  int queueCount;
+  std::unique_ptr<Queue[]> queues;
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable wake, done;
+  const std::function<void(size_t, int)> *job = nullptr;
+  size_t generation = 0;
+  int busyWorkers = 0;
+  bool stopping = false;
+  std::atomic<size_t> stealCount{0};
+
+  void workerLoop(int index) {
+    size_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+      }
+      process(index);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busyWorkers == 0) done.notify_all();
+      }
+    }
+  }
+
+  void process(int index) {
+    size_t task;
+    while (pop(index, task) || steal(index, task)) (*job)(task, index);
+  }
+
+  bool pop(int index, size_t &task) {
+    Queue &queue = queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) return false;
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+  }
+
+  bool steal(int index, size_t &task) {
+    for (int k = 1; k < queueCount; k++) {
+      Queue &victim = queues[(index + k) % queueCount];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (victim.tasks.empty()) continue;
+      task = victim.tasks.back();
+      victim.tasks.pop_back();
+      stealCount++;
+      return true;
+    }
+    return false;
+  }
+};
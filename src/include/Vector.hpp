@@ -5,6 +5,7 @@
 #include <cstring>
 #include <exception>
 #include <string>
+#include <type_traits>
 
 #include "Utils.hpp"
 #include "MathUtils.hpp"
@@ -14,20 +15,47 @@ namespace VectorDef {
 template <size_t n>
 concept IsVectorDim = n > 1;
 
+// With RT_PADDED_VECTORS, 3- and 4-component floating point vectors are
+// stored in 4 lanes aligned to their size, so every element-wise loop below
+// is a single SSE / AVX / NEON instruction. Constructors zero the padding
+// lane, element-wise ops may leave anything in it, only the first n lanes
+// are ever read. Off by default: bench/vector.cpp shows the padded layout
+// losing to the compiler vectorizing plain 3-lane code across loop
+// iterations.
+#ifdef RT_PADDED_VECTORS
+template <typename T, size_t n>
+constexpr size_t VectorLanes =
+    std::is_floating_point_v<T> && (n == 3 || n == 4) ? 4 : n;
+
+template <typename T, size_t n>
+constexpr size_t VectorAlign =
+    VectorLanes<T, n> == 4 ? 4 * sizeof(T) : alignof(T);
+#else
+template <typename T, size_t n>
+constexpr size_t VectorLanes = n;
+
+template <typename T, size_t n>
+constexpr size_t VectorAlign = alignof(T);
+#endif
+
+template <typename T, size_t n>
+struct Vector;
+
 template <typename T, size_t n>
   requires IsVectorDim<n>
 struct VectorBase {
-  std::array<T, n> val;
+  static constexpr size_t lanes = VectorLanes<T, n>;
+  alignas(VectorAlign<T, n>) std::array<T, lanes> val;
 
 #pragma region Constructors and basic operators
   // 空构造函数
-  VectorBase() {}
+  constexpr VectorBase() { clearPadding(); }
 
-  // 复制构造函数
-  VectorBase(const VectorBase<T, n> &v) { val = v.val; }
+  // 复制构造函数，保持平凡可复制，向量可以放在寄存器里传递
+  constexpr VectorBase(const VectorBase<T, n> &v) = default;
 
   // 移动构造函数
-  VectorBase(VectorBase<T, n> &&v) : val(std::move(v.val)) {}
+  constexpr VectorBase(VectorBase<T, n> &&v) = default;
 
   // 显式使用默认的复制赋值运算符
   VectorBase<T, n> &operator=(const VectorBase<T, n> &v) = default;
@@ -37,25 +65,31 @@ struct VectorBase {
 
   // 维度不相同的向量的复制构造函数
   template <typename T2, size_t n2>
-  VectorBase(const VectorBase<T2, n2> &v) {
+  constexpr VectorBase(const VectorBase<T2, n2> &v) {
     size_t len = std::min(n, n2);
     for (size_t i = 0; i < len; i++) val[i] = static_cast<T>(v.val[i]);
+    clearPadding();
   }
 
   // 构造函数，参数为向量的值
   template <typename T0, typename T1, typename... Ts>
-  VectorBase(T0 arg0, T1 arg1, Ts... args) {
+  constexpr VectorBase(T0 arg0, T1 arg1, Ts... args) {
     static_assert(sizeof...(args) == n - 2,
                   "Number of arguments does not match type!");
     readVals(
         {static_cast<T>(arg0), static_cast<T>(arg1), static_cast<T>(args)...});
+    clearPadding();
   }
 
-  void readVals(std::initializer_list<T> vals) {
+  constexpr void readVals(std::initializer_list<T> vals) {
     size_t i = 0;
     for (auto v : vals) val[i++] = v;
   }
 
+  // 不带边界检查的下标访问，用于热点路径
+  constexpr T &get(size_t i) { return val[i]; }
+  constexpr const T &get(size_t i) const { return val[i]; }
+
   // 带边界检查的下标访问
   T &operator[](int i) {
     if (i < 0 || i >= n) throw std::out_of_range("Index out of range!");
@@ -78,11 +112,21 @@ struct VectorBase {
     return res;
   }
 
-  static VectorBase<T, n> random(T min, T max) {
-    VectorBase<T, n> res;
+  constexpr void clearPadding() {
+    for (size_t i = n; i < lanes; i++) val[i] = 0;
+  }
+
+  static Vector<T, n> random(T min, T max) {
+    Vector<T, n> res;
     for (size_t i = 0; i < n; i++) res.val[i] = RandFloat(min, max);
     return res;
   }
+
+  static Vector<T, n> random(T min, T max, RNG &rng) {
+    Vector<T, n> res;
+    for (size_t i = 0; i < n; i++) res.val[i] = rng.nextFloat(min, max);
+    return res;
+  }
 #pragma endregion
 
 #pragma region I/O functions
@@ -106,124 +150,132 @@ struct VectorBase {
 #pragma endregion
 
 #pragma region Math functions
+  // lanes an element-wise op with a VectorBase<T2, n> covers
+  template <typename T2>
+  static constexpr size_t lanesWith = std::min(lanes, VectorLanes<T2, n>);
+
   template <typename T2>
     requires std::is_arithmetic_v<T2>
-  VectorBase<T, n> operator+(T2 x) const {
-    VectorBase<T, n> res;
-    for (size_t i = 0; i < n; i++) res.val[i] = val[i] + x;
+  Vector<T, n> operator+(T2 x) const {
+    Vector<T, n> res;
+    for (size_t i = 0; i < lanes; i++) res.val[i] = val[i] + x;
     return res;
   }
 
   template <typename T2>
   auto operator+(const VectorBase<T2, n> &x) const
-      -> VectorBase<decltype(std::declval<T>() * std::declval<T2>()), n> {
-    VectorBase<decltype(std::declval<T>() * std::declval<T2>()), n> res;
-    for (size_t i = 0; i < n; i++) res.val[i] = val[i] + x.val[i];
+      -> Vector<decltype(std::declval<T>() * std::declval<T2>()), n> {
+    Vector<decltype(std::declval<T>() * std::declval<T2>()), n> res;
+    for (size_t i = 0; i < lanesWith<T2>; i++)
+      res.val[i] = val[i] + x.val[i];
     return res;
   }
 
   template <typename T2>
     requires std::is_arithmetic_v<T2>
-  VectorBase<T, n> operator-(T2 x) const {
-    VectorBase<T, n> res;
-    for (size_t i = 0; i < n; i++) res.val[i] = val[i] - x;
+  Vector<T, n> operator-(T2 x) const {
+    Vector<T, n> res;
+    for (size_t i = 0; i < lanes; i++) res.val[i] = val[i] - x;
     return res;
   }
 
   template <typename T2>
   auto operator-(const VectorBase<T2, n> &x) const
-      -> VectorBase<decltype(std::declval<T>() * std::declval<T2>()), n> {
-    VectorBase<decltype(std::declval<T>() * std::declval<T2>()), n> res;
-    for (size_t i = 0; i < n; i++) res.val[i] = val[i] - x.val[i];
+      -> Vector<decltype(std::declval<T>() * std::declval<T2>()), n> {
+    Vector<decltype(std::declval<T>() * std::declval<T2>()), n> res;
+    for (size_t i = 0; i < lanesWith<T2>; i++)
+      res.val[i] = val[i] - x.val[i];
     return res;
   }
 
   // multiply by a scalar
   template <typename T2>
     requires std::is_arithmetic_v<T2>
-  VectorBase<T, n> operator*(T2 x) const {
-    VectorBase<T, n> res;
-    for (size_t i = 0; i < n; i++) res.val[i] = val[i] * x;
+  Vector<T, n> operator*(T2 x) const {
+    Vector<T, n> res;
+    for (size_t i = 0; i < lanes; i++) res.val[i] = val[i] * x;
     return res;
   }
 
   // multiply by a vector element-wise
   template <typename T2>
   auto operator*(const VectorBase<T2, n> &x) const
-      -> VectorBase<decltype(std::declval<T>() * std::declval<T2>()), n> {
-    VectorBase<decltype(std::declval<T>() * std::declval<T2>()), n> res;
-    for (size_t i = 0; i < n; i++) res.val[i] = val[i] * x.val[i];
+      -> Vector<decltype(std::declval<T>() * std::declval<T2>()), n> {
+    Vector<decltype(std::declval<T>() * std::declval<T2>()), n> res;
+    for (size_t i = 0; i < lanesWith<T2>; i++)
+      res.val[i] = val[i] * x.val[i];
     return res;
   }
 
   template <typename T2>
     requires std::is_arithmetic_v<T2>
-  VectorBase<T, n> operator/(T2 x) const {
-    VectorBase<T, n> res;
-    for (size_t i = 0; i < n; i++) res.val[i] = val[i] / x;
+  Vector<T, n> operator/(T2 x) const {
+    Vector<T, n> res;
+    for (size_t i = 0; i < lanes; i++) res.val[i] = val[i] / x;
     return res;
   }
 
   // divide by a vector element-wise
   template <typename T2>
   auto operator/(const VectorBase<T2, n> &x) const
-      -> VectorBase<decltype(std::declval<T>() / std::declval<T2>()), n> {
-    VectorBase<decltype(std::declval<T>() / std::declval<T2>()), n> res;
-    for (size_t i = 0; i < n; i++) res.val[i] = val[i] / x.val[i];
+      -> Vector<decltype(std::declval<T>() / std::declval<T2>()), n> {
+    Vector<decltype(std::declval<T>() / std::declval<T2>()), n> res;
+    for (size_t i = 0; i < lanesWith<T2>; i++)
+      res.val[i] = val[i] / x.val[i];
     return res;
   }
 
   template <typename T2>
     requires std::is_arithmetic_v<T2>
   VectorBase<T, n> &operator+=(T2 x) {
-    for (size_t i = 0; i < n; i++) val[i] += x;
+    for (size_t i = 0; i < lanes; i++) val[i] += x;
     return *this;
   }
 
   VectorBase<T, n> &operator+=(const VectorBase<T, n> &v) {
-    for (size_t i = 0; i < n; i++) val[i] += v.val[i];
+    for (size_t i = 0; i < lanes; i++) val[i] += v.val[i];
     return *this;
   }
 
   template <typename T2>
     requires std::is_arithmetic_v<T2>
   VectorBase<T, n> &operator-=(T2 x) {
-    for (size_t i = 0; i < n; i++) val[i] -= x;
+    for (size_t i = 0; i < lanes; i++) val[i] -= x;
     return *this;
   }
 
   VectorBase<T, n> &operator-=(const VectorBase<T, n> &v) {
-    for (size_t i = 0; i < n; i++) val[i] -= v.val[i];
+    for (size_t i = 0; i < lanes; i++) val[i] -= v.val[i];
     return *this;
   }
 
   template <typename T2>
     requires std::is_arithmetic_v<T2>
   VectorBase<T, n> &operator*=(T2 x) {
-    for (size_t i = 0; i < n; i++) val[i] *= x;
+    for (size_t i = 0; i < lanes; i++) val[i] *= x;
     return *this;
   }
 
   VectorBase<T, n> &operator*=(const VectorBase<T, n> &v) {
-    for (size_t i = 0; i < n; i++) val[i] *= v.val[i];
+    for (size_t i = 0; i < lanes; i++) val[i] *= v.val[i];
     return *this;
   }
 
   template <typename T2>
     requires std::is_arithmetic_v<T2>
   VectorBase<T, n> &operator/=(T2 x) {
-    for (size_t i = 0; i < n; i++) val[i] /= x;
+    for (size_t i = 0; i < lanes; i++) val[i] /= x;
     return *this;
   }
 
-  T dot(const VectorBase<T, n> &v) const {
+  constexpr T dot(const VectorBase<T, n> &v) const {
     T sum = 0;
     for (size_t i = 0; i < n; i++) sum += val[i] * v.val[i];
     return sum;
   }
 
   T pow() const { return dot(*this); }
-  decltype(auto) length() const { return sqrt(pow()); }
+  decltype(auto) length() const { return std::sqrt(pow()); }
 
   // 浮点型向量的归一化 (整型向量不支持此操作)
   template <typename U = T>
@@ -231,8 +283,8 @@ struct VectorBase {
   VectorBase<T, n> &normalize() {
     auto len2 = pow();
     if (std::abs(len2 - 1) < 1e-3) return *this;
-    mfloat invLen = 1 / sqrt(len2);
-    for (size_t i = 0; i < n; i++) val[i] *= invLen;
+    T invLen = 1 / std::sqrt(len2);
+    for (size_t i = 0; i < lanes; i++) val[i] *= invLen;
     return *this;
   }
 
@@ -242,8 +294,8 @@ struct VectorBase {
   VectorBase<T, n> &safeNormalize() {
     auto len2 = pow();
     if (std::abs(len2 - 1) < 1e-3) return *this;
-    auto invLen = 1 / std::max(sqrt(len2), static_cast<decltype(len2)>(1e-3));
-    for (size_t i = 0; i < n; i++) val[i] *= invLen;
+    auto invLen = 1 / std::max(std::sqrt(len2), static_cast<decltype(len2)>(1e-3));
+    for (size_t i = 0; i < lanes; i++) val[i] *= invLen;
     return *this;
   }
 #pragma endregion
@@ -264,6 +316,8 @@ struct Vector<T, 2> : VectorBase<T, 2> {
   Vector(VectorBase<T, 2> &&other) : VectorBase<T, 2>(std::move(other)) {}
   T &x() { return this->val[0]; }
   T &y() { return this->val[1]; }
+  const T &x() const { return this->val[0]; }
+  const T &y() const { return this->val[1]; }
 };
 
 template <typename T>
@@ -272,7 +326,7 @@ struct Vector<T, 3> : public VectorBase<T, 3> {
   Vector(const VectorBase<T, 3> &other) : VectorBase<T, 3>(other) {}
   Vector(VectorBase<T, 3> &&other) : VectorBase<T, 3>(std::move(other)) {}
 
-  Vector<T, 3> cross(const Vector<T, 3> &other) {
+  constexpr Vector<T, 3> cross(const Vector<T, 3> &other) const {
     Vector<T, 3> res;
     res.val[0] = this->val[1] * other.val[2] - this->val[2] * other.val[1];
     res.val[1] = this->val[2] * other.val[0] - this->val[0] * other.val[2];
@@ -286,6 +340,9 @@ struct Vector<T, 3> : public VectorBase<T, 3> {
   T &r() { return this->val[0]; }
   T &g() { return this->val[1]; }
   T &b() { return this->val[2]; }
+  const T &x() const { return this->val[0]; }
+  const T &y() const { return this->val[1]; }
+  const T &z() const { return this->val[2]; }
 };
 
 template <typename T>
@@ -301,6 +358,10 @@ struct Vector<T, 4> : public VectorBase<T, 4> {
   T &g() { return this->val[1]; }
   T &b() { return this->val[2]; }
   T &a() { return this->val[3]; }
+  const T &x() const { return this->val[0]; }
+  const T &y() const { return this->val[1]; }
+  const T &z() const { return this->val[2]; }
+  const T &w() const { return this->val[3]; }
 };
 #pragma endregion
 
@@ -321,24 +382,24 @@ using float4 = Vector<mfloat, 4>;
 // 浮点型向量的归一化 (整型向量不支持此操作)
 template <typename T, size_t n>
   requires std::floating_point<T>
-VectorBase<T, n> normalize(const VectorBase<T, n> &v) {
+Vector<T, n> normalize(const VectorBase<T, n> &v) {
   auto len2 = v.pow();
   if (std::abs(len2 - 1) < 1e-3) return v;
-  auto invLen = 1 / sqrt(len2);
-  VectorBase<T, n> res;
-  for (size_t i = 0; i < n; i++) res.val[i] = v.val[i] * invLen;
+  auto invLen = 1 / std::sqrt(len2);
+  Vector<T, n> res;
+  for (size_t i = 0; i < VectorLanes<T, n>; i++) res.val[i] = v.val[i] * invLen;
   return res;
 }
 
 // 浮点型向量的安全归一化 (整型向量不支持此操作)
 template <typename T, size_t n>
   requires std::floating_point<T>
-VectorBase<T, n> safeNormalize(const VectorBase<T, n> &v) {
+Vector<T, n> safeNormalize(const VectorBase<T, n> &v) {
   auto len2 = v.pow();
-  if (std::abs(len2 - 1) < 1e-3) return VectorBase<T, n>(v);
-  auto invLen = 1 / std::max(sqrt(len2), static_cast<decltype(len2)>(1e-3));
-  VectorBase<T, n> res;
-  for (size_t i = 0; i < n; i++) res.val[i] = v.val[i] * invLen;
+  if (std::abs(len2 - 1) < 1e-3) return Vector<T, n>(v);
+  auto invLen = 1 / std::max(std::sqrt(len2), static_cast<decltype(len2)>(1e-3));
+  Vector<T, n> res;
+  for (size_t i = 0; i < VectorLanes<T, n>; i++) res.val[i] = v.val[i] * invLen;
   return res;
 }
 #pragma endregion
@@ -368,14 +429,23 @@ void AssertVectorNormalized(const Vector<T, n> &v) {
 template <typename T, size_t n>
 Vector<T, n> abs(const Vector<T, n> &v) {
   Vector<T, n> res;
-  for (size_t i = 0; i < n; i++) res.val[i] = std::abs(v.val[i]);
+  for (size_t i = 0; i < res.lanes; i++) res.val[i] = std::abs(v.val[i]);
+  return res;
+}
+
+// largest absolute component
+template <typename T, size_t n>
+T maxAbs(const Vector<T, n> &v) {
+  T res = 0;
+  for (size_t i = 0; i < n; i++) res = std::max(res, std::abs(v.val[i]));
   return res;
 }
 
 template <typename T, size_t n>
 Vector<T, n> clamp(const Vector<T, n> &v, T min, T max) {
   Vector<T, n> res;
-  for (size_t i = 0; i < n; i++) res.val[i] = std::clamp(v.val[i], min, max);
+  for (size_t i = 0; i < res.lanes; i++)
+    res.val[i] = std::clamp(v.val[i], min, max);
   return res;
 }
 
@@ -393,8 +463,60 @@ inline float3 RandomInUnitSphere() {
   }
 }
 
+// Direct mappings of uniform numbers in [0, 1) onto shapes: no rejection
+// loop, a fixed count of numbers per point, and stratified numbers (see
+// Sampler.hpp) give stratified points.
+
+// uniform on the unit sphere
+inline float3 SampleUnitSphere(const float2 &u) {
+  mfloat z = 1 - 2 * u.x();
+  mfloat r = std::sqrt(std::max(1 - z * z, mfloat(0)));
+  mfloat phi = 2 * PI * u.y();
+  return float3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// uniform in the unit ball, the direction from u and the radius from w
+inline float3 SampleUnitBall(const float2 &u, mfloat w) {
+  return SampleUnitSphere(u) * std::cbrt(w);
+}
+
+// uniform in the unit disk, Shirley and Chiu's concentric mapping keeps
+// the strata of u together
+inline float2 SampleUnitDisk(const float2 &u) {
+  mfloat a = 2 * u.x() - 1, b = 2 * u.y() - 1;
+  if (a == 0 && b == 0) return float2(0, 0);
+  mfloat r, phi;
+  if (std::abs(a) > std::abs(b)) {
+    r = a;
+    phi = PI / 4 * (b / a);
+  } else {
+    r = b;
+    phi = PI / 2 - PI / 4 * (a / b);
+  }
+  return float2(r * std::cos(phi), r * std::sin(phi));
+}
+
+inline float3 RandomInUnitSphere(RNG &rng) {
+  mfloat u0 = rng.nextFloat(), u1 = rng.nextFloat();
+  return SampleUnitBall(float2(u0, u1), rng.nextFloat());
+}
+
 inline float3 RandomUnitVector() { return normalize(RandomInUnitSphere()); }
 
+inline float3 RandomUnitVector(RNG &rng) {
+  mfloat u0 = rng.nextFloat();
+  return SampleUnitSphere(float2(u0, rng.nextFloat()));
+}
+
+// u, v completing the unit vector w to an orthonormal basis (Duff et al.,
+// "Building an Orthonormal Basis, Revisited", JCGT 2017)
+inline void OrthonormalBasis(const float3 &w, float3 &u, float3 &v) {
+  mfloat sign = std::copysign(mfloat(1), w.z());
+  mfloat a = -1 / (sign + w.z()), b = w.x() * w.y() * a;
+  u = float3(1 + sign * w.x() * w.x() * a, sign * b, -sign * w.x());
+  v = float3(b, sign + w.y() * w.y() * a, -w.y());
+}
+
 inline float3 RandomOnHemisphere(const float3 &normal) {
   auto inUnitSphere = RandomInUnitSphere();
   if (inUnitSphere.dot(normal) > 0)
@@ -403,12 +525,9 @@ inline float3 RandomOnHemisphere(const float3 &normal) {
     return inUnitSphere * -1;
 }
 
-inline float2 RandomInUnitDisk() {
-  while (true) {
-    float2 vec(RandFloat(-1, 1), RandFloat(-1, 1));
-    auto pow = vec.pow();
-    if (pow <= 1) return vec;
-  }
+inline float2 RandomInUnitDisk(RNG &rng) {
+  mfloat u0 = rng.nextFloat();
+  return SampleUnitDisk(float2(u0, rng.nextFloat()));
 }
 
 inline float3 ReflectedVector(const float3 &rayIn, const float3 &normal) {
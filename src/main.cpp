@@ -1,9 +1,11 @@
 #pragma warning(disable : 4819)
 
-using mfloat = double;
-
 #include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
 #include <omp.h>
 
 #include "Color.hpp"
@@ -11,63 +13,186 @@ using mfloat = double;
 #include "Ray.hpp"
 #include "Sphere.hpp"
 #include "Camera.hpp"
+#include "SphereSet.hpp"
+#include "Scenes.hpp"
+#include "SceneFile.hpp"
+#include "Trace.hpp"
 
 const int width = 1920, height = 1080;
 
+// renderer options shared by the built-in scene and scene files, they
+// override what a scene file sets
+static void ApplyOption(Camera &camera, const std::string &option,
+                        const std::string &value) {
+  if (option == "--threads") {
+    camera.threadCount = std::stoi(value);
+  } else if (option == "--tile") {
+    camera.tileSize = std::stoi(value);
+  } else if (option == "--order") {
+    if (!ParseTileOrder(value, camera.tileOrder))
+      print("unknown tile order:", value);
+  } else if (option == "--packet") {
+    camera.packetSize = std::stoi(value);
+  } else if (option == "--pass-spp") {
+    camera.passSamples = std::stoi(value);
+  } else if (option == "--checkpoint") {
+    camera.checkpointPath = value;
+  } else if (option == "--checkpoint-interval") {
+    camera.checkpointInterval = std::stod(value);
+  } else if (option == "--status") {
+    camera.statusPath = value;
+  } else if (option == "--progress-interval") {
+    camera.progressInterval = std::stod(value);
+  } else if (option == "--adaptive") {
+    camera.adaptiveThreshold = std::stod(value);
+  } else if (option == "--min-spp") {
+    camera.adaptiveMinSamples = std::stoi(value);
+  } else if (option == "--max-spp") {
+    camera.adaptiveMaxSamples = std::stoi(value);
+  } else if (option == "--integrator") {
+    if (!ParseIntegrator(value, camera.integrator))
+      print("unknown integrator:", value);
+  } else if (option == "--sampler") {
+    if (!ParseSamplerType(value, camera.samplerType))
+      print("unknown sampler:", value);
+  } else if (option == "--sample-lights") {
+    camera.sampleLights = std::stoi(value) != 0;
+  } else if (option == "--denoise") {
+    camera.denoise = std::stoi(value) != 0;
+  } else if (option == "--aov") {
+    camera.outputFeatures = std::stoi(value) != 0;
+  } else if (option == "--feature-spp") {
+    camera.featureSamples = std::stoi(value);
+  } else if (option == "--spp") {
+    camera.samplesPerPixel = std::stoi(value);
+  } else {
+    print("unknown option:", option);
+  }
+}
+
+// object and allocation counts of the scene's arena, and the scene's total
+static void PrintMemory(const Scene &scene, size_t totalBytes) {
+  Arena::Stats stats = scene.arena.stats();
+  print("scene memory:", totalBytes / 1024.0, "KiB, arena:", stats.objects,
+        "objects in", stats.allocations, "allocations,",
+        stats.bytesUsed / 1024.0, "of", stats.bytesReserved / 1024.0,
+        "KiB used");
+}
+
+// tracePath: where to write the Chrome trace of the render, if not empty
+static void Render(Camera &camera, const Hittable &world,
+                   const std::string &name, const std::string &exeDir,
+                   const std::string &tracePath) {
+  timeTest([&]() -> void {
+    print("rendering", name + "...");
+
+    // render
+    bool printLog = camera.samplesPerPixel > 10;
+    auto image = camera.render(world, printLog);
+
+    // save image, lossless HDR first, then the tonemapped PNG
+    image.writeEXR((name + ".exr").c_str());
+    image.writePFM((name + ".pfm").c_str());
+    image.toImage().writePNG((name + ".png").c_str());
+    if (camera.adaptiveThreshold > 0)
+      camera.sampleHeatmap.toImage().writePNG((name + "_samples.png").c_str());
+    print("image saved at", exeDir + "/" + name + ".{png,exr,pfm}");
+    if (camera.denoise) {
+      camera.noisyImage.writePFM((name + "_noisy.pfm").c_str());
+      print("image before denoising saved at",
+            exeDir + "/" + name + "_noisy.pfm");
+    }
+    if (camera.outputFeatures) {
+      camera.features.albedo.writePFM((name + "_albedo.pfm").c_str());
+      camera.features.normal.writePFM((name + "_normal.pfm").c_str());
+      camera.features.depth.writePFM((name + "_depth.pfm").c_str());
+      print("feature buffers saved at",
+            exeDir + "/" + name + "_{albedo,normal,depth}.pfm");
+    }
+    if (tracePath.empty()) return;
+    if (WriteChromeTrace(tracePath, camera))
+      print("trace saved at", tracePath);
+    else
+      print("failed to write trace", tracePath);
+  });
+}
+
 int main(int argc, char **argv) {
   std::ios::sync_with_stdio(false);
 
-  // setup scene
-  HittableList scene;
-  auto groundMat = std::make_shared<Lambertian>(ColorF3(0.5, 0.5, 0.5));
-  scene.add(
-      std::make_shared<Sphere>(mfloat(1000), float3(0, -1000, 0), groundMat));
-
-  for (int a = -11; a < 11; a++) {
-    for (int b = -11; b < 11; b++) {
-      auto chooseMat = RandFloat();
-      float3 center(a + 0.9 * RandFloat(), 0.2, b + 0.9 * RandFloat());
-      if ((center - float3(4, 0.2, 0)).length() > 0.9) {
-        std::shared_ptr<Material> sphereMat;
-        if (chooseMat < 0.8) {
-          // diffuse
-          auto albedo = RandomUnitVector() * RandomUnitVector();
-          sphereMat = std::make_shared<Lambertian>(albedo);
-          scene.add(std::make_shared<Sphere>(mfloat(0.2), center, sphereMat));
-        } else if (chooseMat < 0.95) {
-          // metal
-          auto albedo = RandomUnitVector() / 2 + 0.5;
-          auto fuzz = RandFloat(0, 0.5);
-          sphereMat = std::make_shared<Metal>(albedo, fuzz);
-          scene.add(std::make_shared<Sphere>(mfloat(0.2), center, sphereMat));
-        } else {
-          // glass
-          sphereMat = std::make_shared<Dielectric>(mfloat(1.5));
-          scene.add(std::make_shared<Sphere>(mfloat(0.2), center, sphereMat));
-        }
-      }
-    }
+  // scene files: --scene PATH (repeatable, rendered one after another into
+  // <file stem>.{png,exr,pfm}), --write-scene PATH saves the built-in scene
+  // scheduler options: --threads N, --tile N, --order scanline|morton|hilbert
+  //                    --packet N (camera rays of N x N pixels at once)
+  // progressive options: --pass-spp N, --checkpoint PATH,
+  //                      --checkpoint-interval SECONDS
+  // progress: --status PATH, JSON status rewritten while rendering,
+  //           --progress-interval SECONDS
+  // adaptive sampling: --adaptive THRESHOLD, --min-spp N, --max-spp N
+  // integrator: --integrator megakernel|wavefront
+  // samples: --spp N, --sampler independent|sobol|bluenoise
+  // lights: --sample-lights 0|1, next-event estimation (default 1)
+  // denoising: --denoise 0|1, --aov 0|1 (write the feature buffers),
+  //            --feature-spp N (camera rays per pixel of the features)
+  // profiling: --trace PATH, Chrome trace of the render (with several scenes
+  // the scene's name is added to the file name)
+  std::vector<std::string> scenePaths;
+  std::string writeScenePath, tracePath;
+  std::vector<std::pair<std::string, std::string>> options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string option = argv[i], value = argv[i + 1];
+    if (option == "--scene") scenePaths.push_back(value);
+    else if (option == "--write-scene") writeScenePath = value;
+    else if (option == "--trace") tracePath = value;
+    else options.push_back({option, value});
   }
+  auto applyOptions = [&](Camera &camera) {
+    for (const auto &[option, value] : options)
+      ApplyOption(camera, option, value);
+  };
 
-  auto mat1 = std::make_shared<Dielectric>(mfloat(1.5));
-  scene.add(std::make_shared<Sphere>(mfloat(1.0), float3(0, 1, 0), mat1));
-
-  auto mat2 = std::make_shared<Lambertian>(ColorF3(0.4, 0.2, 0.1));
-  scene.add(std::make_shared<Sphere>(mfloat(1.0), float3(-4, 1, 0), mat2));
+  // one SceneFile for the whole sequence, every load reuses the arena of
+  // the scene before
+  SceneFile file;
+  for (const auto &path : scenePaths) {
+    try {
+      timeTest([&]() -> void {
+        file.load(path);
+        print("loaded", path, file.fromCache ? "from cache," : "and built,",
+              file.spheres.size(), "spheres,", file.triangleCount(),
+              "triangles,", file.instanceCount(), "instances");
+        PrintMemory(file.scene, file.memoryBytes());
+      });
+    } catch (const std::exception &e) {
+      print("failed to load scene:", e.what());
+      continue;
+    }
+    applyOptions(file.camera);
+    std::string name = std::filesystem::path(path).stem().string();
+    std::string trace = tracePath;
+    if (!trace.empty() && scenePaths.size() > 1) {
+      std::filesystem::path p(trace);
+      trace = (p.parent_path() /
+               (p.stem().string() + "_" + name + p.extension().string()))
+                  .string();
+    }
+    Render(file.camera, file.world(), name, get_dir(argv[0]), trace);
+  }
+  if (!scenePaths.empty()) return 0;
 
-  auto mat3 = std::make_shared<Metal>(ColorF3(0.7, 0.6, 0.5), mfloat(0.0));
-  scene.add(std::make_shared<Sphere>(mfloat(1.0), float3(4, 1, 0), mat3));
+  // setup scene
+  Scene scene = WeekendScene();
+  // every primitive of the weekend scene is a sphere
+  SphereSet spheres(scene.world);
+  PrintMemory(scene,
+              scene.arena.stats().bytesReserved + spheres.memoryBytes());
 
   // setup camera
-  CameraTransform camTrans{
-      float3(13, 2, 3),  // origin
-      float3(0, 0, 0),   // lookAt
-      float3(0, 1, 0)    // up
-  };
+  CameraTransform camTrans = WeekendCameraTransform();
 
   // defocus disk parameters
   mfloat angle = 2, foucsDist = 10, imageDist = 0.1;
-  std::cin >> angle >> foucsDist >> imageDist;
+  if (writeScenePath.empty()) std::cin >> angle >> foucsDist >> imageDist;
   DefocusDisk ddisk{angle, foucsDist, imageDist, camTrans};
 
   Camera camera{width, height,
@@ -76,18 +201,16 @@ int main(int argc, char **argv) {
   camera.samplesPerPixel = 4096;
   camera.maxDepth = 40;
 
-  timeTest([&]() -> void {
-    print("rendering...");
-
-    // render
-    bool printLog = camera.samplesPerPixel > 10;
-    auto image = camera.render(scene, printLog);
+  if (!writeScenePath.empty()) {
+    if (SceneFile::WriteJson(writeScenePath, scene, camera))
+      print("scene saved at", writeScenePath);
+    else
+      print("failed to write scene", writeScenePath);
+    return 0;
+  }
 
-    // save image
-    image.linearToGamma();
-    image.writePNG("test.png");
-    print("image saved at", get_dir(argv[0]) + "/test.png");
-  });
+  applyOptions(camera);
+  Render(camera, spheres, "test", get_dir(argv[0]), tracePath);
 
   return 0;
-}
\ No newline at end of file
+}
@@ -2,13 +2,75 @@ add_rules("mode.debug", "mode.release")
 
 add_requires("stb")
 
-target("rt_in_one_weekend")
-    set_kind("binary")
-    add_files("src/*.cpp")
+option("simd")
+    set_default("none")
+    set_showmenu(true)
+    set_values("none", "avx2", "avx512")
+    set_description("Instruction set of the SIMD intersection kernels")
+option_end()
+
+option("padded_vectors")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Store float3 in 4 aligned lanes (RT_PADDED_VECTORS)")
+option_end()
+
+option("counters")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Count BVH nodes, hit tests and path ends (RT_COUNTERS)")
+option_end()
+
+-- settings shared by the renderer and the benchmarks, precision "f32"
+-- renders in float (RT_FLOAT32), anything else in double
+local function add_renderer_settings(precision)
     add_packages("stb")
     set_languages("c++20")
     if is_plat("windows") then
         add_cxflags("/openmp")
     else
-        add_cxflags("-fopenmp")
-    end
\ No newline at end of file
+        -- no FMA contraction: the watertight triangle test relies on an
+        -- edge function of a shared edge being exactly negated in the
+        -- neighbouring triangle
+        add_cxflags("-fopenmp", "-ffp-contract=off")
+    end
+    if get_config("simd") == "avx2" then
+        add_vectorexts("avx2", "fma")
+    elseif get_config("simd") == "avx512" then
+        add_vectorexts("avx512", "fma")
+    end
+    if has_config("padded_vectors") then
+        add_defines("RT_PADDED_VECTORS")
+    end
+    if has_config("counters") then
+        add_defines("RT_COUNTERS")
+    end
+    if precision == "f32" then
+        add_defines("RT_FLOAT32")
+    end
+end
+
+-- every target comes in double precision and with an _f32 suffix in float
+local precisions = {{suffix = "", precision = "f64"}, {suffix = "_f32", precision = "f32"}}
+
+for _, p in ipairs(precisions) do
+    target("rt_in_one_weekend" .. p.suffix)
+        set_kind("binary")
+        set_default(p.precision == "f64")
+        add_files("src/*.cpp")
+        add_renderer_settings(p.precision)
+end
+
+
+-- benchmarks: every bench/*.cpp becomes its own target, run with
+-- `xmake build bench_<name> && xmake run bench_<name>`
+for _, file in ipairs(os.files("bench/*.cpp")) do
+    for _, p in ipairs(precisions) do
+        target("bench_" .. path.basename(file) .. p.suffix)
+            set_kind("binary")
+            set_default(false)
+            add_files(file)
+            add_includedirs("src")
+            add_renderer_settings(p.precision)
+    end
+end